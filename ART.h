@@ -17,6 +17,7 @@
 
 #include <algorithm>  // std::random_shuffle
 #include <array>
+#include <atomic>
 #include <cassert>
 #include <chrono>
 #include <cstdio>
@@ -25,47 +26,1469 @@
 #include <locale>
 #include <memory>
 #include <stdexcept>
+#include <type_traits>
+#include <vector>
 
 #include "ArtNode.h"  // ArtNode definitions
 #include "Chain.h"    // Chain definitions
 #include "Helper.h"   // Helper functions
+#include "KeyEncoding.h"  // Order-preserving encoders of typed keys
+#include "NodeAllocator.h"  // Slab allocator for inner nodes
 
 namespace ART {
 
+// Layout choices of a tree, fixed when it is constructed
+struct TreeOptions {
+    // Bytes per key, 4 or 8. Keys are compared byte by byte, most significant
+    // first, so 8-byte keys index 64-bit ids and timestamps in order.
+    // variableKeyLength makes the keys byte strings of any length, such as
+    // paths or URLs, which only ART itself inserts and looks up
+    unsigned keyLength = 4;
+    // Every leaf value equals its key, as in a set. The last key byte is then
+    // stored in bitmap nodes instead of Node4..Node256
+    bool selfKeyed = false;
+    // Colliding leaves are kept in sorted buckets of up to this many leaves
+    // before inner nodes are built for them, 0 disables buckets
+    unsigned bucketSize = 0;
+    // Pages that back the inner nodes, huge pages cut the dTLB misses of
+    // lookups in large trees
+    PageMode pageMode = PageMode::Regular;
+    // Every key carries the time it expires at, stored after its leaf record.
+    // Keys read as absent once the clock of the tree reaches it and are
+    // erased by ART::reapExpired(). Needs fixed-length keys and payloads
+    bool expiring = false;
+};
+
+// Counter written by the thread that owns a tree and read by any thread, such
+// as a monitor polling the tree during an ingest. With a single writer a
+// relaxed load and store do, no locked read-modify-write is needed
+class StatCounter {
+   public:
+    void add(ptrdiff_t delta) {
+        value.store(value.load(std::memory_order_relaxed) + delta,
+                    std::memory_order_relaxed);
+    }
+    size_t get() const { return value.load(std::memory_order_relaxed); }
+    void reset() { value.store(0, std::memory_order_relaxed); }
+
+   private:
+    std::atomic<size_t> value{0};
+};
+
+// Snapshot of the memory taken by a tree
+struct MemoryStats {
+    size_t nodes[numNodeTypes] = {};  // live inner nodes, indexed by type
+    size_t bytes[numNodeTypes] = {};  // bytes they take in the allocator
+    size_t leaves = 0;                // keys stored in the tree
+    size_t records = 0;               // leaves with a payload record
+    size_t recordBytes = 0;           // bytes the records take
+
+    size_t nodeBytes() const {
+        size_t total = 0;
+        for (int type = 0; type < numNodeTypes; type++) total += bytes[type];
+        return total;
+    }
+    // Pseudo-leaves are stored in their parents and take no memory of their
+    // own, leaves with a payload add their record
+    double bytesPerKey() const {
+        return leaves ? double(nodeBytes() + recordBytes) / leaves : 0;
+    }
+};
+
+// Order in which compact() lays out the inner nodes
+enum class LayoutOrder {
+    DepthFirst,   // preorder, every node is followed by its subtrees
+    VanEmdeBoas,  // the top half of the levels first, then every subtree of
+                  // the bottom half, each laid out the same way
+};
+
+// What an insert did with its key, see ART::try_insert()
+enum class InsertStatus {
+    Inserted,  // the key was new
+    Updated,   // the key was in the tree and got the new payload
+    Exists,    // the key was in the tree and kept its payload
+    Replaced,  // the key had expired, its leaf took the new payload
+};
+
+struct InsertResult {
+    InsertStatus status;
+    uint64_t oldPayload;  // payload of a key that was in the tree or expired
+};
+
+// Where a paged range scan continues, see ART::scan(). It holds keys only,
+// so it stays valid across inserts and erases between the pages
+struct ScanToken {
+    uint64_t next;  // smallest key of the next page
+    uint64_t hi;    // largest key of the range
+    bool done;      // no key of the range is left
+};
+
 class ART {
    public:
-    ArtNode* root;  // pointer to root node of tree
+    // Inner node bytes per key assumed when presizing the allocator. Sorted
+    // ingests need about 8, uniformly random 32-bit keys about 23; reserved
+    // but untouched memory is not committed by the OS
+    static const size_t reserveBytesPerKey = 24;
+
+    NodeRef root;   // pointer to root node of tree
     ArtNode* fp;    // pointer to fast path node
-    std::array<ArtNode*, maxPrefixLength> fp_path;  // path that leads to fp
-    std::array<ArtNode**, maxPrefixLength>
+    std::array<ArtNode*, maxKeyWidth> fp_path;  // path that leads to fp
+    std::array<NodeRef*, maxKeyWidth>
         fp_path_ref;        // references to nodes on fp_path
     size_t fp_path_length;  // stores length of fp path
-    ArtNode* fp_leaf;       // pointer to leaf node in fast path
+    FastPathLeaf fp_leaf;   // key of the leaf in fast path
     size_t fp_depth;        // depth that will be used during fp insertion
-    ArtNode** fp_ref;       // reference to fp node, used for insertion
+    NodeRef* fp_ref;       // reference to fp node, used for insertion
+    NodeAllocator allocator;  // owns all inner nodes, freed with the tree
+    // Live inner nodes, their bytes and the leaves, see memoryStats()
+    StatCounter nodeCounts[numNodeTypes];
+    StatCounter nodeBytes[numNodeTypes];
+    StatCounter leafCount;
+    StatCounter recordCount;
+    StatCounter recordBytes;
+    // Posting lists of keys with several payloads, freed with the tree
+    size_t postingLists;
+    // Payload of the key being inserted, see beginInsert(). A variable-length
+    // key is inserted with its terminated bytes as well
+    uint64_t insertPayload;
+    const uint8_t* insertKey;
+    unsigned insertKeyLength;
+    // Leaf that the last insert found its key in, null if the key was new or
+    // is kept in an interval or bitmap node
+    NodeRef* foundLeaf;
+    // Payload of the key the last erase removed, the key itself for one of
+    // an interval or bitmap node, and whether that key had expired
+    uint64_t erasedPayload;
+    bool erasedExpired;
+#ifdef ART_ORDER_STATISTICS
+    // Keys in the tree before the insert, see countInsert()
+    size_t insertLeaves;
+#endif
+    // Expiry of the key being inserted into an expiring tree, the current
+    // time of the tree and the key the reaper continues at
+    uint64_t insertExpiry;
+    uint64_t clock;
+    uintptr_t reapCursor;
+    // Path of the last erase of a fixed-length key, which the fast path is
+    // repaired from: per level the cell and the depth of a node, and the
+    // node as it was before the erase
+    std::array<NodeRef*, maxKeyWidth + 1> erasePathRef;
+    std::array<unsigned, maxKeyWidth + 1> erasePathDepth;
+    std::array<ArtNode*, maxKeyWidth + 1> erasePathNode;
+    const unsigned keyLength;     // see TreeOptions
+    const bool selfKeyed;         // see TreeOptions
+    const unsigned bucketSize;    // see TreeOptions
+    const bool expiring;          // see TreeOptions
+
+    // Expiry of keys that never expire
+    static const uint64_t noExpiry = UINT64_MAX;
+
+    // Largest bucket size, the capacity of a bucket is stored in a byte
+    static const unsigned maxBucketSize = 255;
 
     // constructor
-    ART()
+    explicit ART(const TreeOptions& options = TreeOptions())
         : root(nullptr),
           fp(nullptr),
           fp_path{nullptr},
+          fp_path_ref{nullptr},
           fp_path_length(0),
           fp_leaf(nullptr),
           fp_depth(0),
-          fp_ref(nullptr) {}
+          fp_ref(nullptr),
+          allocator(options.pageMode),
+          postingLists(0),
+          insertPayload(0),
+          insertKey(nullptr),
+          insertKeyLength(0),
+          foundLeaf(nullptr),
+          insertExpiry(noExpiry),
+          clock(0),
+          reapCursor(0),
+          erasePathRef{nullptr},
+          erasePathDepth{0},
+          erasePathNode{nullptr},
+          keyLength(options.keyLength),
+          selfKeyed(options.selfKeyed),
+          bucketSize(options.bucketSize),
+          expiring(options.expiring) {
+        if (keyLength != 4 && keyLength != maxKeyWidth &&
+            keyLength != variableKeyLength)
+            throw std::invalid_argument("key length must be 4, 8 or 0");
+        if (keyLength == variableKeyLength && (selfKeyed || bucketSize))
+            throw std::invalid_argument(
+                "variable-length keys need neither self-keyed trees nor "
+                "buckets");
+        if (bucketSize == 1 || bucketSize > maxBucketSize)
+            throw std::invalid_argument("bucket size must be 0 or 2..255");
+        if (expiring && (selfKeyed || keyLength == variableKeyLength))
+            throw std::invalid_argument(
+                "expiring keys need fixed-length keys with payloads");
+#ifdef ART_COMPRESSED_CHILDREN
+        if (expiring)
+            throw std::invalid_argument("leaf records need 64-bit children");
+#endif
+    }
+
+    virtual ~ART() {
+        if (postingLists) freePostings(root);
+    }
+
+    ART(const ART&) = delete;
+    ART& operator=(const ART&) = delete;
+
+    // Presize the allocator for a tree holding numKeys keys
+    void reserve(size_t numKeys) {
+        allocator.reserve(numKeys * reserveBytesPerKey);
+    }
+
+    // Release the whole tree in one step and reset the fast path
+    void clear() {
+        if (postingLists) freePostings(root);
+        postingLists = 0;
+        allocator.release();
+        root = nullptr;
+        fp = nullptr;
+        fp_path.fill(nullptr);
+        fp_path_ref.fill(nullptr);
+        fp_path_length = 0;
+        fp_leaf = nullptr;
+        fp_depth = 0;
+        fp_ref = nullptr;
+        for (int type = 0; type < numNodeTypes; type++) {
+            nodeCounts[type].reset();
+            nodeBytes[type].reset();
+        }
+        leafCount.reset();
+        recordCount.reset();
+        recordBytes.reset();
+    }
+
+    // Read the node and leaf counters, cheap enough to poll while the tree
+    // is being built
+    MemoryStats memoryStats() const {
+        MemoryStats stats;
+        for (int type = 0; type < numNodeTypes; type++) {
+            stats.nodes[type] = nodeCounts[type].get();
+            stats.bytes[type] = nodeBytes[type].get();
+        }
+        stats.leaves = leafCount.get();
+        stats.records = recordCount.get();
+        stats.recordBytes = recordBytes.get();
+        return stats;
+    }
+
+    // Account for an inner node that was allocated (+1) or is freed (-1)
+    void countNode(ArtNode* node, ptrdiff_t delta) {
+        nodeCounts[node->type].add(delta);
+        nodeBytes[node->type].add(
+            delta * ptrdiff_t(NodeAllocator::allocationSize(nodeSize(node))));
+    }
+
+    // Start the insert of a key with an arbitrary payload. The payload is
+    // kept for addLeaf(), and the key is returned as the value that the
+    // insert paths compare and that pseudo-leaves store
+    uintptr_t beginInsert(uint8_t key[], uint64_t payload) {
+        if (keyLength == variableKeyLength)
+            throw std::invalid_argument(
+                "variable-length keys are inserted with their length");
+        return beginInsert(keyValue(key, keyLength), payload);
+    }
+
+    // Start the insert of a key given as an integer
+    uintptr_t beginInsert(uint64_t value, uint64_t payload) {
+        if (keyLength == variableKeyLength)
+            throw std::invalid_argument(
+                "variable-length keys are inserted with their length");
+        if (keyLength < 8 && value >> (8 * keyLength))
+            throw std::invalid_argument("the key is wider than the tree");
+#ifdef ART_COMPRESSED_CHILDREN
+        if (value > maxHandleValue)
+            throw std::invalid_argument(
+                "a tree of 32-bit children stores keys below 2^31");
+#endif
+        // Keys too wide for a pseudo-leaf need a leaf record as well
+        if (payload != value || !fitsInLeaf(value)) {
+#ifdef ART_COMPRESSED_CHILDREN
+            throw std::invalid_argument(
+                "leaf records need 64-bit children");
+#endif
+            if (selfKeyed)
+                throw std::invalid_argument(
+                    "a self-keyed tree stores keys below 2^62 as leaves");
+        }
+        insertPayload = payload;
+        insertExpiry = noExpiry;
+#ifdef ART_ORDER_STATISTICS
+        insertLeaves = leafCount.get();
+#endif
+        return value;
+    }
+
+    // The leaf of a value that is new to the tree, counted as it is stored.
+    // Its payload goes to a leaf record unless it equals the key
+    ArtNode* addLeaf(uintptr_t value) {
+        leafCount.add(1);
+        if (keyLength != variableKeyLength && !expiring &&
+            insertPayload == value && fitsInLeaf(value))
+            return makeLeaf(value);
+        return addRecordLeaf(value, insertPayload);
+    }
+
+    // A leaf with a record for a value and its payload, not counted as a leaf
+    ArtNode* addRecordLeaf(uintptr_t value, uint64_t payload) {
+        bool variable = keyLength == variableKeyLength;
+        size_t size = sizeof(LeafRecord) + (variable ? insertKeyLength : 0) +
+                      (expiring ? sizeof(uint64_t) : 0);
+        recordCount.add(1);
+        recordBytes.add(NodeAllocator::allocationSize(size));
+        LeafRecord* record =
+            static_cast<LeafRecord*>(allocator.allocate(size));
+        record->key = value;
+        record->payload = payload;
+        if (expiring) recordExpiry(record) = insertExpiry;
+        if (variable) {
+            record->key = insertKeyLength;
+            memcpy(record + 1, insertKey, insertKeyLength);
+        }
+        return makeRecordLeaf(record);
+    }
+
+    // Is the leaf at leafRef the one of the key being inserted. It is then
+    // kept as it is and remembered, insert_or_assign() and upsert() give it
+    // the new payload afterwards
+    bool isFoundLeaf(NodeRef* leafRef, uintptr_t value) {
+        ArtNode* leaf = *leafRef;
+        if (keyLength == variableKeyLength) {
+            if (leafRecord(leaf)->key != insertKeyLength ||
+                memcmp(recordKey(leafRecord(leaf)), insertKey,
+                       insertKeyLength) != 0)
+                return false;
+        } else if (getLeafValue(leaf) != value) {
+            return false;
+        }
+        foundLeaf = leafRef;
+        return true;
+    }
+
+    // Give the key that the last insert found in the tree a new payload
+    void assignPayload(uintptr_t value, uint64_t payload) {
+        if (!foundLeaf) {
+            // Interval and bitmap nodes hold keys that are their own payload
+            if (payload != value)
+                throw std::invalid_argument(
+                    "a self-keyed tree stores keys as their payload");
+            return;
+        }
+        ArtNode* leaf = *foundLeaf;
+        if (isPostingLeaf(leaf)) {
+            // The payload replaces all of the key
+            ArtNode* newLeaf = addRecordLeaf(value, payload);
+            freeRecord(leaf);
+            replaceOnFastPath(leaf, newLeaf);
+            *foundLeaf = newLeaf;
+            return;
+        }
+        if (isRecordLeaf(leaf)) {
+            leafRecord(leaf)->payload = payload;
+            if (expiring) recordExpiry(leafRecord(leaf)) = insertExpiry;
+            return;
+        }
+        if (payload == value) return;
+#ifdef ART_COMPRESSED_CHILDREN
+        throw std::invalid_argument("leaf records need 64-bit children");
+#endif
+        if (selfKeyed)
+            throw std::invalid_argument(
+                "a self-keyed tree stores keys as their payload");
+        // The pseudo-leaf gets a record for its payload
+        ArtNode* newLeaf = addRecordLeaf(value, payload);
+        replaceOnFastPath(leaf, newLeaf);
+        *foundLeaf = newLeaf;
+    }
+
+    // Bytes of the record of a leaf, with the key of a variable-length one
+    size_t recordSize(ArtNode* leaf) const {
+        if (isPostingLeaf(leaf))
+            return sizeof(LeafRecord) + sizeof(PostingList*);
+        if (keyLength == variableKeyLength)
+            return sizeof(LeafRecord) + leafRecord(leaf)->key;
+        return sizeof(LeafRecord) + (expiring ? sizeof(uint64_t) : 0);
+    }
 
+    // Uncount a leaf that was removed from the tree and free its record.
+    // What the erase returns is read from the record first
+    void dropLeaf(ArtNode* leaf) {
+        leafCount.add(-1);
+        erasedPayload = getLeafPayload(leaf);
+        erasedExpired = expiring && isExpired(leaf);
+        if (isRecordLeaf(leaf)) freeRecord(leaf);
+    }
+
+    // Free the record of a leaf, with the payload list of a posting leaf
+    void freeRecord(ArtNode* leaf) {
+        if (isPostingLeaf(leaf)) {
+            PostingList* list = recordPostings(leafRecord(leaf));
+            recordBytes.add(-ptrdiff_t(list->bytes()));
+            delete list;
+            postingLists--;
+        }
+        size_t size = recordSize(leaf);
+        recordCount.add(-1);
+        recordBytes.add(-ptrdiff_t(NodeAllocator::allocationSize(size)));
+        allocator.deallocate(leafRecord(leaf), size);
+    }
+
+    // Insert a key with its payload. A key that is already in the tree keeps
+    // its payload, as with try_insert()
     void insert(uint8_t key[], uintptr_t value) {
-        insert(this, root, &root, key, 0, value, maxPrefixLength);
+        value = beginInsert(key, value);
+        if (expiring)
+            insertOnce(key, value);
+        else
+            insertValue(key, value);
+    }
+
+    // Insert a key given as an integer, its bytes are only built for the
+    // descent. Without a payload the key is its own payload
+    void insert(uint64_t key, uint64_t payload) {
+        uintptr_t value = beginInsert(key, payload);
+        uint8_t bytes[maxKeyWidth];
+        loadKey(value, bytes, keyLength);
+        if (expiring)
+            insertOnce(bytes, value);
+        else
+            insertValue(bytes, value);
+    }
+    void insert(uint64_t key) { insert(key, key); }
+
+    // Insert a key that is not in the tree yet. A key that is keeps its
+    // payload, which is returned with InsertStatus::Exists
+    InsertResult try_insert(uint8_t key[], uint64_t payload) {
+        uintptr_t value = beginInsert(key, payload);
+        return insertOnce(key, value);
+    }
+    InsertResult try_insert(uint64_t key, uint64_t payload) {
+        uintptr_t value = beginInsert(key, payload);
+        uint8_t bytes[maxKeyWidth];
+        loadKey(value, bytes, keyLength);
+        return insertOnce(bytes, value);
+    }
+
+    // Insert a key, or give it the new payload if it is already in the tree.
+    // Returns InsertStatus::Updated with the old payload then
+    InsertResult insert_or_assign(uint8_t key[], uint64_t payload) {
+        return upsert(key, payload, [](uint64_t, uint64_t p) { return p; });
+    }
+    InsertResult insert_or_assign(uint64_t key, uint64_t payload) {
+        return upsert(key, payload, [](uint64_t, uint64_t p) { return p; });
+    }
+
+    // Insert a key with payload, or if it is already in the tree give it
+    // merge(oldPayload, payload), such as a sum or the larger of both
+    template <typename Merge>
+    InsertResult upsert(uint8_t key[], uint64_t payload, Merge merge) {
+        InsertResult result = try_insert(key, payload);
+        return mergePayload(result, keyValue(key, keyLength), payload, merge);
+    }
+    template <typename Merge>
+    InsertResult upsert(uint64_t key, uint64_t payload, Merge merge) {
+        InsertResult result = try_insert(key, payload);
+        return mergePayload(result, key, payload, merge);
+    }
+
+    // Insert a key of an expiring tree that expires at the given time, given
+    // as an integer. The forms without one insert keys that never expire, an
+    // assigned key gets the new expiry with its payload
+    InsertResult try_insert(uint64_t key, uint64_t payload,
+                            uint64_t expiresAt) {
+        uintptr_t value = beginExpiringInsert(key, payload, expiresAt);
+        uint8_t bytes[maxKeyWidth];
+        loadKey(value, bytes, keyLength);
+        return insertOnce(bytes, value);
+    }
+    InsertResult insert_or_assign(uint64_t key, uint64_t payload,
+                                  uint64_t expiresAt) {
+        InsertResult result = try_insert(key, payload, expiresAt);
+        return mergePayload(result, key, payload,
+                            [](uint64_t, uint64_t p) { return p; });
+    }
+
+    // Set the current time of an expiring tree, in the unit of the expiry
+    // times. Keys that expire at or before it read as absent
+    void setClock(uint64_t now) { clock = now; }
+
+    // The time a key of an expiring tree expires at
+    uint64_t getExpiry(ArtNode* leaf) const {
+        return recordExpiry(leafRecord(leaf));
+    }
+
+    // The same three for a tree of variable-length keys
+    InsertResult try_insert(const uint8_t key[], unsigned length,
+                            uint64_t payload) {
+        if (keyLength != variableKeyLength)
+            throw std::invalid_argument(
+                "the keys of this tree are fixed-length");
+        TerminatedKey terminated(key, length);
+        insertPayload = payload;
+        insertKey = terminated.bytes;
+        insertKeyLength = terminated.size;
+        InsertResult result = insertOnce(terminated.bytes, 0);
+        insertKey = nullptr;
+        return result;
+    }
+    InsertResult insert_or_assign(const uint8_t key[], unsigned length,
+                                  uint64_t payload) {
+        return upsert(key, length, payload,
+                      [](uint64_t, uint64_t p) { return p; });
+    }
+    template <typename Merge>
+    InsertResult upsert(const uint8_t key[], unsigned length,
+                        uint64_t payload, Merge merge) {
+        InsertResult result = try_insert(key, length, payload);
+        return mergePayload(result, 0, payload, merge);
+    }
+
+    // Does a key go below the fast path node, equal to the fp leaf in every
+    // byte but the last. One masked compare against the cached key
+    bool onFastPath(uintptr_t value) const {
+        return ((value ^ getLeafValue(fp_leaf)) >> 8) == 0;
+    }
+
+    // Insert a key of length bytes with its payload into a tree of
+    // variable-length keys. Every leaf gets a record with the terminated key
+    void insert(const uint8_t key[], unsigned length, uint64_t payload) {
+        try_insert(key, length, payload);
+    }
+
+    // Add a payload to a key that may have others, as in a multimap. A key
+    // with one payload is stored as any other, the second one turns its leaf
+    // into a posting leaf that refers to the sorted list of all. lookup()
+    // finds the leaf with the smallest payload. Returns the number of
+    // payloads of the key
+    size_t insert_dup(uint8_t key[], uint64_t payload) {
+        checkDuplicates();
+        if (try_insert(key, payload).status == InsertStatus::Inserted)
+            return 1;
+        return addDuplicate(keyValue(key, keyLength), payload);
+    }
+    size_t insert_dup(uint64_t key, uint64_t payload) {
+        checkDuplicates();
+        if (try_insert(key, payload).status == InsertStatus::Inserted)
+            return 1;
+        return addDuplicate(key, payload);
+    }
+
+    // Remove one occurrence of a payload of a key. The key is erased with its
+    // last payload and stored as a unique key again once it has one left.
+    // Returns false if the key does not have the payload
+    bool erase_one(uint64_t key, uint64_t payload) {
+        checkDuplicates();
+        if (keyLength < 8 && key >> (8 * keyLength)) return false;
+        uint8_t bytes[maxKeyWidth];
+        loadKey(key, bytes, keyLength);
+        NodeRef* leafRef = findLeafRef(bytes);
+        if (leafRef == NULL) return false;
+        ArtNode* leaf = *leafRef;
+        if (!isPostingLeaf(leaf)) {
+            if (getLeafPayload(leaf) != payload) return false;
+            return eraseKey(bytes, key);
+        }
+        PostingList* list = recordPostings(leafRecord(leaf));
+        size_t listBytes = list->bytes();
+        if (!list->erase(payload)) return false;
+        recordBytes.add(ptrdiff_t(list->bytes()) - ptrdiff_t(listBytes));
+        if (list->size() > 1) {
+            leafRecord(leaf)->payload = list->front();
+            return true;
+        }
+        ArtNode* newLeaf = fitsInLeaf(key) && list->front() == key
+                               ? makeLeaf(key)
+                               : addRecordLeaf(key, list->front());
+        freeRecord(leaf);
+        replaceOnFastPath(leaf, newLeaf);
+        *leafRef = newLeaf;
+        return true;
+    }
+
+    // Number of payloads of a leaf
+    static size_t payloadCount(ArtNode* leaf) {
+        return isPostingLeaf(leaf) ? recordPostings(leafRecord(leaf))->size()
+                                   : 1;
+    }
+
+    // Call visit with every payload of a leaf in ascending order, such as a
+    // leaf of a range lookup. Returns their number
+    template <typename Visit>
+    static size_t forEachPayload(ArtNode* leaf, Visit visit) {
+        if (!isPostingLeaf(leaf)) {
+            visit(getLeafPayload(leaf));
+            return 1;
+        }
+        PostingList* list = recordPostings(leafRecord(leaf));
+        list->forEach(visit);
+        return list->size();
+    }
+
+    // The same for the payloads of a key, none if it is not in the tree
+    template <typename Visit>
+    size_t forEachPayload(uint64_t key, Visit visit) {
+        ArtNode* leaf = lookup(key);
+        return leaf ? forEachPayload(leaf, visit) : 0;
+    }
+
+    // Call visit with the leaf of every key from lo to hi, in key order.
+    // The walk is depth-first and allocates nothing: children outside the
+    // bounds are skipped and subtrees within them are visited without
+    // comparing keys. Expired keys are skipped. A visit that returns false
+    // ends the scan after its key. Returns the number of keys visited
+    template <typename Visit>
+    size_t scan(uint64_t lo, uint64_t hi, Visit&& visit) {
+        size_t count = 0;
+        scanFrom(lo, hi, visit, count);
+        return count;
+    }
+    template <typename Visit>
+    size_t scan(uint8_t lo[], uint8_t hi[], Visit&& visit) {
+        return scan(uint64_t(keyValue(lo, keyLength)),
+                    uint64_t(keyValue(hi, keyLength)), visit);
+    }
+
+    // The same into a buffer the caller keeps across scans, the leaves are
+    // appended to out
+    size_t scan(uint64_t lo, uint64_t hi, std::vector<ArtNode*>& out) {
+        return scan(lo, hi, [&out](ArtNode* leaf) { out.push_back(leaf); });
+    }
+
+    // A page of a range scan: visit at most limit keys from lo to hi, fewer
+    // if visit returns false. The token continues the scan after the last
+    // key visited, with a descent along that key instead of a scan from lo
+    template <typename Visit>
+    ScanToken scan(uint64_t lo, uint64_t hi, size_t limit, Visit&& visit) {
+        if (limit == 0) return {lo, hi, lo > hi};
+        size_t visited = 0;
+        uint64_t last = 0;
+        auto page = [&](ArtNode* leaf) {
+            last = getLeafValue(leaf);
+            return visitLeaf(visit, leaf) && ++visited < limit;
+        };
+        size_t count = 0;
+        if (scanFrom(lo, hi, page, count) || last >= hi)
+            return {hi, hi, true};
+        return {last + 1, hi, false};
+    }
+
+    // The next page of a scan
+    template <typename Visit>
+    ScanToken scan(const ScanToken& token, size_t limit, Visit&& visit) {
+        if (token.done) return token;
+        return scan(token.next, token.hi, limit, visit);
+    }
+
+    // Call visit with every payload of the keys from low to high, in key
+    // order and ascending within a key. Returns their number
+    template <typename Visit>
+    size_t scanPayloads(uint64_t low, uint64_t high, Visit visit) {
+        size_t count = 0;
+        scan(low, high, [&](ArtNode* leaf) {
+            count += forEachPayload(leaf, visit);
+        });
+        return count;
+    }
+
+#ifdef ART_ORDER_STATISTICS
+    // Number of keys below key. Every inner node counts the keys below it,
+    // so the descent adds up the children left of the path of key: it reads
+    // as many nodes as a lookup, however many keys it counts
+    uint64_t rank(uint64_t key) {
+        checkOrderStatistics();
+        return countBelow(key, false);
+    }
+    uint64_t rank(uint8_t key[]) {
+        return rank(uint64_t(keyValue(key, keyLength)));
+    }
+
+    // The leaf of the key with rank k, the smallest key has rank 0. NULL if
+    // the tree has no more than k keys
+    ArtNode* select(uint64_t k) {
+        checkOrderStatistics();
+        ArtNode* node = root;
+        if (k >= subtreeSize(node)) return NULL;
+        while (!isLeaf(node)) {
+            switch (node->type) {
+                case NodeTypeInterval:
+                    return makeLeaf(static_cast<NodeInterval*>(node)->lo + k);
+                case NodeTypeBucket:
+                    return static_cast<NodeBucket*>(node)->child[k];
+                case NodeTypeBitmap: {
+                    NodeBitmap* bitmap = static_cast<NodeBitmap*>(node);
+                    return bitmap->leaf(bitmap->nthSet(k));
+                }
+            }
+            // Skip whole children from the end of node nearer to rank k
+            if (k < node->leaves / 2) {
+                for (int slot = nextSlot(node, -1);;
+                     slot = nextSlot(node, slot)) {
+                    ArtNode* child = slotChild(node, slot);
+                    uint64_t size = subtreeSize(child);
+                    if (k < size) {
+                        node = child;
+                        break;
+                    }
+                    k -= size;
+                }
+            } else {
+                uint64_t fromEnd = node->leaves - 1 - k;
+                for (int slot = prevSlot(node, 256);;
+                     slot = prevSlot(node, slot)) {
+                    ArtNode* child = slotChild(node, slot);
+                    uint64_t size = subtreeSize(child);
+                    if (fromEnd < size) {
+                        node = child;
+                        k = size - 1 - fromEnd;
+                        break;
+                    }
+                    fromEnd -= size;
+                }
+            }
+        }
+        return node;
+    }
+
+    // Number of keys from lo to hi, in two descents
+    uint64_t count(uint64_t lo, uint64_t hi) {
+        checkOrderStatistics();
+        if (lo > hi) return 0;
+        return countBelow(hi, true) - countBelow(lo, false);
+    }
+    uint64_t count(uint8_t lo[], uint8_t hi[]) {
+        return count(uint64_t(keyValue(lo, keyLength)),
+                     uint64_t(keyValue(hi, keyLength)));
+    }
+#endif
+
+   protected:
+    // The descent of an insert, from the root or the fast path of the tree.
+    // A key that is already in the tree is left as it is
+    virtual void insertValue(uint8_t key[], uintptr_t value) {
+        insert(this, root, &root, key, 0, value, keyLength);
+        countInsert(&root);
+    }
+
+    // Insert a value in one descent. The leaf count tells whether its key
+    // was new, a key that was not is found in a leaf or a self-keyed node
+    InsertResult insertOnce(uint8_t key[], uintptr_t value) {
+        size_t leaves = leafCount.get();
+        foundLeaf = nullptr;
+        // The fast paths of the QuART trees need fixed-length keys
+        if (keyLength == variableKeyLength)
+            ART::insertValue(key, value);
+        else
+            insertValue(key, value);
+        if (leafCount.get() != leaves) return {InsertStatus::Inserted, 0};
+        if (expiring && foundLeaf && isExpired(*foundLeaf)) {
+            // An expired key reads as absent, the insert takes its leaf over.
+            // The caller gets the payload it had, such as to free it
+            LeafRecord* record = leafRecord(*foundLeaf);
+            uint64_t oldPayload = record->payload;
+            record->payload = insertPayload;
+            recordExpiry(record) = insertExpiry;
+            return {InsertStatus::Replaced, oldPayload};
+        }
+        uint64_t oldPayload = foundLeaf ? getLeafPayload(*foundLeaf) : value;
+        return {InsertStatus::Exists, oldPayload};
+    }
+
+    // Count a new key in the node at nodeRef once the insert below it is
+    // done, so each level of the descent is counted as it returns. An insert
+    // that started at the fast path counts it in the first above nodes of
+    // fp_path as well, which it did not descend through. Nodes the insert
+    // created add up their children, grown ones kept the count they had
+#ifdef ART_ORDER_STATISTICS
+    void countInsert(NodeRef* nodeRef, size_t above = 0) {
+        if (keyLength == variableKeyLength || leafCount.get() == insertLeaves)
+            return;
+        for (size_t i = 0; i < above; i++) fp_path[i]->leaves++;
+        ArtNode* node = *nodeRef;
+        if (isLeaf(node) || isTerminal(node) || node->type == NodeTypeBitmap)
+            return;
+        if (node->leaves != 0)
+            node->leaves++;
+        else
+            node->leaves = countChildren(node);
+    }
+#else
+    void countInsert(NodeRef*, size_t = 0) {}
+#endif
+
+    // Start the insert of a key that expires
+    uintptr_t beginExpiringInsert(uint64_t key, uint64_t payload,
+                                  uint64_t expiresAt) {
+        if (!expiring)
+            throw std::invalid_argument("the keys of this tree do not expire");
+        uintptr_t value = beginInsert(key, payload);
+        insertExpiry = expiresAt;
+        return value;
+    }
+
+    // Keys with several payloads keep their list after the record
+    void checkDuplicates() const {
+#ifdef ART_COMPRESSED_CHILDREN
+        throw std::invalid_argument("leaf records need 64-bit children");
+#endif
+        if (selfKeyed || expiring || keyLength == variableKeyLength)
+            throw std::invalid_argument(
+                "duplicate keys need fixed-length keys with payloads that do "
+                "not expire");
+    }
+
+#ifdef ART_ORDER_STATISTICS
+    // Expired keys are counted until they are reaped, and variable-length
+    // keys are not counted at all
+    void checkOrderStatistics() const {
+        if (expiring || keyLength == variableKeyLength)
+            throw std::invalid_argument(
+                "order statistics need fixed-length keys that do not expire");
+    }
+
+    // Number of keys below key, or not above it if inclusive
+    uint64_t countBelow(uint64_t key, bool inclusive) {
+        if (keyLength < 8 && key >> (8 * keyLength)) return subtreeSize(root);
+        uint8_t bytes[maxKeyWidth];
+        loadKey(key, bytes, keyLength);
+        uint64_t below = 0;
+        ArtNode* node = root;
+        unsigned depth = 0;
+        while (node != NULL) {
+            if (isLeaf(node)) {
+                uintptr_t value = getLeafValue(node);
+                return below + (value < key || (inclusive && value == key));
+            }
+            if (node->type == NodeTypeInterval) {
+                NodeInterval* interval = static_cast<NodeInterval*>(node);
+                if (key < interval->lo) return below;
+                if (key > interval->hi) return below + subtreeSize(node);
+                return below + (key - interval->lo) + inclusive;
+            }
+            if (node->type == NodeTypeBucket) {
+                NodeBucket* bucket = static_cast<NodeBucket*>(node);
+                unsigned pos = bucket->lowerBound(key);
+                if (inclusive && pos < bucket->count &&
+                    getLeafValue(bucket->child[pos]) == key)
+                    pos++;
+                return below + pos;
+            }
+            unsigned pos = prefixMismatch(node, bytes, depth, keyLength);
+            if (pos != node->prefixLength) {
+                // All keys below node are on the same side of key
+                uint8_t buffer[maxKeyWidth];
+                uint8_t prefixByte =
+                    pos < maxPrefixLength
+                        ? node->prefix[pos]
+                        : leafKey(minimum(node), buffer,
+                                  keyLength)[depth + pos];
+                if (prefixByte > bytes[depth + pos]) return below;
+                return below + subtreeSize(node);
+            }
+            depth += node->prefixLength;
+            uint8_t keyByte = bytes[depth];
+            if (node->type == NodeTypeBitmap) {
+                NodeBitmap* bitmap = static_cast<NodeBitmap*>(node);
+                return below + bitmap->countBelow(keyByte) +
+                       (inclusive && bitmap->contains(keyByte));
+            }
+            // The children of smaller key bytes are below key. Those of a
+            // large key byte are the count of node but those of larger ones
+            int slot;
+            if (keyByte < 128) {
+                slot = nextSlot(node, -1);
+                for (; slot >= 0 && slotKey(node, slot) < keyByte;
+                     slot = nextSlot(node, slot))
+                    below += subtreeSize(slotChild(node, slot));
+                if (slot < 0 || slotKey(node, slot) != keyByte) return below;
+            } else {
+                uint64_t above = 0;
+                slot = prevSlot(node, 256);
+                for (; slot >= 0 && slotKey(node, slot) > keyByte;
+                     slot = prevSlot(node, slot))
+                    above += subtreeSize(slotChild(node, slot));
+                below += node->leaves - above;
+                if (slot < 0 || slotKey(node, slot) != keyByte) return below;
+                below -= subtreeSize(slotChild(node, slot));
+            }
+            node = slotChild(node, slot);
+            depth++;
+        }
+        return below;
+    }
+
+    // Subtract one from the key counts of the inner nodes on the path of an
+    // erased key. The nodes the erase created have no count yet, they add up
+    // their children, from the bottom up. Shrunk nodes kept the count of the
+    // node they replaced
+    void countErase(uint8_t key[]) {
+        std::array<ArtNode*, maxKeyWidth> path;
+        unsigned height = 0, depth = 0;
+        ArtNode* node = root;
+        while (node != NULL && !isLeaf(node) && !isTerminal(node) &&
+               node->type != NodeTypeBitmap &&
+               prefixMismatch(node, key, depth, keyLength) ==
+                   node->prefixLength) {
+            path[height++] = node;
+            depth += node->prefixLength;
+            node = *findChild(node, key[depth++]);
+        }
+        while (height > 0) {
+            node = path[--height];
+            if (node->leaves != 0)
+                node->leaves--;
+            else
+                node->leaves = countChildren(node);
+        }
+    }
+
+    // Keys below a node that an insert or erase just created
+    uint64_t countChildren(ArtNode* node) {
+        uint64_t leaves = 0;
+        for (int slot = nextSlot(node, -1); slot >= 0;
+             slot = nextSlot(node, slot))
+            leaves += subtreeSize(slotChild(node, slot));
+        return leaves;
+    }
+#endif
+
+    // Add a payload to the key that the last insert found in the tree
+    size_t addDuplicate(uintptr_t value, uint64_t payload) {
+        ArtNode* leaf = *foundLeaf;
+        if (isPostingLeaf(leaf)) {
+            PostingList* list = recordPostings(leafRecord(leaf));
+            size_t listBytes = list->bytes();
+            list->insert(payload);
+            recordBytes.add(ptrdiff_t(list->bytes()) - ptrdiff_t(listBytes));
+            leafRecord(leaf)->payload = list->front();
+            return list->size();
+        }
+        // The second payload, the leaf gets a record with a list
+        size_t size = sizeof(LeafRecord) + sizeof(PostingList*);
+        LeafRecord* record =
+            static_cast<LeafRecord*>(allocator.allocate(size));
+        PostingList* list = new PostingList(getLeafPayload(leaf), payload);
+        record->key = value;
+        record->payload = list->front();
+        recordPostings(record) = list;
+        postingLists++;
+        recordCount.add(1);
+        recordBytes.add(NodeAllocator::allocationSize(size) + list->bytes());
+        ArtNode* newLeaf = makePostingLeaf(record);
+        if (isRecordLeaf(leaf)) freeRecord(leaf);
+        replaceOnFastPath(leaf, newLeaf);
+        *foundLeaf = newLeaf;
+        return 2;
+    }
+
+    // Merge the payload into a key that an insert found in the tree
+    template <typename Merge>
+    InsertResult mergePayload(InsertResult result, uintptr_t value,
+                              uint64_t payload, Merge merge) {
+        if (result.status != InsertStatus::Exists) return result;
+        assignPayload(value, merge(result.oldPayload, payload));
+        result.status = InsertStatus::Updated;
+        return result;
+    }
+
+   public:
+    // Are the children of a node at this depth stored in a bitmap node
+    bool bitmapLevel(unsigned depth) const {
+        return selfKeyed && depth == keyLength - 1;
+    }
+
+    // Put an empty bitmap node in place of a leaf being expanded at the last
+    // key byte of a self-keyed tree. The caller inserts both leaves into it
+    NodeBitmap* newBitmapNode(NodeRef* nodeRef, ArtNode* leaf, uint8_t key[],
+                              unsigned depth, unsigned prefixLength) {
+        NodeBitmap* newNode = allocNode<NodeBitmap>(this);
+        newNode->prefixLength = prefixLength;
+        memcpy(newNode->prefix, key + depth,
+               min(prefixLength, maxPrefixLength));
+        newNode->base = getLeafValue(leaf) & ~uintptr_t(0xFF);
+        *nodeRef = newNode;
+        // The leaf is counted again when the caller inserts its bit
+        leafCount.add(-1);
+        return newNode;
+    }
+
+    // Are colliding leaves at this depth gathered in a bucket. The last key
+    // byte of a self-keyed tree goes to a bitmap node instead
+    bool bucketLevel(unsigned depth) const {
+        return bucketSize != 0 &&
+               depth < keyLength - (selfKeyed ? 1 : 0);
+    }
+
+    // Capacity of a bucket for count leaves: it fills whole cache lines,
+    // doubling their number as it grows, up to the bucket size
+    unsigned bucketCapacity(unsigned count) const {
+        size_t lines = 1;
+        while (NodeBucket::capacityFor(lines) < count) lines *= 2;
+        return std::min(NodeBucket::capacityFor(lines), bucketSize);
+    }
+
+    // Put a bucket holding leaf in its place, at a depth where another leaf
+    // collides with it. The caller inserts the new leaf into it
+    NodeBucket* newBucket(NodeRef* nodeRef, ArtNode* leaf, unsigned depth) {
+        NodeBucket* bucket = allocBucket(this, bucketCapacity(2), depth);
+        bucket->child[0] = leaf;
+        bucket->count = 1;
+        *nodeRef = bucket;
+        replaceOnFastPath(leaf, bucket);
+        return bucket;
+    }
+
+    // Move the leaves of a bucket into a new one of the given capacity
+    NodeBucket* resizeBucket(NodeRef* nodeRef, NodeBucket* bucket,
+                             unsigned capacity) {
+        NodeBucket* newNode = allocBucket(this, capacity, bucket->depth);
+        newNode->count = bucket->count;
+        memcpy(newNode->child, bucket->child,
+               bucket->count * sizeof(NodeRef));
+        *nodeRef = newNode;
+        replaceOnFastPath(bucket, newNode);
+        freeNode(this, bucket);
+        return newNode;
+    }
+
+    // Add a value to the bucket at nodeRef, growing it if needed. Returns
+    // false if the bucket was full, it is then burst and the caller continues
+    // the insert at *nodeRef
+    bool insertIntoBucket(NodeRef* nodeRef, NodeBucket* bucket,
+                          uintptr_t value) {
+        unsigned pos = bucket->lowerBound(value);
+        if (pos < bucket->count && isFoundLeaf(&bucket->child[pos], value))
+            return true;
+        if (bucket->count == bucket->capacity) {
+            if (bucket->capacity == bucketSize) {
+                burstBucket(nodeRef, bucket, value);
+                return false;
+            }
+            bucket = resizeBucket(nodeRef, bucket,
+                                  bucketCapacity(bucket->count + 1));
+        }
+        memmove(bucket->child + pos + 1, bucket->child + pos,
+                (bucket->count - pos) * sizeof(NodeRef));
+        bucket->child[pos] = addLeaf(value);
+        bucket->count++;
+        return true;
+    }
+
+    // Remove a value from the bucket at nodeRef. The last leaf left takes
+    // the place of the bucket, and a mostly empty bucket is shrunk
+    void eraseFromBucket(NodeRef* nodeRef, NodeBucket* bucket,
+                         uintptr_t value) {
+        unsigned pos = bucket->lowerBound(value);
+        if (pos == bucket->count || getLeafValue(bucket->child[pos]) != value)
+            return;
+        dropLeaf(bucket->child[pos]);
+        memmove(bucket->child + pos, bucket->child + pos + 1,
+                (bucket->count - pos - 1) * sizeof(NodeRef));
+        bucket->count--;
+        if (bucket->count == 1) {
+            *nodeRef = bucket->child[0];
+            replaceOnFastPath(bucket, *nodeRef);
+            freeNode(this, bucket);
+        } else if (bucket->count * 4 <= bucket->capacity &&
+                   bucketCapacity(bucket->count) < bucket->capacity) {
+            resizeBucket(nodeRef, bucket, bucketCapacity(bucket->count));
+        }
+    }
+
+    // Replace a full bucket by an inner node at the first key byte where its
+    // leaves and value are not all equal. Its children are smaller buckets,
+    // single leaves, or bits of a bitmap node at the last key byte
+    void burstBucket(NodeRef* nodeRef, NodeBucket* bucket, uintptr_t value) {
+        uint8_t loKey[maxKeyWidth], hiKey[maxKeyWidth], key[maxKeyWidth];
+        loadKey(getLeafValue(bucket->child[0]), loKey, keyLength);
+        loadKey(getLeafValue(bucket->child[bucket->count - 1]), hiKey,
+                keyLength);
+        loadKey(value, key, keyLength);
+        unsigned depth = bucket->depth;
+        unsigned pos = depth;
+        while (loKey[pos] == hiKey[pos] && loKey[pos] == key[pos]) pos++;
+        unsigned shift = 8 * (keyLength - 1 - pos);
+        auto keyByteAt = [&](unsigned i) -> uint8_t {
+            return (getLeafValue(bucket->child[i]) >> shift) & 0xFF;
+        };
+
+        ArtNode* newNode;
+        if (bitmapLevel(pos)) {
+            NodeBitmap* bitmap = allocNode<NodeBitmap>(this);
+            bitmap->base = getLeafValue(bucket->child[0]) & ~uintptr_t(0xFF);
+            for (unsigned i = 0; i < bucket->count; i++)
+                bitmap->bits[keyByteAt(i) >> 6] |= uint64_t(1)
+                                                   << (keyByteAt(i) & 63);
+            bitmap->count = bucket->count;
+            newNode = bitmap;
+        } else {
+            // Leave room for the child of value
+            unsigned children = 2;
+            for (unsigned i = 1; i < bucket->count; i++)
+                if (keyByteAt(i) != keyByteAt(i - 1)) children++;
+            newNode = newInnerNode(children);
+            *nodeRef = newNode;
+            for (unsigned from = 0, to; from < bucket->count; from = to) {
+                to = from + 1;
+                while (to < bucket->count && keyByteAt(to) == keyByteAt(from))
+                    to++;
+                ArtNode* child = bucket->child[from];
+                if (to - from > 1) {
+                    NodeBucket* childBucket =
+                        allocBucket(this, bucketCapacity(to - from), pos + 1);
+                    childBucket->count = to - from;
+                    memcpy(childBucket->child, bucket->child + from,
+                           (to - from) * sizeof(NodeRef));
+                    child = childBucket;
+                }
+                insertChild(this, nodeRef, newNode, keyByteAt(from), child);
+            }
+        }
+        newNode->prefixLength = pos - depth;
+        memcpy(newNode->prefix, loKey + depth,
+               min(newNode->prefixLength, maxPrefixLength));
+        *nodeRef = newNode;
+        replaceOnFastPath(bucket, newNode);
+        freeNode(this, bucket);
+    }
+
+    // Add a value to the interval or bucket node at nodeRef. Returns false if
+    // the node was split or burst instead, the caller then continues the
+    // insert at *nodeRef
+    bool insertIntoTerminal(NodeRef* nodeRef, ArtNode* node,
+                            uintptr_t value) {
+        if (node->type == NodeTypeBucket)
+            return insertIntoBucket(nodeRef, static_cast<NodeBucket*>(node),
+                                    value);
+        return insertIntoInterval(nodeRef, static_cast<NodeInterval*>(node),
+                                  value);
+    }
+
+    // Remove a value from the interval or bucket node at nodeRef. Returns
+    // false if an interval was split instead, the caller then continues the
+    // erase at *nodeRef
+    bool eraseFromTerminal(NodeRef* nodeRef, ArtNode* node, uintptr_t value) {
+        if (node->type == NodeTypeBucket) {
+            eraseFromBucket(nodeRef, static_cast<NodeBucket*>(node), value);
+            return true;
+        }
+        return eraseFromInterval(nodeRef, static_cast<NodeInterval*>(node),
+                                 value);
+    }
+
+    // Inner node with room for the given number of children
+    ArtNode* newInnerNode(unsigned children) {
+        if (children <= 4) return allocNode<Node4>(this);
+        if (ladderNode8 && children <= 8) return allocNode<Node8>(this);
+        if (children <= 16) return allocNode<Node16>(this);
+        if (ladderNode32 && children <= 32) return allocNode<Node32>(this);
+        if (children <= 48) return allocNode<Node48>(this);
+        return allocNode<Node256>(this);
+    }
+
+    // Point the fast path at newNode where it referred to node, after node
+    // was replaced in place
+    void replaceOnFastPath(ArtNode* node, ArtNode* newNode) {
+        if (fp == node) fp = newNode;
+        for (size_t i = 0; i < fp_path_length; i++)
+            if (fp_path[i] == node) fp_path[i] = newNode;
+    }
+
+    // Add a value to the interval node at nodeRef. Returns false if the value
+    // neither lies in it nor extends it, the interval is then split and the
+    // caller continues the insert at *nodeRef
+    bool insertIntoInterval(NodeRef* nodeRef, NodeInterval* interval,
+                            uintptr_t value) {
+        assert(selfKeyed);
+        if (interval->contains(value)) return true;
+        if (interval->extendsTo(value)) {
+            interval->extend(value);
+            leafCount.add(1);
+            return true;
+        }
+        splitInterval(nodeRef, interval, value);
+        return false;
+    }
+
+    // Remove a value from the interval node at nodeRef. Returns false if the
+    // value is inside the interval and not one of its bounds, the interval is
+    // then split and the caller continues the erase at *nodeRef
+    bool eraseFromInterval(NodeRef* nodeRef, NodeInterval* interval,
+                           uintptr_t value) {
+        if (!interval->contains(value)) return true;
+        if (value != interval->lo && value != interval->hi) {
+            splitInterval(nodeRef, interval, value);
+            return false;
+        }
+        leafCount.add(-1);
+        if (interval->lo + 1 == interval->hi) {
+            // A single key is left, it becomes a leaf
+            *nodeRef = makeLeaf(value == interval->lo ? interval->hi
+                                                      : interval->lo);
+            replaceOnFastPath(interval, *nodeRef);
+            freeNode(this, interval);
+        } else if (value == interval->lo) {
+            interval->lo++;
+        } else {
+            interval->hi--;
+        }
+        return true;
+    }
+
+    // Replace an interval node by an inner node at the first key byte where
+    // the bounds of the interval and value are not all equal. Its children
+    // cover the same keys as smaller intervals, single leaves, or bits of a
+    // bitmap node at the last key byte
+    void splitInterval(NodeRef* nodeRef, NodeInterval* interval,
+                       uintptr_t value) {
+        uint8_t loKey[maxKeyWidth], hiKey[maxKeyWidth], key[maxKeyWidth];
+        loadKey(interval->lo, loKey, keyLength);
+        loadKey(interval->hi, hiKey, keyLength);
+        loadKey(value, key, keyLength);
+        unsigned depth =
+            keyLength - __builtin_popcountll(interval->mask) / 8;
+        unsigned pos = depth;
+        while (loKey[pos] == hiKey[pos] && loKey[pos] == key[pos]) pos++;
+
+        ArtNode* newNode;
+        if (pos == keyLength - 1) {
+            NodeBitmap* bitmap = allocNode<NodeBitmap>(this);
+            bitmap->base = interval->lo & ~uintptr_t(0xFF);
+            for (unsigned b = loKey[pos]; b <= hiKey[pos]; b++)
+                bitmap->bits[b >> 6] |= uint64_t(1) << (b & 63);
+            bitmap->count = hiKey[pos] - loKey[pos] + 1;
+            newNode = bitmap;
+        } else {
+            // Leave room for the child of value
+            unsigned children = hiKey[pos] - loKey[pos] + 2;
+            newNode = newInnerNode(children);
+            *nodeRef = newNode;
+            uintptr_t childMask = subtreeMask(pos + 1, keyLength);
+            unsigned shift = 8 * (keyLength - 1 - pos);
+            for (uintptr_t from = interval->lo;; from++) {
+                uintptr_t to = std::min(interval->hi, from | childMask);
+                ArtNode* child = makeLeaf(from);
+                if (from != to) {
+                    NodeInterval* childInterval = allocNode<NodeInterval>(this);
+                    childInterval->lo = from;
+                    childInterval->hi = to;
+                    childInterval->mask = childMask;
+                    child = childInterval;
+                }
+                insertChild(this, nodeRef, newNode, (from >> shift) & 0xFF,
+                                 child);
+                if (to == interval->hi) break;
+                from = to;
+            }
+        }
+        newNode->prefixLength = pos - depth;
+        memcpy(newNode->prefix, loKey + depth,
+               min(newNode->prefixLength, maxPrefixLength));
+        *nodeRef = newNode;
+        replaceOnFastPath(interval, newNode);
+        freeNode(this, interval);
     }
 
     ArtNode* lookup(uint8_t key[]) {
-        return lookup(root, key, maxPrefixLength, 0, maxPrefixLength);
+        // Fixed key lengths take the unrolled descent, on a copy of the key
+        // as wide as the widest key
+        if (keyLength == variableKeyLength)
+            return liveLeaf(lookup(root, key, keyLength, 0, keyLength));
+        return lookup(uint64_t(keyValue(key, keyLength)));
+    }
+
+    // Find the leaf of a key given as an integer, NULL if it is not in the
+    // tree or is wider than the keys of the tree
+    ArtNode* lookup(uint64_t key) {
+        return liveLeaf(lookupStored(key));
+    }
+
+    // The same, but a key that expired and is not reaped yet is found too,
+    // such as by the owner of what its payload refers to
+    ArtNode* lookupStored(uint64_t key) {
+        if (keyLength == variableKeyLength)
+            throw std::invalid_argument(
+                "variable-length keys are looked up with their length");
+        if (keyLength < 8 && key >> (8 * keyLength)) return NULL;
+        uint8_t bytes[maxKeyWidth] = {};
+        loadKey(key, bytes, keyLength);
+        return lookupFixed(bytes, key);
+    }
+
+    // The same through the descent for any key length, which lookup()
+    // replaces by one unrolled for the fixed key lengths. Kept to compare
+    // both, see run -g
+    ArtNode* lookupGeneric(uint64_t key) {
+        if (keyLength == variableKeyLength)
+            throw std::invalid_argument(
+                "variable-length keys are looked up with their length");
+        if (keyLength < 8 && key >> (8 * keyLength)) return NULL;
+        uint8_t bytes[maxKeyWidth];
+        loadKey(key, bytes, keyLength);
+        return liveLeaf(lookup(root, bytes, keyLength, 0, keyLength));
     }
 
+    // Find the leaf of a key of length bytes in a tree of variable-length
+    // keys, NULL if it is not in the tree
+    ArtNode* lookup(const uint8_t key[], unsigned length) {
+        if (keyLength != variableKeyLength)
+            throw std::invalid_argument(
+                "the keys of this tree are fixed-length");
+        TerminatedKey terminated(key, length);
+        return lookup(root, terminated.bytes, terminated.size, 0,
+                      variableKeyLength);
+    }
+
+    // Erase a key with its payloads, false if it is not in the tree. An
+    // expired key is erased as well but was absent already, the descent that
+    // erases it tells. The fast path
+    // stays where the variant keeps it, only the part of it below the node
+    // the erase changed is followed again
+    bool erase(uint8_t key[]) {
+        if (keyLength == variableKeyLength)
+            throw std::invalid_argument(
+                "variable-length keys are erased with their length");
+        uintptr_t value = keyValue(key, keyLength);
+        return eraseKey(key, value) && !erasedExpired;
+    }
+    bool erase(uint64_t key) {
+        if (keyLength == variableKeyLength)
+            throw std::invalid_argument(
+                "variable-length keys are erased with their length");
+        if (keyLength < 8 && key >> (8 * keyLength)) return false;
+        uint8_t bytes[maxKeyWidth];
+        loadKey(key, bytes, keyLength);
+        return eraseKey(bytes, key) && !erasedExpired;
+    }
+
+    // Erase a key and give the payload it had, the smallest of a key with
+    // several, such as to free what the payload refers to. Unlike erase(),
+    // an expired key counts as found. False if the key was not stored
+    bool extract(uint64_t key, uint64_t& payload) {
+        if (keyLength == variableKeyLength)
+            throw std::invalid_argument(
+                "variable-length keys are erased with their length");
+        if (keyLength < 8 && key >> (8 * keyLength)) return false;
+        uint8_t bytes[maxKeyWidth];
+        loadKey(key, bytes, keyLength);
+        if (!eraseKey(bytes, key)) return false;
+        payload = erasedPayload;
+        return true;
+    }
+
+    // Erase a key of length bytes from a tree of variable-length keys
+    bool erase(const uint8_t key[], unsigned length) {
+        if (keyLength != variableKeyLength)
+            throw std::invalid_argument(
+                "the keys of this tree are fixed-length");
+        TerminatedKey terminated(key, length);
+        return erase(root, &root, terminated.bytes, terminated.size, 0,
+                     variableKeyLength) >= 0;
+    }
+
+    // The leaves of the keys from l_key to h_key as a Chain in key order.
+    // Bounds shorter than maxKeyLength are padded with zero bytes. scan()
+    // visits the same leaves without building a Chain
     Chain* rangelookup(uint8_t l_key[], unsigned l_keyLength, uint8_t h_key[],
                        uint8_t h_keyLength, unsigned maxKeyLength) {
-        return rangelookup(root, l_key, l_keyLength, h_key, h_keyLength,
-                           maxKeyLength);
+        if (keyLength == variableKeyLength)
+            throw std::invalid_argument(
+                "range lookups need fixed-length keys");
+        uint64_t lValue = 0, hValue = 0;
+        for (unsigned i = 0; i < maxKeyLength; i++) {
+            lValue = (lValue << 8) | (i < l_keyLength ? l_key[i] : 0);
+            hValue = (hValue << 8) | (i < h_keyLength ? h_key[i] : 0);
+        }
+        Chain* result = new Chain();
+        scan(lValue, hValue, [result](ArtNode* leaf) {
+            result->extend_item(new ChainItem(leaf));
+        });
+        return result;
+    }
+
+    // Has a key of an expiring tree expired
+    bool isExpired(ArtNode* leaf) const {
+        return recordExpiry(leafRecord(leaf)) <= clock;
+    }
+
+    // The leaf a lookup found, NULL if its key expired
+    ArtNode* liveLeaf(ArtNode* leaf) const {
+        if (expiring && leaf && isExpired(leaf)) return NULL;
+        return leaf;
+    }
+
+    // Erase the expired keys among the next batch keys, in key order from
+    // where the last call stopped and wrapping around after the largest key.
+    // Returns the number of keys erased. Scans are bounded by the batch, so
+    // the reaper can run between other operations
+    size_t reapExpired(size_t batch) {
+        return reapExpired(batch, [](uint64_t) {});
+    }
+
+    // The same, calling erased(payload) with the payload of every key it
+    // erases, such as to free what the payload refers to
+    template <typename Erased>
+    size_t reapExpired(size_t batch, Erased erased) {
+        if (!expiring || root == nullptr) return 0;
+        std::vector<ArtNode*> expired;
+        size_t scanned = 0;
+        if (findExpired(root, batch, scanned, expired)) reapCursor = 0;
+        uint8_t key[maxKeyWidth];
+        // A leaf and its record stay valid until its own key is erased
+        for (ArtNode* leaf : expired) {
+            uintptr_t value = getLeafValue(leaf);
+            erased(getLeafPayload(leaf));
+            loadKey(value, key, keyLength);
+            eraseKey(key, value);
+        }
+        return expired.size();
+    }
+
+    // Point the fast path along the path of the largest key, down to the
+    // deepest inner node on it, a state every variant starts an insert from
+    // correctly. The insert moves the fast path back to where the variant
+    // keeps it
+    virtual void resetFastPath() {
+        fp_path.fill(nullptr);
+        fp_path_ref.fill(nullptr);
+        fp_path_length = 0;
+        fp_depth = 0;
+        if (root == nullptr) {
+            fp = nullptr;
+            fp_ref = nullptr;
+            fp_leaf = nullptr;
+            return;
+        }
+        fp_leaf = maximum(root);
+        descendFastPath(root, &root, 0);
+    }
+
+    // Extend the fast path from node, at the given depth, along the key of
+    // the fp leaf down to the deepest inner node on its path
+    void descendFastPath(ArtNode* node, NodeRef* nodeRef, unsigned depth) {
+        uint8_t key[maxKeyWidth];
+        loadKey(getLeafValue(fp_leaf), key, keyLength);
+        for (;;) {
+            fp_path[fp_path_length] = node;
+            fp_path_ref[fp_path_length++] = nodeRef;
+            fp = node;
+            fp_ref = nodeRef;
+            fp_depth = depth;
+            if (isLeaf(node) || isTerminal(node) ||
+                node->type == NodeTypeBitmap)
+                return;
+            depth += node->prefixLength;
+            NodeRef* child = findChild(node, key[depth]);
+            if (isLeaf(*child)) return;
+            node = *child;
+            nodeRef = child;
+            depth++;
+        }
     }
 
     void printTree() { printTree(this->root, 0); }
@@ -133,6 +1556,30 @@ class ART {
                     }
                     break;
                 }
+                case NodeType8: {
+                    Node8* node = static_cast<Node8*>(current);
+                    if (node->count > 0) {
+                        // Move to the last child (rightmost)
+                        current = node->child[node->count - 1];
+                    } else {
+                        std::cerr << "Error: NodeType8 has no children."
+                                  << std::endl;
+                        return false;
+                    }
+                    break;
+                }
+                case NodeType32: {
+                    Node32* node = static_cast<Node32*>(current);
+                    if (node->count > 0) {
+                        // Move to the last child (rightmost)
+                        current = node->child[node->count - 1];
+                    } else {
+                        std::cerr << "Error: NodeType32 has no children."
+                                  << std::endl;
+                        return false;
+                    }
+                    break;
+                }
                 case NodeType48: {
                     Node48* node = static_cast<Node48*>(current);
                     unsigned pos = 255;
@@ -162,6 +1609,12 @@ class ART {
                     }
                     break;
                 }
+                case NodeTypeBitmap:
+                case NodeTypeInterval:
+                case NodeTypeBucket:
+                    // Leaves only, the fp path never continues below it
+                    current = maximum(current);
+                    break;
                 default:
                     std::cerr << "Error: Unknown node type." << std::endl;
                     return false;
@@ -173,27 +1626,101 @@ class ART {
         return false;
     }
 
+    // Copy every inner node into fresh slabs in the given order, so that
+    // nodes scattered by inserts and erases are contiguous again. Leaf
+    // records follow the node that refers to them. Child references and the
+    // fast path are moved over and the old slabs are freed. Returns the
+    // number of nodes moved
+    size_t compact(LayoutOrder order = LayoutOrder::DepthFirst) {
+        std::vector<ArtNode*> nodes;
+        if (order == LayoutOrder::DepthFirst)
+            layoutDepthFirst(root, nodes);
+        else
+            layoutVanEmdeBoas(root, subtreeHeight(root), nodes);
+
+        NodeAllocator fresh(allocator.pageMode);
+        size_t bytes = 0;
+        for (ArtNode* node : nodes)
+            bytes += NodeAllocator::allocationSize(nodeSize(node));
+        bytes += recordBytes.get();
+        fresh.reserve(bytes);
+        // Pairs of old node or record leaf and its copy, sorted by the old
+        // address
+        std::vector<std::pair<ArtNode*, ArtNode*>> moved;
+        moved.reserve(nodes.size());
+        if (isRecordLeaf(root)) moveRecord(fresh, root, moved);
+        for (ArtNode* node : nodes) {
+            size_t size = nodeSize(node);
+            ArtNode* copy = static_cast<ArtNode*>(fresh.allocate(size));
+            memcpy(copy, node, size);
+            moved.emplace_back(node, copy);
+            NodeRef* slots;
+            unsigned count = childSlots(copy, &slots);
+            for (unsigned i = 0; i < count; i++)
+                if (isRecordLeaf(slots[i]))
+                    slots[i] = moveRecord(fresh, slots[i], moved);
+        }
+        std::sort(moved.begin(), moved.end());
+
+        for (auto& entry : moved) {
+            if (isLeaf(entry.second)) continue;
+            NodeRef* slots;
+            unsigned count = childSlots(entry.second, &slots);
+            for (unsigned i = 0; i < count; i++)
+                if (slots[i] && !isLeaf(slots[i]))
+                    slots[i] = movedNode(moved, slots[i]);
+        }
+        root = movedNode(moved, root);
+        fp = movedNode(moved, fp);
+        fp_ref = movedRef(moved, fp_ref);
+        for (size_t i = 0; i < maxKeyWidth; i++) {
+            fp_path[i] = movedNode(moved, fp_path[i]);
+            fp_path_ref[i] = movedRef(moved, fp_path_ref[i]);
+        }
+        // The old slabs go with fresh
+        allocator.swap(fresh);
+        return nodes.size();
+    }
+
    private:
     // Void insert function
-    void insert(ART* tree, ArtNode* node, ArtNode** nodeRef, uint8_t key[],
+    void insert(ART* tree, ArtNode* node, NodeRef* nodeRef, uint8_t key[],
                 unsigned depth, uintptr_t value, unsigned maxKeyLength) {
         // Insert the leaf value into the tree
 
         if (node == NULL) {
-            *nodeRef = makeLeaf(value);
+            *nodeRef = addLeaf(value);
             return;
         }
 
+        // The key is already in the tree
+        if (isLeaf(node) && isFoundLeaf(nodeRef, value)) return;
+
+        if (isLeaf(node) && bucketLevel(depth)) {
+            // Gather the colliding leaves in a bucket instead
+            node = newBucket(nodeRef, node, depth);
+        }
+
         if (isLeaf(node)) {
             // Replace leaf with Node4 and store both leaves in it
-            uint8_t existingKey[maxKeyLength];
-            loadKey(getLeafValue(node), existingKey);
+            uint8_t buffer[maxKeyWidth];
+            const uint8_t* existingKey = leafKey(node, buffer, maxKeyLength);
             unsigned newPrefixLength = 0;
             while (existingKey[depth + newPrefixLength] ==
                    key[depth + newPrefixLength])
                 newPrefixLength++;
 
-            Node4* newNode = new Node4();
+            if (bitmapLevel(depth + newPrefixLength)) {
+                NodeBitmap* newNode =
+                    newBitmapNode(nodeRef, node, key, depth, newPrefixLength);
+                newNode->insertBitmap(this, nodeRef,
+                                      existingKey[depth + newPrefixLength]);
+                newNode->insertBitmap(this, nodeRef,
+                                      key[depth + newPrefixLength]);
+                return;
+            }
+
+            Node4* newNode = allocNode<Node4>(this);
             newNode->prefixLength = newPrefixLength;
             memcpy(newNode->prefix, key + depth,
                    min(newPrefixLength, maxPrefixLength));
@@ -202,17 +1729,24 @@ class ART {
             newNode->insertNode4(this, nodeRef,
                                  existingKey[depth + newPrefixLength], node);
             newNode->insertNode4(this, nodeRef, key[depth + newPrefixLength],
-                                 makeLeaf(value));
+                                 addLeaf(value));
             return;
         }
 
+        if (isTerminal(node)) {
+            // Add to the interval or bucket in place, or split it and insert
+            // below
+            if (insertIntoTerminal(nodeRef, node, value)) return;
+            node = *nodeRef;
+        }
+
         // Handle prefix of inner node
         if (node->prefixLength) {
             unsigned mismatchPos =
                 prefixMismatch(node, key, depth, maxKeyLength);
             if (mismatchPos != node->prefixLength) {
                 // Prefix differs, create new node
-                Node4* newNode = new Node4();
+                Node4* newNode = allocNode<Node4>(this);
                 *nodeRef = newNode;
                 newNode->prefixLength = mismatchPos;
                 memcpy(newNode->prefix, node->prefix,
@@ -226,46 +1760,87 @@ class ART {
                             min(node->prefixLength, maxPrefixLength));
                 } else {
                     node->prefixLength -= (mismatchPos + 1);
-                    uint8_t minKey[maxKeyLength];
-                    loadKey(getLeafValue(minimum(node)), minKey);
+                    uint8_t buffer[maxKeyWidth];
+                    const uint8_t* minKey =
+                        leafKey(minimum(node), buffer, maxKeyLength);
                     newNode->insertNode4(this, nodeRef,
                                          minKey[depth + mismatchPos], node);
                     memmove(node->prefix, minKey + depth + mismatchPos + 1,
                             min(node->prefixLength, maxPrefixLength));
                 }
                 newNode->insertNode4(this, nodeRef, key[depth + mismatchPos],
-                                     makeLeaf(value));
+                                     addLeaf(value));
                 return;
             }
             depth += node->prefixLength;
         }
 
         // Recurse
-        ArtNode** child = findChild(node, key[depth]);
+        NodeRef* child = findChild(node, key[depth]);
         if (*child) {
             insert(tree, *child, child, key, depth + 1, value, maxKeyLength);
+            countInsert(child);
             return;
         }
 
         // Insert leaf into inner node
-        ArtNode* newNode = makeLeaf(value);
-        switch (node->type) {
-            case NodeType4:
-                static_cast<Node4*>(node)->insertNode4(this, nodeRef,
-                                                       key[depth], newNode);
-                break;
-            case NodeType16:
-                static_cast<Node16*>(node)->insertNode16(this, nodeRef,
-                                                         key[depth], newNode);
-                break;
-            case NodeType48:
-                static_cast<Node48*>(node)->insertNode48(this, nodeRef,
-                                                         key[depth], newNode);
-                break;
-            case NodeType256:
-                static_cast<Node256*>(node)->insertNode256(this, nodeRef,
-                                                           key[depth], newNode);
-                break;
+        if (node->type == NodeTypeBitmap)
+            static_cast<NodeBitmap*>(node)->insertBitmap(this, nodeRef,
+                                                         key[depth]);
+        else
+            insertChild(this, nodeRef, node, key[depth], addLeaf(value));
+    }
+
+    // The descent of a lookup of a fixed-length key
+    ArtNode* lookupFixed(uint8_t key[], uintptr_t value) {
+        if (keyLength == 4)
+            return lookupLevel<4, 0>(root, key, value, 0, false);
+        return lookupLevel<maxKeyWidth, 0>(root, key, value, 0, false);
+    }
+
+    // One level of the lookup of a key of KeyLength bytes. Every level is a
+    // copy of its own, unrolled at compile time: a path has at most one
+    // inner node per key byte. A leaf is compared with the key as a whole,
+    // and only if prefix bytes were skipped or the leaf lies above the last
+    // level. Keys no wider than the inline prefix never skip any
+    template <unsigned KeyLength, unsigned Level>
+    static ArtNode* lookupLevel(ArtNode* node, const uint8_t key[],
+                                uintptr_t value, unsigned depth,
+                                bool skippedPrefix) {
+        if constexpr (Level == KeyLength) {
+            // Every key byte was consumed, only a leaf can be left
+            if (node != NULL && skippedPrefix && getLeafValue(node) != value)
+                return NULL;
+            return node;
+        } else {
+            if (node == NULL) return NULL;
+            if (isLeaf(node)) {
+                if (depth == KeyLength && !skippedPrefix) return node;
+                return getLeafValue(node) == value ? node : NULL;
+            }
+            if (isTerminal(node)) {
+                if (node->type == NodeTypeBucket)
+                    return static_cast<NodeBucket*>(node)->find(value);
+                if (static_cast<NodeInterval*>(node)->contains(value))
+                    return makeLeaf(value);
+                return NULL;
+            }
+            if (node->prefixLength) {
+                if (KeyLength <= maxPrefixLength ||
+                    node->prefixLength < maxPrefixLength) {
+                    for (unsigned pos = 0; pos < node->prefixLength; pos++)
+                        if (key[depth + pos] != node->prefix[pos]) return NULL;
+                } else {
+                    if (depth + node->prefixLength >= KeyLength) return NULL;
+                    for (unsigned pos = 0; pos < maxPrefixLength; pos++)
+                        if (key[depth + pos] != node->prefix[pos]) return NULL;
+                    skippedPrefix = true;
+                }
+                depth += node->prefixLength;
+            }
+            return lookupLevel<KeyLength, Level + 1>(
+                *findChild(node, key[depth]), key, value, depth + 1,
+                skippedPrefix);
         }
     }
 
@@ -282,23 +1857,31 @@ class ART {
                 if (!skippedPrefix && depth == keyLength)  // No check required
                     return node;
 
-                if (depth != keyLength) {
-                    // Check leaf
-                    uint8_t leafKey[maxKeyLength];
-                    loadKey(getLeafValue(node), leafKey);
-                    for (unsigned i = (skippedPrefix ? 0 : depth);
-                         i < keyLength; i++)
-                        if (leafKey[i] != key[i]) return NULL;
-                }
-                return node;
+                // Check leaf, all of it if some prefix was skipped
+                if (leafMatches(node, key, keyLength,
+                                skippedPrefix ? 0 : depth, maxKeyLength))
+                    return node;
+                return NULL;
+            }
+
+            if (isTerminal(node)) {
+                // Full keys are compared, no skipped prefix needs checking
+                return lookupTerminal(node, key, keyLength);
             }
 
             if (node->prefixLength) {
                 if (node->prefixLength < maxPrefixLength) {
                     for (unsigned pos = 0; pos < node->prefixLength; pos++)
                         if (key[depth + pos] != node->prefix[pos]) return NULL;
-                } else
+                } else {
+                    // Compare the bytes kept in the node and skip the rest,
+                    // the leaf is checked instead. A key that ends within
+                    // the prefix is not below the node
+                    if (depth + node->prefixLength >= keyLength) return NULL;
+                    for (unsigned pos = 0; pos < maxPrefixLength; pos++)
+                        if (key[depth + pos] != node->prefix[pos]) return NULL;
                     skippedPrefix = true;
+                }
                 depth += node->prefixLength;
             }
 
@@ -309,40 +1892,108 @@ class ART {
         return NULL;
     }
 
-    // Erase function, deletes a leaf from the tree
-    void erase(ArtNode* node, ArtNode** nodeRef, uint8_t key[],
-               unsigned keyLength, unsigned depth, unsigned maxKeyLength) {
+    // Collect the expired keys among the leaves below node from reapCursor
+    // on, until batch leaves were scanned. Returns false if the batch ended
+    // first, reapCursor is then the first key not scanned
+    bool findExpired(ArtNode* node, size_t batch, size_t& scanned,
+                     std::vector<ArtNode*>& expired) {
+        if (isLeaf(node)) {
+            uintptr_t value = getLeafValue(node);
+            if (value < reapCursor) return true;
+            if (scanned == batch) {
+                reapCursor = value;
+                return false;
+            }
+            scanned++;
+            if (isExpired(node)) expired.push_back(node);
+            return true;
+        }
+        if (node->type == NodeTypeBucket) {
+            NodeBucket* bucket = static_cast<NodeBucket*>(node);
+            for (unsigned i = bucket->lowerBound(reapCursor); i < bucket->count;
+                 i++)
+                if (!findExpired(bucket->child[i], batch, scanned, expired))
+                    return false;
+            return true;
+        }
+        uint8_t keys[256];
+        NodeRef children[256];
+        unsigned count = sortedChildren(node, keys, children);
+        // Skip the subtrees before the cursor, the ones after it follow
+        bool past = false;
+        for (unsigned i = 0; i < count; i++) {
+            if (!past && getLeafValue(maximum(children[i])) < reapCursor)
+                continue;
+            past = true;
+            if (!findExpired(children[i], batch, scanned, expired))
+                return false;
+        }
+        return true;
+    }
+
+    // Erase function, deletes a leaf from the tree. Returns the level of
+    // the node it changed on the path of the key, the root being level 0,
+    // or -1 if the key is not in the tree. Nodes above it are left in place
+    int erase(ArtNode* node, NodeRef* nodeRef, uint8_t key[],
+              unsigned keyLength, unsigned depth, unsigned maxKeyLength,
+              int level = 0) {
         // Delete a leaf from a tree
 
-        if (!node) return;
+        if (!node) return -1;
+        if (level <= int(maxKeyWidth)) {
+            erasePathRef[level] = nodeRef;
+            erasePathDepth[level] = depth;
+            erasePathNode[level] = node;
+        }
 
         if (isLeaf(node)) {
             // Make sure we have the right leaf
-            if (leafMatches(node, key, keyLength, depth, maxKeyLength))
-                *nodeRef = NULL;
-            return;
+            if (!leafMatches(node, key, keyLength, depth, maxKeyLength))
+                return -1;
+            *nodeRef = NULL;
+            dropLeaf(node);
+            return level;
+        }
+
+        bool split = false;
+        if (isTerminal(node)) {
+            // Remove the key in place, or split the interval until the key is
+            // a leaf
+            size_t leaves = leafCount.get();
+            if (eraseFromTerminal(nodeRef, node, keyValue(key, keyLength)))
+                return leafCount.get() != leaves ? level : -1;
+            node = *nodeRef;
+            split = true;
         }
 
         // Handle prefix
         if (node->prefixLength) {
             if (prefixMismatch(node, key, depth, maxKeyLength) !=
                 node->prefixLength)
-                return;
+                return -1;
             depth += node->prefixLength;
         }
 
-        ArtNode** child = findChild(node, key[depth]);
+        NodeRef* child = findChild(node, key[depth]);
         if (isLeaf(*child) &&
             leafMatches(*child, key, keyLength, depth, maxKeyLength)) {
             // Leaf found, delete it in inner node
+            dropLeaf(*child);
             switch (node->type) {
                 case NodeType4:
                     static_cast<Node4*>(node)->eraseNode4(this, nodeRef, child);
                     break;
+                case NodeType8:
+                    static_cast<Node8*>(node)->eraseNode8(this, nodeRef, child);
+                    break;
                 case NodeType16:
                     static_cast<Node16*>(node)->eraseNode16(this, nodeRef,
                                                             child);
                     break;
+                case NodeType32:
+                    static_cast<Node32*>(node)->eraseNode32(this, nodeRef,
+                                                            child);
+                    break;
                 case NodeType48:
                     static_cast<Node48*>(node)->eraseNode48(this, nodeRef,
                                                             key[depth]);
@@ -351,89 +2002,359 @@ class ART {
                     static_cast<Node256*>(node)->eraseNode256(this, nodeRef,
                                                               key[depth]);
                     break;
+                case NodeTypeBitmap:
+                    static_cast<NodeBitmap*>(node)->eraseBitmap(this, nodeRef,
+                                                                key[depth]);
+                    break;
             }
-        } else {
-            // Recurse
-            erase(*child, child, key, keyLength, depth + 1, maxKeyLength);
+            return level;
         }
+        // Recurse. A split interval was changed here already
+        int changed = erase(*child, child, key, keyLength, depth + 1,
+                            maxKeyLength, level + 1);
+        return split && changed >= 0 ? level : changed;
     }
 
-    // Range lookup function, returns a Chain of ArtNode
-    Chain* rangelookup(ArtNode* node, uint8_t l_key[], unsigned l_keyLength,
-                       uint8_t h_key[], uint8_t h_keyLength,
-                       unsigned maxKeyLength) {
-        // Find the node with a matching key, optimistic version
-        Chain* queue =
-            new Chain((ChainItem*)new ChainItemWithDepth(node, 0, true, true));
-        Chain* result = new Chain();
+    // Number of inner node levels below and including node
+    static unsigned subtreeHeight(ArtNode* node) {
+        if (!node || isLeaf(node)) return 0;
+        NodeRef* slots;
+        unsigned count = childSlots(node, &slots);
+        unsigned height = 0;
+        for (unsigned i = 0; i < count; i++)
+            height = std::max(height, subtreeHeight(slots[i]));
+        return height + 1;
+    }
 
-        while (!queue->isEmpty()) {
-            ChainItemWithDepth* item = (ChainItemWithDepth*)queue->pop_front();
-            node = item->nodeptr();
-
-            int depth = item->depth_;
-            bool lequ = item->lequ_, hequ = item->hequ_;
-            bool continue_flag =
-                0;  // true means the range vialates the key range
-            unsigned pos;
-            auto compare_and_set = [&](unsigned pos,
-                                       uint8_t compared_byte) -> void {
-                uint8_t lkey = pos >= l_keyLength ? 0 : l_key[pos];
-                uint8_t hkey = pos >= h_keyLength ? 0 : l_key[pos];
-
-                if (lkey < compared_byte)
-                    lequ = 0;
-                else if (lkey > compared_byte)
-                    continue_flag = 1;
-
-                if (hkey < compared_byte)
-                    continue_flag = 1;
-                else if (hkey > compared_byte)
-                    hequ = 0;
-            };
-            if (isLeaf(node)) {
-                uint8_t leafKey[maxKeyLength];
-                loadKey(getLeafValue(node), leafKey);
-                for (unsigned i = depth;
-                     i < maxKeyLength && !continue_flag && (lequ || hequ); i++)
-                    compare_and_set(i, leafKey[i]);
-                if (!continue_flag) {
-                    result->extend_item(new ChainItem(node));
-                }
-                continue;
+    static void layoutDepthFirst(ArtNode* node, std::vector<ArtNode*>& out) {
+        // Append node and then its subtrees in key order
+        if (!node || isLeaf(node)) return;
+        out.push_back(node);
+        uint8_t keys[256];
+        NodeRef children[256];
+        unsigned count = sortedChildren(node, keys, children);
+        for (unsigned i = 0; i < count; i++)
+            layoutDepthFirst(children[i], out);
+    }
+
+    static void layoutVanEmdeBoas(ArtNode* node, unsigned height,
+                                  std::vector<ArtNode*>& out) {
+        // Append the first height levels below node, the top half of them
+        // before each subtree rooted in the bottom half
+        if (!node || isLeaf(node) || height == 0) return;
+        if (height == 1) {
+            out.push_back(node);
+            return;
+        }
+        unsigned top = height / 2;
+        layoutVanEmdeBoas(node, top, out);
+        std::vector<ArtNode*> roots;
+        collectLevel(node, top, roots);
+        for (ArtNode* subtree : roots)
+            layoutVanEmdeBoas(subtree, height - top, out);
+    }
+
+    static void collectLevel(ArtNode* node, unsigned level,
+                             std::vector<ArtNode*>& out) {
+        // Append the inner nodes level levels below node in key order
+        if (!node || isLeaf(node)) return;
+        if (level == 0) {
+            out.push_back(node);
+            return;
+        }
+        uint8_t keys[256];
+        NodeRef children[256];
+        unsigned count = sortedChildren(node, keys, children);
+        for (unsigned i = 0; i < count; i++)
+            collectLevel(children[i], level - 1, out);
+    }
+
+    // Erase the key of value and repair the fast path, false if the key is
+    // not in the tree. A key of an interval or bitmap node is its payload
+    bool eraseKey(uint8_t key[], uintptr_t value) {
+        erasedPayload = value;
+        erasedExpired = false;
+        int level = erase(root, &root, key, keyLength, 0, keyLength);
+        if (level < 0) return false;
+#ifdef ART_ORDER_STATISTICS
+        countErase(key);
+#endif
+        repairFastPath(value, level);
+        return true;
+    }
+
+    // Point the fast path again after an erase of value changed the node at
+    // level on its path. Nodes above that one are intact: if the fast path
+    // went through the changed node, it is followed again from the deepest
+    // of them it shares with the erased key. An erased fp leaf is replaced
+    // by the largest key left where it was
+    void repairFastPath(uintptr_t value, unsigned level) {
+        if (fp == NULL) return;
+        if (root == NULL) {
+            resetFastPath();
+            return;
+        }
+        // The paths of value and the fp leaf part at the node whose key byte
+        // is the first one where they differ
+        uint64_t diff = value ^ getLeafValue(fp_leaf);
+        unsigned common =
+            diff ? __builtin_clzll(diff) / 8 - (8 - keyLength) : keyLength;
+        unsigned shared = 1;
+        while (shared <= level && erasePathDepth[shared] - 1 < common)
+            shared++;
+        bool leafErased = diff == 0;
+        bool below = shared > level && fp_depth >= erasePathDepth[level];
+        if (!leafErased && !below && fp != erasePathNode[level]) return;
+
+        unsigned restart = shared - 1;
+        if (shared > level) restart = level ? level - 1 : 0;
+        if (leafErased) fp_leaf = maximum(*erasePathRef[level] != NULL
+                                              ? *erasePathRef[level]
+                                              : *erasePathRef[restart]);
+        for (unsigned i = 0; i < restart; i++) {
+            fp_path[i] = *erasePathRef[i];
+            fp_path_ref[i] = erasePathRef[i];
+        }
+        fp_path_length = restart;
+        descendFastPath(*erasePathRef[restart], erasePathRef[restart],
+                        erasePathDepth[restart]);
+    }
+
+    // The cell that holds the leaf of a fixed-length key, NULL if the key is
+    // not in the tree or is stored in an interval or bitmap node
+    NodeRef* findLeafRef(uint8_t key[]) {
+        uintptr_t value = keyValue(key, keyLength);
+        NodeRef* nodeRef = &root;
+        unsigned depth = 0;
+        while (*nodeRef != NULL) {
+            ArtNode* node = *nodeRef;
+            if (isLeaf(node))
+                return getLeafValue(node) == value ? nodeRef : NULL;
+            if (node->type == NodeTypeBucket) {
+                NodeBucket* bucket = static_cast<NodeBucket*>(node);
+                unsigned pos = bucket->lowerBound(value);
+                if (pos < bucket->count &&
+                    getLeafValue(bucket->child[pos]) == value)
+                    return &bucket->child[pos];
+                return NULL;
             }
+            if (isTerminal(node) || node->type == NodeTypeBitmap) return NULL;
+            depth += node->prefixLength;
+            nodeRef = findChild(node, key[depth]);
+            depth++;
+        }
+        return NULL;
+    }
 
-            if (node->prefixLength > maxPrefixLength) {
-                for (pos = 0;
-                     pos < maxPrefixLength && !continue_flag && (lequ || hequ);
-                     pos++) {
-                    compare_and_set(depth + pos, node->prefix[pos]);
-                }
-                uint8_t minKey[maxKeyLength];
-                loadKey(getLeafValue(minimum(node)), minKey);
-                for (; pos < node->prefixLength && !continue_flag &&
-                       (lequ || hequ);
-                     pos++) {
-                    compare_and_set(depth + pos, minKey[depth + pos]);
+    // Bounds of a range scan, as values and as key bytes
+    struct ScanBounds {
+        uintptr_t lo, hi;
+        uint8_t loKey[maxKeyWidth], hiKey[maxKeyWidth];
+    };
+
+    // Visit the keys from lo to hi, false if a visit ended the scan
+    template <typename Visit>
+    bool scanFrom(uint64_t lo, uint64_t hi, Visit& visit, size_t& count) {
+        if (keyLength == variableKeyLength)
+            throw std::invalid_argument(
+                "range scans need fixed-length keys");
+        if (keyLength < 8) {
+            if (lo >> (8 * keyLength)) return true;
+            hi = std::min(hi, uint64_t(subtreeMask(0, keyLength)));
+        }
+        if (root == NULL || lo > hi) return true;
+        ScanBounds bounds;
+        bounds.lo = lo;
+        bounds.hi = hi;
+        loadKey(lo, bounds.loKey, keyLength);
+        loadKey(hi, bounds.hiKey, keyLength);
+        return scanRange(root, 0, true, true, bounds, visit, count);
+    }
+
+    // Visitors may return nothing, or false to end the scan
+    template <typename Visit>
+    static bool visitLeaf(Visit& visit, ArtNode* leaf) {
+        if constexpr (std::is_void_v<decltype(visit(leaf))>) {
+            visit(leaf);
+            return true;
+        } else {
+            return visit(leaf);
+        }
+    }
+
+    // Visit the leaves below node within the bounds. lowEqual and highEqual
+    // tell if the key bytes above depth are those of lo and hi, only then
+    // does that bound cut into the subtree. False if a visit ended the scan
+    template <typename Visit>
+    bool scanRange(ArtNode* node, unsigned depth, bool lowEqual,
+                   bool highEqual, const ScanBounds& bounds, Visit& visit,
+                   size_t& count) {
+        if (!lowEqual && !highEqual) return scanAll(node, visit, count);
+        if (isLeaf(node)) {
+            uintptr_t value = getLeafValue(node);
+            if (value < bounds.lo || value > bounds.hi) return true;
+            return scanLeaf(node, visit, count);
+        }
+        switch (node->type) {
+            case NodeTypeInterval: {
+                NodeInterval* interval = static_cast<NodeInterval*>(node);
+                uintptr_t first = std::max(bounds.lo, interval->lo);
+                uintptr_t last = std::min(bounds.hi, interval->hi);
+                if (first > last) return true;
+                return scanInterval(first, last, visit, count);
+            }
+            case NodeTypeBucket: {
+                // Leaves are sorted, binary search the first one
+                NodeBucket* bucket = static_cast<NodeBucket*>(node);
+                unsigned i = lowEqual ? bucket->lowerBound(bounds.lo) : 0;
+                for (; i < bucket->count; i++) {
+                    if (highEqual && getLeafValue(bucket->child[i]) > bounds.hi)
+                        return true;
+                    if (!scanLeaf(bucket->child[i], visit, count)) return false;
                 }
+                return true;
+            }
+        }
+        // Prefix bytes that differ from a bound put the whole subtree on
+        // one side of it
+        uint8_t buffer[maxKeyWidth];
+        const uint8_t* minKey = NULL;
+        for (unsigned pos = 0;
+             pos < node->prefixLength && (lowEqual || highEqual); pos++) {
+            uint8_t keyByte;
+            if (pos < maxPrefixLength) {
+                keyByte = node->prefix[pos];
             } else {
-                for (pos = 0; pos < node->prefixLength && !continue_flag &&
-                              (lequ || hequ);
-                     pos++) {
-                    compare_and_set(depth + pos, node->prefix[pos]);
-                }
+                if (minKey == NULL)
+                    minKey = leafKey(minimum(node), buffer, keyLength);
+                keyByte = minKey[depth + pos];
             }
-            if (continue_flag) continue;
-            depth += node->prefixLength;
+            if (lowEqual) {
+                if (keyByte < bounds.loKey[depth + pos]) return true;
+                lowEqual = keyByte == bounds.loKey[depth + pos];
+            }
+            if (highEqual) {
+                if (keyByte > bounds.hiKey[depth + pos]) return true;
+                highEqual = keyByte == bounds.hiKey[depth + pos];
+            }
+        }
+        if (!lowEqual && !highEqual) return scanAll(node, visit, count);
+        depth += node->prefixLength;
+        uint8_t first = lowEqual ? bounds.loKey[depth] : 0;
+        uint8_t last = highEqual ? bounds.hiKey[depth] : 255;
+        for (int slot = lowerSlot(node, first); slot >= 0;) {
+            uint8_t keyByte = slotKey(node, slot);
+            if (keyByte > last) return true;
+            int next = nextSlot(node, slot);
+            prefetchChild(node, next);
+            if (!scanRange(slotChild(node, slot), depth + 1,
+                           lowEqual && keyByte == first,
+                           highEqual && keyByte == last, bounds, visit, count))
+                return false;
+            slot = next;
+        }
+        return true;
+    }
 
-            std::unique_ptr<Chain> newly_added =
-                std::move(std::unique_ptr<Chain>(newly_added->findChildbyRange(
-                    item->nodeptr(), lequ ? l_key[depth] : 0,
-                    hequ ? h_key[depth] : 255, depth, lequ, hequ)));
-            queue->extend(std::move(newly_added));
+    // Visit every leaf below node, no key is compared
+    template <typename Visit>
+    bool scanAll(ArtNode* node, Visit& visit, size_t& count) {
+        if (isLeaf(node)) return scanLeaf(node, visit, count);
+        if (node->type == NodeTypeInterval) {
+            NodeInterval* interval = static_cast<NodeInterval*>(node);
+            return scanInterval(interval->lo, interval->hi, visit, count);
         }
-        delete queue;
-        return result;
+        for (int slot = nextSlot(node, -1); slot >= 0;) {
+            int next = nextSlot(node, slot);
+            prefetchChild(node, next);
+            if (!scanAll(slotChild(node, slot), visit, count)) return false;
+            slot = next;
+        }
+        return true;
+    }
+
+    template <typename Visit>
+    bool scanLeaf(ArtNode* leaf, Visit& visit, size_t& count) {
+        if (expiring && isExpired(leaf)) return true;
+        count++;
+        return visitLeaf(visit, leaf);
+    }
+
+    // Keys of an interval are rebuilt as pseudo-leaves
+    template <typename Visit>
+    static bool scanInterval(uintptr_t first, uintptr_t last, Visit& visit,
+                             size_t& count) {
+        for (uintptr_t value = first;; value++) {
+            count++;
+            if (!visitLeaf(visit, makeLeaf(value))) return false;
+            if (value == last) return true;
+        }
+    }
+
+    // Fetch the node in a slot while the subtree before it is scanned
+    static void prefetchChild(ArtNode* node, int slot) {
+        if (slot < 0 || node->type == NodeTypeBitmap) return;
+        ArtNode* child = slotChild(node, slot);
+        if (!isLeaf(child)) __builtin_prefetch(child);
+    }
+
+    // Free the posting lists of the leaves below node, their records go with
+    // the allocator
+    void freePostings(ArtNode* node) {
+        if (node == NULL) return;
+        if (isLeaf(node)) {
+            if (isPostingLeaf(node)) delete recordPostings(leafRecord(node));
+            return;
+        }
+        NodeRef* slots;
+        unsigned count = childSlots(node, &slots);
+        for (unsigned i = 0; i < count; i++) freePostings(slots[i]);
+    }
+
+    // Copy a leaf record into fresh memory for compact()
+    ArtNode* moveRecord(NodeAllocator& fresh, ArtNode* leaf,
+                        std::vector<std::pair<ArtNode*, ArtNode*>>& moved) {
+        size_t size = recordSize(leaf);
+        LeafRecord* copy = static_cast<LeafRecord*>(fresh.allocate(size));
+        memcpy(copy, leafRecord(leaf), size);
+        moved.emplace_back(leaf, isPostingLeaf(leaf) ? makePostingLeaf(copy)
+                                                     : makeRecordLeaf(copy));
+        return moved.back().second;
+    }
+
+    // The copy of an inner node or record leaf moved by compact(). Other
+    // leaves stay as they are, pointers to nodes that are no longer in the
+    // tree become NULL
+    static ArtNode* movedNode(
+        const std::vector<std::pair<ArtNode*, ArtNode*>>& moved,
+        ArtNode* node) {
+        if (!node || (isLeaf(node) && !isRecordLeaf(node))) return node;
+        auto it = std::lower_bound(moved.begin(), moved.end(),
+                                   std::make_pair(node, (ArtNode*)NULL));
+        if (it == moved.end() || it->first != node) return NULL;
+        return it->second;
+    }
+
+    // The same child cell in the copy of the node it lies in. References
+    // outside of the moved nodes, like the one to the root, stay as they are
+    static NodeRef* movedRef(
+        const std::vector<std::pair<ArtNode*, ArtNode*>>& moved,
+        NodeRef* ref) {
+        char* address = reinterpret_cast<char*>(ref);
+        auto it = std::upper_bound(
+            moved.begin(), moved.end(), ref,
+            [](NodeRef* r, const std::pair<ArtNode*, ArtNode*>& entry) {
+                return reinterpret_cast<char*>(r) <
+                       reinterpret_cast<char*>(entry.first);
+            });
+        if (!ref || it == moved.begin()) return ref;
+        --it;
+        // Child cells only lie in inner nodes
+        if (isLeaf(it->first)) return ref;
+        char* start = reinterpret_cast<char*>(it->first);
+        if (address >= start + nodeSize(it->first)) return ref;
+        return reinterpret_cast<NodeRef*>(reinterpret_cast<char*>(it->second) +
+                                          (address - start));
     }
 
     void printTree(ArtNode* node, int depth) {
@@ -458,6 +2379,14 @@ class ART {
                 }
                 break;
             }
+            case NodeType8: {
+                Node8* n = static_cast<Node8*>(node);
+                printf("Node8 [%p]\n", static_cast<void*>(n));
+                for (unsigned i = 0; i < n->count; i++) {
+                    printTree(n->child[i], depth + 1);
+                }
+                break;
+            }
             case NodeType16: {
                 Node16* n = static_cast<Node16*>(node);
                 printf("Node16 [%p]\n", static_cast<void*>(n));
@@ -466,6 +2395,14 @@ class ART {
                 }
                 break;
             }
+            case NodeType32: {
+                Node32* n = static_cast<Node32*>(node);
+                printf("Node32 [%p]\n", static_cast<void*>(n));
+                for (unsigned i = 0; i < n->count; i++) {
+                    printTree(n->child[i], depth + 1);
+                }
+                break;
+            }
             case NodeType48: {
                 Node48* n = static_cast<Node48*>(node);
                 printf("Node48 [%p]\n", static_cast<void*>(n));
@@ -486,7 +2423,66 @@ class ART {
                 }
                 break;
             }
+            case NodeTypeBitmap: {
+                NodeBitmap* n = static_cast<NodeBitmap*>(node);
+                printf("NodeBitmap [%p]\n", static_cast<void*>(n));
+                for (unsigned i = n->nextSet(0); i < 256; i = n->nextSet(i + 1))
+                    printTree(n->leaf(i), depth + 1);
+                break;
+            }
+            case NodeTypeInterval: {
+                NodeInterval* n = static_cast<NodeInterval*>(node);
+                printf("NodeInterval [%p] [%lu, %lu]\n", static_cast<void*>(n),
+                       n->lo, n->hi);
+                break;
+            }
+            case NodeTypeBucket: {
+                NodeBucket* n = static_cast<NodeBucket*>(node);
+                printf("NodeBucket [%p]\n", static_cast<void*>(n));
+                for (unsigned i = 0; i < n->count; i++)
+                    printTree(n->child[i], depth + 1);
+                break;
+            }
         }
     }
 };
+
+template <class T>
+T* allocNode(ART* tree) {
+    // Construct a node of type T in memory taken from the tree's allocator
+    T* node = new (tree->allocator.allocate(sizeof(T))) T();
+    tree->countNode(node, 1);
+    return node;
+}
+
+NodeBucket* allocBucket(ART* tree, unsigned capacity, unsigned depth) {
+    // Construct an empty bucket with room for capacity leaves
+    NodeBucket* node =
+        new (tree->allocator.allocate(NodeBucket::sizeFor(capacity)))
+            NodeBucket(capacity, depth);
+    tree->countNode(node, 1);
+    return node;
+}
+
+void freeNode(ART* tree, ArtNode* node) {
+    // Hand the node's memory back to the tree's allocator
+    tree->countNode(node, -1);
+    tree->allocator.deallocate(node, nodeSize(node));
+}
+
+void countLeaves(ART* tree, ptrdiff_t delta) { tree->leafCount.add(delta); }
+
+void collapseBitmap(ART* tree, NodeRef* nodeRef, NodeBitmap* node) {
+    // The interval takes the place of the bitmap, it may extend up to the
+    // bounds of the subtree at the position of the bitmap
+    NodeInterval* interval = allocNode<NodeInterval>(tree);
+    interval->lo = node->base;
+    interval->hi = node->base | 0xFF;
+    interval->mask = subtreeMask(tree->keyLength - 1 - node->prefixLength,
+                                 tree->keyLength);
+    *nodeRef = interval;
+    tree->replaceOnFastPath(node, interval);
+    freeNode(tree, node);
+}
+
 }  // namespace ART
\ No newline at end of file
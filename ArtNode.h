@@ -23,9 +23,13 @@
 #include <locale>
 #include <memory>
 #include <stdexcept>
+#include <string>
+#include <utility>
 #include <vector>
 
 #include "Helper.h"
+#include "NodeAllocator.h"  // Slab allocator for inner nodes
+#include "PostingList.h"    // Payload lists of duplicate keys
 
 namespace ART {
 class ART;
@@ -34,11 +38,43 @@ static const int8_t NodeType4 = 0;
 static const int8_t NodeType16 = 1;
 static const int8_t NodeType48 = 2;
 static const int8_t NodeType256 = 3;
+static const int8_t NodeTypeBitmap = 4;
+static const int8_t NodeTypeInterval = 5;
+static const int8_t NodeTypeBucket = 6;
+static const int8_t NodeType8 = 7;
+static const int8_t NodeType32 = 8;
+// Number of node types, the size of arrays indexed by type
+static const int numNodeTypes = 9;
+
+// Growth ladder of the inner nodes. Node4, Node16, Node48 and Node256 are
+// always used, Node8 and Node32 are added as intermediate steps when the tree
+// is built with ART_LADDER_NODE8 and ART_LADDER_NODE32
+#ifdef ART_LADDER_NODE8
+static const bool ladderNode8 = true;
+#else
+static const bool ladderNode8 = false;
+#endif
+#ifdef ART_LADDER_NODE32
+static const bool ladderNode32 = true;
+#else
+static const bool ladderNode32 = false;
+#endif
 
 // The maximum prefix length for compressed paths stored in the
 // header, if the path is longer it is loaded from the database on
-// demand
-static const unsigned maxPrefixLength = 4;
+// demand. It does not depend on the key length, build with
+// ART_PREFIX_LENGTH to change it (up to 16, a Node4 stays in a cache line;
+// up to 8 with ART_ORDER_STATISTICS)
+#ifndef ART_PREFIX_LENGTH
+#define ART_PREFIX_LENGTH 4
+#endif
+static const unsigned maxPrefixLength = ART_PREFIX_LENGTH;
+
+// Widest key a tree can index in bytes, the fast path arrays are sized for it
+static const unsigned maxKeyWidth = 8;
+
+// Key length of a tree whose keys are byte strings of any length
+static const unsigned variableKeyLength = 0;
 
 // Shared header of all inner nodes
 struct ArtNode {
@@ -50,166 +86,546 @@ struct ArtNode {
     int8_t type;
     // compressed path (prefix)
     uint8_t prefix[maxPrefixLength];
+#ifdef ART_ORDER_STATISTICS
+    // number of keys below an inner node on the growth ladder, 0 until it
+    // is counted; terminal and bitmap nodes are sized by their contents
+    uint64_t leaves;
 
+    ArtNode(int8_t type) : prefixLength(0), count(0), type(type), leaves(0) {}
+#else
     ArtNode(int8_t type) : prefixLength(0), count(0), type(type) {}
+#endif
+};
+
+#ifdef ART_COMPRESSED_CHILDREN
+// Reference to a child stored as a 32-bit handle. A leaf keeps a tag bit in
+// bit 0 and its value in the upper 31 bits, leaf records are not supported in
+// this mode. An inner node is
+// stored as its offset into the node arena in 8-byte units, which leaves bit
+// 0 clear because nodes are 16-byte aligned. Handle 0 is the null reference.
+// Keys of 2^31 and above have no handle, ART::beginInsert() rejects them
+static const uintptr_t maxHandleValue = UINT32_MAX >> 1;
+
+class NodeRef {
+   public:
+    NodeRef() = default;
+    NodeRef(ArtNode* node) : handle(encode(node)) {}
+
+    operator ArtNode*() const { return decode(handle); }
+    ArtNode* operator->() const { return decode(handle); }
+
+   private:
+    static uint32_t encode(ArtNode* node) {
+        uintptr_t bits = reinterpret_cast<uintptr_t>(node);
+        if (bits & 1) {
+            // Leaf values must fit in 31 bits in this mode
+            assert(!(bits & 2) && (bits >> 2) <= maxHandleValue);
+            return static_cast<uint32_t>(((bits >> 2) << 1) | 1);
+        }
+        if (node == nullptr) return 0;
+        return static_cast<uint32_t>(
+            (reinterpret_cast<char*>(node) - nodeArenaBase) >> 3);
+    }
+
+    static ArtNode* decode(uint32_t handle) {
+        if (handle & 1)
+            return reinterpret_cast<ArtNode*>(((uintptr_t(handle) >> 1) << 2) |
+                                              1);
+        if (handle == 0) return nullptr;
+        return reinterpret_cast<ArtNode*>(nodeArenaBase +
+                                          (uintptr_t(handle) << 3));
+    }
+
+    uint32_t handle;
 };
+#else
+// Reference to a child, a plain pointer unless children are compressed
+typedef ArtNode* NodeRef;
+#endif
 
 // This address is used to communicate that search failed
-ArtNode* nullNode = NULL;
+NodeRef nullNode = NULL;
 // Empty marker
 static const uint8_t emptyMarker = 48;
 
 // Node with up to 4 children
 struct Node4 : ArtNode {
     uint8_t key[4];
-    ArtNode* child[4];
+    NodeRef child[4];
 
     Node4() : ArtNode(NodeType4) {
         memset(key, 0, sizeof(key));
         memset(child, 0, sizeof(child));
     }
 
-    void lilInsertNode4(ART* tree, ArtNode** nodeRef, uint8_t keyByte,
+    void lilInsertNode4(ART* tree, NodeRef* nodeRef, uint8_t keyByte,
                         ArtNode* child);
 
     // Base ART insert function for Node4
-    void insertNode4(ART* tree, ArtNode** nodeRef, uint8_t keyByte,
+    void insertNode4(ART* tree, NodeRef* nodeRef, uint8_t keyByte,
                      ArtNode* child);
     // Insert function used in base tail insert. Checks if fp structures need
     // to be updated and updates if necessary
-    void tailInsertNode4(ART* tree, ArtNode** nodeRef, uint8_t keyByte,
+    void tailInsertNode4(ART* tree, NodeRef* nodeRef, uint8_t keyByte,
                          ArtNode* child,
-                         std::array<ArtNode*, maxPrefixLength>& temp_fp_path,
+                         std::array<ArtNode*, maxKeyWidth>& temp_fp_path,
                          size_t& temp_fp_path_length, size_t depth_prev);
 
-    void stailInsertNode4ChangeFp(ART* tree, ArtNode** nodeRef, uint8_t keyByte,
+    void stailInsertNode4ChangeFp(ART* tree, NodeRef* nodeRef, uint8_t keyByte,
                                   ArtNode* child);
-    void stailInsertNode4PreserveFpPrefixExpansion(ART* tree, ArtNode** nodeRef,
+    void stailInsertNode4PreserveFpPrefixExpansion(ART* tree, NodeRef* nodeRef,
                                                    uint8_t keyByte,
                                                    ArtNode* child);
-    void stailInsertNode4PreserveFp(ART* tree, ArtNode** nodeRef,
+    void stailInsertNode4PreserveFp(ART* tree, NodeRef* nodeRef,
                                     uint8_t keyByte, ArtNode* child);
-    void lilCanInsertNode4ChangeFp(ART* tree, ArtNode** nodeRef, uint8_t keyByte,
+    void lilCanInsertNode4ChangeFp(ART* tree, NodeRef* nodeRef, uint8_t keyByte,
                                   ArtNode* child);
-    void lilCanInsertNode4PreserveFpPrefixExpansion(ART* tree, ArtNode** nodeRef,
+    void lilCanInsertNode4PreserveFpPrefixExpansion(ART* tree, NodeRef* nodeRef,
                                                    uint8_t keyByte,
                                                    ArtNode* child);
-    void lilCanInsertNode4PreserveFp(ART* tree, ArtNode** nodeRef,
+    void lilCanInsertNode4PreserveFp(ART* tree, NodeRef* nodeRef,
                                     uint8_t keyByte, ArtNode* child);
     // Erase function for Node4
-    void eraseNode4(ART* tree, ArtNode** nodeRef, ArtNode** leafPlace);
+    void eraseNode4(ART* tree, NodeRef* nodeRef, NodeRef* leafPlace);
+};
+
+// Node with up to 8 children, between Node4 and Node16 on the growth ladder
+struct Node8 : ArtNode {
+    uint8_t key[8];
+    NodeRef child[8];
+
+    Node8() : ArtNode(NodeType8) {
+        memset(key, 0, sizeof(key));
+        memset(child, 0, sizeof(child));
+    }
+
+    // Add a child in key order, the node must not be full
+    void insertSorted(uint8_t keyByte, ArtNode* child);
+
+    void lilInsertNode8(ART* tree, NodeRef* nodeRef, uint8_t keyByte,
+                        ArtNode* child);
+
+    // Base ART insert function for Node8
+    void insertNode8(ART* tree, NodeRef* nodeRef, uint8_t keyByte,
+                     ArtNode* child);
+    // Insert function used in base tail insert. Checks if fp structures need
+    // to be updated and updates if necessary.
+    void tailInsertNode8(ART* tree, NodeRef* nodeRef, uint8_t keyByte,
+                         ArtNode* child,
+                         std::array<ArtNode*, maxKeyWidth>& temp_fp_path,
+                         size_t& temp_fp_path_length, size_t depth_prev);
+    void stailInsertNode8ChangeFp(ART* tree, NodeRef* nodeRef, uint8_t keyByte,
+                                  ArtNode* child);
+    void stailInsertNode8PreserveFp(ART* tree, NodeRef* nodeRef,
+                                    uint8_t keyByte, ArtNode* child);
+    void lilCanInsertNode8ChangeFp(ART* tree, NodeRef* nodeRef, uint8_t keyByte,
+                                   ArtNode* child);
+    void lilCanInsertNode8PreserveFp(ART* tree, NodeRef* nodeRef,
+                                     uint8_t keyByte, ArtNode* child);
+    // Erase function for Node8
+    void eraseNode8(ART* tree, NodeRef* nodeRef, NodeRef* leafPlace);
 };
 
 // Node with up to 16 children
 struct Node16 : ArtNode {
-    uint8_t key[16];
-    ArtNode* child[16];
+    // aligned so the SIMD key array ends within the first cache line
+    alignas(16) uint8_t key[16];
+    NodeRef child[16];
 
     Node16() : ArtNode(NodeType16) {
         memset(key, 0, sizeof(key));
         memset(child, 0, sizeof(child));
     }
 
-    void lilInsertNode16(ART* tree, ArtNode** nodeRef, uint8_t keyByte,
+    void lilInsertNode16(ART* tree, NodeRef* nodeRef, uint8_t keyByte,
                          ArtNode* child);
 
     // Base ART insert function for Node16
-    void insertNode16(ART* tree, ArtNode** nodeRef, uint8_t keyByte,
+    void insertNode16(ART* tree, NodeRef* nodeRef, uint8_t keyByte,
                       ArtNode* child);
     // Insert function used in base tail insert. Checks if fp structures need
     // to be updated and updates if necessary.
-    void tailInsertNode16(ART* tree, ArtNode** nodeRef, uint8_t keyByte,
+    void tailInsertNode16(ART* tree, NodeRef* nodeRef, uint8_t keyByte,
                           ArtNode* child,
-                          std::array<ArtNode*, maxPrefixLength>& temp_fp_path,
+                          std::array<ArtNode*, maxKeyWidth>& temp_fp_path,
                           size_t& temp_fp_path_length, size_t depth_prev);
-    void stailInsertNode16ChangeFp(ART* tree, ArtNode** nodeRef,
+    void stailInsertNode16ChangeFp(ART* tree, NodeRef* nodeRef,
                                    uint8_t keyByte, ArtNode* child);
-    void stailInsertNode16PreserveFp(ART* tree, ArtNode** nodeRef,
+    void stailInsertNode16PreserveFp(ART* tree, NodeRef* nodeRef,
                                      uint8_t keyByte, ArtNode* child);
-    void lilCanInsertNode16ChangeFp(ART* tree, ArtNode** nodeRef,
+    void lilCanInsertNode16ChangeFp(ART* tree, NodeRef* nodeRef,
                                    uint8_t keyByte, ArtNode* child);
-    void lilCanInsertNode16PreserveFp(ART* tree, ArtNode** nodeRef,
+    void lilCanInsertNode16PreserveFp(ART* tree, NodeRef* nodeRef,
                                      uint8_t keyByte, ArtNode* child);
     // Erase function for Node16
-    void eraseNode16(ART* tree, ArtNode** nodeRef, ArtNode** leafPlace);
+    void eraseNode16(ART* tree, NodeRef* nodeRef, NodeRef* leafPlace);
+};
+
+// Node with up to 32 children, between Node16 and Node48 on the growth
+// ladder. Like Node16 its keys are stored with flipped sign bits
+struct Node32 : ArtNode {
+    // aligned for a single 32-byte AVX2 load
+    alignas(32) uint8_t key[32];
+    NodeRef child[32];
+
+    Node32() : ArtNode(NodeType32) {
+        memset(key, 0, sizeof(key));
+        memset(child, 0, sizeof(child));
+    }
+
+    // Bit i is set if key i equals keyByte, only the first count keys are
+    // considered
+    uint32_t equalMask(uint8_t keyByte) const;
+    // Bit i is set if key i is greater than keyByte
+    uint32_t greaterMask(uint8_t keyByte) const;
+    // Add a child in key order, the node must not be full
+    void insertSorted(uint8_t keyByte, ArtNode* child);
+
+    void lilInsertNode32(ART* tree, NodeRef* nodeRef, uint8_t keyByte,
+                         ArtNode* child);
+
+    // Base ART insert function for Node32
+    void insertNode32(ART* tree, NodeRef* nodeRef, uint8_t keyByte,
+                      ArtNode* child);
+    // Insert function used in base tail insert. Checks if fp structures need
+    // to be updated and updates if necessary.
+    void tailInsertNode32(ART* tree, NodeRef* nodeRef, uint8_t keyByte,
+                          ArtNode* child,
+                          std::array<ArtNode*, maxKeyWidth>& temp_fp_path,
+                          size_t& temp_fp_path_length, size_t depth_prev);
+    void stailInsertNode32ChangeFp(ART* tree, NodeRef* nodeRef,
+                                   uint8_t keyByte, ArtNode* child);
+    void stailInsertNode32PreserveFp(ART* tree, NodeRef* nodeRef,
+                                     uint8_t keyByte, ArtNode* child);
+    void lilCanInsertNode32ChangeFp(ART* tree, NodeRef* nodeRef,
+                                    uint8_t keyByte, ArtNode* child);
+    void lilCanInsertNode32PreserveFp(ART* tree, NodeRef* nodeRef,
+                                      uint8_t keyByte, ArtNode* child);
+    // Erase function for Node32
+    void eraseNode32(ART* tree, NodeRef* nodeRef, NodeRef* leafPlace);
 };
 
 // Node with up to 48 children
 struct Node48 : ArtNode {
     uint8_t childIndex[256];
-    ArtNode* child[48];
+    NodeRef child[48];
 
     Node48() : ArtNode(NodeType48) {
         memset(childIndex, emptyMarker, sizeof(childIndex));
         memset(child, 0, sizeof(child));
     }
 
-    void lilInsertNode48(ART* tree, ArtNode** nodeRef, uint8_t keyByte,
+    void lilInsertNode48(ART* tree, NodeRef* nodeRef, uint8_t keyByte,
                          ArtNode* child);
 
     // Base ART insert function for Node48
-    void insertNode48(ART* tree, ArtNode** nodeRef, uint8_t keyByte,
+    void insertNode48(ART* tree, NodeRef* nodeRef, uint8_t keyByte,
                       ArtNode* child);
     // Insert function used in base tail insert. Checks if fp structures need
     // to be updated and updates if necessary.
-    void tailInsertNode48(ART* tree, ArtNode** nodeRef, uint8_t keyByte,
+    void tailInsertNode48(ART* tree, NodeRef* nodeRef, uint8_t keyByte,
                           ArtNode* child,
-                          std::array<ArtNode*, maxPrefixLength>& temp_fp_path,
+                          std::array<ArtNode*, maxKeyWidth>& temp_fp_path,
                           size_t& temp_fp_path_length, size_t depth_prev);
-    void stailInsertNode48ChangeFp(ART* tree, ArtNode** nodeRef,
+    void stailInsertNode48ChangeFp(ART* tree, NodeRef* nodeRef,
                                    uint8_t keyByte, ArtNode* child);
-    void stailInsertNode48PreserveFp(ART* tree, ArtNode** nodeRef,
+    void stailInsertNode48PreserveFp(ART* tree, NodeRef* nodeRef,
                                      uint8_t keyByte, ArtNode* child);
-    void lilCanInsertNode48ChangeFp(ART* tree, ArtNode** nodeRef,
+    void lilCanInsertNode48ChangeFp(ART* tree, NodeRef* nodeRef,
                                    uint8_t keyByte, ArtNode* child);
-    void lilCanInsertNode48PreserveFp(ART* tree, ArtNode** nodeRef,
+    void lilCanInsertNode48PreserveFp(ART* tree, NodeRef* nodeRef,
                                      uint8_t keyByte, ArtNode* child);
     // Erase function for Node48
-    void eraseNode48(ART* tree, ArtNode** nodeRef, uint8_t keyByte);
+    void eraseNode48(ART* tree, NodeRef* nodeRef, uint8_t keyByte);
 };
 
 // Node with up to 256 children
 struct Node256 : ArtNode {
-    ArtNode* child[256];
+    NodeRef child[256];
 
     Node256() : ArtNode(NodeType256) { memset(child, 0, sizeof(child)); }
 
     void lilInsertNode256(ART* tree [[maybe_unused]],
-                          ArtNode** nodeRef [[maybe_unused]], uint8_t keyByte,
+                          NodeRef* nodeRef [[maybe_unused]], uint8_t keyByte,
                           ArtNode* child);
 
     // Base ART insert function for Node256
-    void insertNode256(ART* tree, ArtNode** nodeRef, uint8_t keyByte,
+    void insertNode256(ART* tree, NodeRef* nodeRef, uint8_t keyByte,
                        ArtNode* child);
     // Insert function used in base tail insert. Checks if fp structures need
     // to be updated and updates if necessary.
-    void tailInsertNode256(ART* tree, ArtNode** nodeRef, uint8_t keyByte,
+    void tailInsertNode256(ART* tree, NodeRef* nodeRef, uint8_t keyByte,
                            ArtNode* child,
-                           std::array<ArtNode*, maxPrefixLength>& temp_fp_path,
+                           std::array<ArtNode*, maxKeyWidth>& temp_fp_path,
                            size_t& temp_fp_path_length, size_t depth_prev);
-    void stailInsertNode256ChangeFp(ART* tree, ArtNode** nodeRef,
+    void stailInsertNode256ChangeFp(ART* tree, NodeRef* nodeRef,
                                     uint8_t keyByte, ArtNode* child);
-    void lilCanInsertNode256ChangeFp(ART* tree, ArtNode** nodeRef,
+    void lilCanInsertNode256ChangeFp(ART* tree, NodeRef* nodeRef,
                                     uint8_t keyByte, ArtNode* child);
     // Erase function for Node256
-    void eraseNode256(ART* tree, ArtNode** nodeRef, uint8_t keyByte);
+    void eraseNode256(ART* tree, NodeRef* nodeRef, uint8_t keyByte);
 };
 
+// Terminal node for the last key byte of a self-keyed tree, where every leaf
+// value equals its key. A leaf is stored as one bit, its value is rebuilt as
+// base | keyByte
+struct NodeBitmap : ArtNode {
+    uintptr_t base;    // leaf value of the key byte 0
+    uint64_t bits[4];  // occupancy of the 256 key bytes
+
+    NodeBitmap() : ArtNode(NodeTypeBitmap), base(0) {
+        memset(bits, 0, sizeof(bits));
+    }
+
+    bool contains(uint8_t keyByte) const {
+        return (bits[keyByte >> 6] >> (keyByte & 63)) & 1;
+    }
+    // Smallest set key byte >= from, 256 if there is none
+    unsigned nextSet(unsigned from) const;
+    // Largest set key byte <= from, -1 if there is none
+    int prevSet(int from) const;
+    // Number of set key bytes below keyByte
+    unsigned countBelow(unsigned keyByte) const;
+    // The set key byte with rank k, the smallest is 0
+    unsigned nthSet(unsigned k) const;
+    // The leaf stored for keyByte
+    ArtNode* leaf(uint8_t keyByte) const;
+
+    // Base ART insert function for NodeBitmap, it never grows
+    void insertBitmap(ART* tree, NodeRef* nodeRef, uint8_t keyByte);
+    // Insert function used in base tail insert. Checks if fp structures need
+    // to be updated and updates if necessary.
+    void tailInsertBitmap(ART* tree, NodeRef* nodeRef, uint8_t keyByte,
+                          std::array<ArtNode*, maxKeyWidth>& temp_fp_path,
+                          size_t& temp_fp_path_length, size_t depth_prev);
+    void stailInsertBitmapChangeFp(ART* tree, NodeRef* nodeRef,
+                                   uint8_t keyByte);
+    void lilCanInsertBitmapChangeFp(ART* tree, NodeRef* nodeRef,
+                                    uint8_t keyByte);
+    // Erase function for NodeBitmap
+    void eraseBitmap(ART* tree, NodeRef* nodeRef, uint8_t keyByte);
+};
+
+// Terminal node of a self-keyed tree holding every key in [lo, hi]. All keys
+// routed to it agree with lo outside mask, so it can grow up to the bounds of
+// that subtree without being split
+struct NodeInterval : ArtNode {
+    uintptr_t lo;    // smallest key
+    uintptr_t hi;    // largest key
+    uintptr_t mask;  // key bits that vary below the position of the node
+
+    NodeInterval() : ArtNode(NodeTypeInterval), lo(0), hi(0), mask(0) {}
+
+    bool contains(uintptr_t value) const { return value >= lo && value <= hi; }
+    // Can value be added by moving one of the bounds
+    bool extendsTo(uintptr_t value) const {
+        return (value == hi + 1 || value + 1 == lo) &&
+               (value & ~mask) == (lo & ~mask);
+    }
+    void extend(uintptr_t value) {
+        if (value > hi)
+            hi = value;
+        else
+            lo = value;
+    }
+};
+
+// Terminal node holding up to capacity leaves in ascending order of their
+// keys. Leaves that collide below an inner node are gathered here instead of
+// in a chain of small inner nodes; once the bucket size of the tree is
+// reached it bursts into an inner node with smaller buckets below
+struct NodeBucket : ArtNode {
+    uint8_t capacity;  // number of leaves that fit in the node
+    uint8_t depth;     // number of key bytes consumed above the bucket
+    NodeRef child[];   // leaves, sorted by key
+
+    NodeBucket(unsigned capacity, unsigned depth)
+        : ArtNode(NodeTypeBucket), capacity(capacity), depth(depth) {}
+
+    static size_t sizeFor(unsigned capacity) {
+        return sizeof(NodeBucket) + capacity * sizeof(NodeRef);
+    }
+    // Number of leaves that fill the given number of cache lines
+    static unsigned capacityFor(size_t lines) {
+        return (lines * NodeAllocator::cacheLineSize - sizeof(NodeBucket)) /
+               sizeof(NodeRef);
+    }
+    // Position of the first leaf whose value is not below value
+    unsigned lowerBound(uintptr_t value) const;
+    // The leaf of value, NULL if it is not in the bucket
+    ArtNode* find(uintptr_t value) const;
+};
+
+// A Node4 fits in exactly one cache line, and so does a NodeBitmap
+static_assert(sizeof(Node4) <= NodeAllocator::cacheLineSize,
+              "Node4 must fit in one cache line");
+static_assert(sizeof(NodeBitmap) <= NodeAllocator::cacheLineSize,
+              "NodeBitmap must fit in one cache line");
+
+size_t nodeSize(int8_t type) {
+    // Size of the node struct of the given type
+    switch (type) {
+        case NodeType4:
+            return sizeof(Node4);
+        case NodeType8:
+            return sizeof(Node8);
+        case NodeType16:
+            return sizeof(Node16);
+        case NodeType32:
+            return sizeof(Node32);
+        case NodeType48:
+            return sizeof(Node48);
+        case NodeType256:
+            return sizeof(Node256);
+        case NodeTypeBitmap:
+            return sizeof(NodeBitmap);
+        case NodeTypeInterval:
+            return sizeof(NodeInterval);
+        case NodeTypeBucket:
+            return sizeof(NodeBucket);  // without its leaves
+    }
+    throw;  // Unreachable
+}
+
+size_t nodeSize(ArtNode* node) {
+    // Size of the given node, buckets vary with their capacity
+    if (node->type == NodeTypeBucket)
+        return NodeBucket::sizeFor(static_cast<NodeBucket*>(node)->capacity);
+    return nodeSize(node->type);
+}
+
+// Intervals and buckets end a path without further key bytes to dispatch on
+bool isTerminal(ArtNode* node) {
+    return node->type == NodeTypeInterval || node->type == NodeTypeBucket;
+}
+
+// Inner nodes are allocated from the slab allocator owned by the tree. These
+// are defined in ART.h, once ART is a complete type
+template <class T>
+T* allocNode(ART* tree);
+NodeBucket* allocBucket(ART* tree, unsigned capacity, unsigned depth);
+void freeNode(ART* tree, ArtNode* node);
+// Account for leaves added to or removed from the tree, defined in ART.h
+void countLeaves(ART* tree, ptrdiff_t delta);
+// Replace a full bitmap node by the interval of its keys, defined in ART.h
+void collapseBitmap(ART* tree, NodeRef* nodeRef, NodeBitmap* node);
+// Add a child to an inner node of any type on the growth ladder
+void insertChild(ART* tree, NodeRef* nodeRef, ArtNode* node, uint8_t keyByte,
+                 ArtNode* child);
+// The same for the inserts of the QuART trees, which keep their fast path up
+// to date. These are defined in ArtNodeNewMethods.cpp
+void tailInsertChild(ART* tree, NodeRef* nodeRef, ArtNode* node,
+                     uint8_t keyByte, ArtNode* child,
+                     std::array<ArtNode*, maxKeyWidth>& temp_fp_path,
+                     size_t& temp_fp_path_length, size_t depth_prev);
+void lilInsertChild(ART* tree, NodeRef* nodeRef, ArtNode* node,
+                    uint8_t keyByte, ArtNode* child);
+void stailInsertChildChangeFp(ART* tree, NodeRef* nodeRef, ArtNode* node,
+                              uint8_t keyByte, ArtNode* child);
+void stailInsertChildPreserveFp(ART* tree, NodeRef* nodeRef, ArtNode* node,
+                                uint8_t keyByte, ArtNode* child);
+void lilCanInsertChildChangeFp(ART* tree, NodeRef* nodeRef, ArtNode* node,
+                               uint8_t keyByte, ArtNode* child);
+void lilCanInsertChildPreserveFp(ART* tree, NodeRef* nodeRef, ArtNode* node,
+                                 uint8_t keyByte, ArtNode* child);
+
 void copyPrefix(ArtNode* src, ArtNode* dst) {
     // Helper function that copies the prefix from the source to the destination
     // node
     dst->prefixLength = src->prefixLength;
     memcpy(dst->prefix, src->prefix, min(src->prefixLength, maxPrefixLength));
+#ifdef ART_ORDER_STATISTICS
+    // The copy replaces the node, the keys below it stay the same
+    dst->leaves = src->leaves;
+#endif
 }
 
+// Leaves are tagged in bit 0. A pseudo-leaf stores its value, which is also
+// its key, in the bits above bit 1. A leaf whose payload differs from its key
+// points to a leaf record instead and is tagged in bit 1 as well. A key with
+// several payloads is tagged in bit 2 too, its record holds the smallest of
+// them and is followed by the list of all. In a tree of variable-length keys
+// every leaf has a record, its key field holds the key length and the key
+// bytes follow the record
+struct LeafRecord {
+    uint64_t key;
+    uint64_t payload;
+};
+
 inline ArtNode* makeLeaf(uintptr_t tid) {
     // Create a pseudo-leaf
-    return reinterpret_cast<ArtNode*>((tid << 1) | 1);
+    return reinterpret_cast<ArtNode*>((tid << 2) | 1);
+}
+
+inline bool fitsInLeaf(uintptr_t tid) {
+    // Does a key fit in a pseudo-leaf, wider keys always get a leaf record
+    return (tid >> 62) == 0;
+}
+
+inline ArtNode* makeRecordLeaf(LeafRecord* record) {
+    // Create a leaf that refers to a record, records are 16-byte aligned
+    return reinterpret_cast<ArtNode*>(reinterpret_cast<uintptr_t>(record) |
+                                      3);
+}
+
+inline ArtNode* makePostingLeaf(LeafRecord* record) {
+    // Create a leaf that refers to the record of a key with several payloads
+    return reinterpret_cast<ArtNode*>(reinterpret_cast<uintptr_t>(record) |
+                                      7);
+}
+
+inline bool isRecordLeaf(ArtNode* node) {
+    return (reinterpret_cast<uintptr_t>(node) & 3) == 3;
+}
+
+inline bool isPostingLeaf(ArtNode* node) {
+    return (reinterpret_cast<uintptr_t>(node) & 7) == 7;
+}
+
+inline LeafRecord* leafRecord(ArtNode* node) {
+    return reinterpret_cast<LeafRecord*>(reinterpret_cast<uintptr_t>(node) &
+                                         ~uintptr_t(7));
 }
 
 inline uintptr_t getLeafValue(ArtNode* node) {
-    // The the value stored in the pseudo-leaf
-    return reinterpret_cast<uintptr_t>(node) >> 1;
+    // The key of the leaf, read from its record if it has one
+    if (isRecordLeaf(node)) return leafRecord(node)->key;
+    return reinterpret_cast<uintptr_t>(node) >> 2;
+}
+
+inline const uint8_t* recordKey(LeafRecord* record) {
+    // Bytes of a variable-length key, stored right after its record
+    return reinterpret_cast<const uint8_t*>(record + 1);
+}
+
+inline uint64_t& recordExpiry(LeafRecord* record) {
+    // Expiry time of a key of an expiring tree, stored after its record
+    return *reinterpret_cast<uint64_t*>(record + 1);
+}
+
+inline PostingList*& recordPostings(LeafRecord* record) {
+    // Payloads of a key with several, stored after its record
+    return *reinterpret_cast<PostingList**>(record + 1);
+}
+
+inline const uint8_t* leafKey(ArtNode* leaf, uint8_t buffer[],
+                              unsigned maxKeyLength) {
+    // Bytes of the key of a leaf. A fixed-length key is rebuilt from the
+    // leaf value in buffer, a variable-length one is read from its record
+    if (maxKeyLength == variableKeyLength) return recordKey(leafRecord(leaf));
+    loadKey(getLeafValue(leaf), buffer, maxKeyLength);
+    return buffer;
+}
+
+inline unsigned getLeafKey(ArtNode* leaf, uint8_t key[]) {
+    // Copy the key of a leaf of a variable-length tree, returns its length
+    return unterminateKey(recordKey(leafRecord(leaf)), key);
+}
+
+inline uint64_t getLeafPayload(ArtNode* node) {
+    // The payload inserted with the key, the key itself for a pseudo-leaf
+    if (isRecordLeaf(node)) return leafRecord(node)->payload;
+    return reinterpret_cast<uintptr_t>(node) >> 2;
 }
 
 inline bool isLeaf(ArtNode* node) {
@@ -217,7 +633,334 @@ inline bool isLeaf(ArtNode* node) {
     return reinterpret_cast<uintptr_t>(node) & 1;
 }
 
-void Node4::insertNode4(ART* tree, ArtNode** nodeRef, uint8_t keyByte,
+// Leaf of the fast path. Only its key is kept, so it does not dangle once a
+// leaf record is freed or moved: as a pseudo-leaf, or in a record of its own
+// if the key is too wide for one. Leaves compare equal if their keys do
+class FastPathLeaf {
+   public:
+    FastPathLeaf(ArtNode* leaf = nullptr) { *this = leaf; }
+    FastPathLeaf(const FastPathLeaf& other) { *this = other.leaf; }
+#ifdef ART_COMPRESSED_CHILDREN
+    FastPathLeaf(NodeRef leaf) { *this = static_cast<ArtNode*>(leaf); }
+    FastPathLeaf& operator=(NodeRef leaf) {
+        return *this = static_cast<ArtNode*>(leaf);
+    }
+#endif
+
+    FastPathLeaf& operator=(const FastPathLeaf& other) {
+        return *this = other.leaf;
+    }
+    FastPathLeaf& operator=(ArtNode* node) {
+        if (isRecordLeaf(node))
+            setKey(getLeafValue(node));
+        else
+            leaf = node;
+        return *this;
+    }
+    void setKey(uintptr_t key) {
+        if (fitsInLeaf(key)) {
+            leaf = makeLeaf(key);
+            return;
+        }
+        record = {key, key};
+        leaf = makeRecordLeaf(&record);
+    }
+
+    operator ArtNode*() const { return leaf; }
+    bool operator==(ArtNode* other) const {
+        if (isLeaf(leaf) && isLeaf(other))
+            return getLeafValue(leaf) == getLeafValue(other);
+        return leaf == other;
+    }
+    bool operator!=(ArtNode* other) const { return !(*this == other); }
+
+   private:
+    ArtNode* leaf;
+    LeafRecord record;
+};
+
+inline uintptr_t subtreeMask(unsigned depth, unsigned keyLength) {
+    // Key bits that vary among the keys below a node at depth
+    unsigned bits = 8 * (keyLength - depth);
+    if (bits >= 8 * sizeof(uintptr_t)) return ~uintptr_t(0);
+    return (uintptr_t(1) << bits) - 1;
+}
+
+int8_t grownType(int8_t type) {
+    // The next larger node type on the growth ladder
+    switch (type) {
+        case NodeType4:
+            return ladderNode8 ? NodeType8 : NodeType16;
+        case NodeType8:
+            return NodeType16;
+        case NodeType16:
+            return ladderNode32 ? NodeType32 : NodeType48;
+        case NodeType32:
+            return NodeType48;
+    }
+    return NodeType256;
+}
+
+int8_t shrunkType(int8_t type) {
+    // The next smaller node type on the growth ladder
+    switch (type) {
+        case NodeType8:
+            return NodeType4;
+        case NodeType16:
+            return ladderNode8 ? NodeType8 : NodeType4;
+        case NodeType32:
+            return NodeType16;
+        case NodeType48:
+            return ladderNode32 ? NodeType32 : NodeType16;
+    }
+    return NodeType48;
+}
+
+unsigned shrinkCount(int8_t type) {
+    // Number of children at which a node shrinks to the smaller type, below
+    // its capacity so that a node does not flip between two types
+    switch (shrunkType(type)) {
+        case NodeType4:
+            return 3;
+        case NodeType8:
+            return 6;
+        case NodeType16:
+            return 12;
+        case NodeType32:
+            return 28;
+    }
+    return 37;
+}
+
+unsigned sortedChildren(ArtNode* node, uint8_t keys[], NodeRef children[]) {
+    // Copy the key bytes and children of an inner node in ascending key
+    // order, returns their number
+    unsigned count = 0;
+    switch (node->type) {
+        case NodeType4: {
+            Node4* n = static_cast<Node4*>(node);
+            for (; count < n->count; count++) {
+                keys[count] = n->key[count];
+                children[count] = n->child[count];
+            }
+            break;
+        }
+        case NodeType8: {
+            Node8* n = static_cast<Node8*>(node);
+            for (; count < n->count; count++) {
+                keys[count] = n->key[count];
+                children[count] = n->child[count];
+            }
+            break;
+        }
+        case NodeType16: {
+            Node16* n = static_cast<Node16*>(node);
+            for (; count < n->count; count++) {
+                keys[count] = flipSign(n->key[count]);
+                children[count] = n->child[count];
+            }
+            break;
+        }
+        case NodeType32: {
+            Node32* n = static_cast<Node32*>(node);
+            for (; count < n->count; count++) {
+                keys[count] = flipSign(n->key[count]);
+                children[count] = n->child[count];
+            }
+            break;
+        }
+        case NodeType48: {
+            Node48* n = static_cast<Node48*>(node);
+            for (unsigned b = 0; b < 256; b++) {
+                if (n->childIndex[b] != emptyMarker) {
+                    keys[count] = b;
+                    children[count++] = n->child[n->childIndex[b]];
+                }
+            }
+            break;
+        }
+        case NodeType256: {
+            Node256* n = static_cast<Node256*>(node);
+            for (unsigned b = 0; b < 256; b++) {
+                if (n->child[b]) {
+                    keys[count] = b;
+                    children[count++] = n->child[b];
+                }
+            }
+            break;
+        }
+    }
+    return count;
+}
+
+template <class T>
+T* allocNodeLike(ART* tree, ArtNode* node) {
+    // New node with the prefix and number of children of node
+    T* newNode = allocNode<T>(tree);
+    newNode->count = node->count;
+    copyPrefix(node, newNode);
+    return newNode;
+}
+
+ArtNode* resizeNode(ART* tree, ArtNode* node, int8_t type) {
+    // Copy an inner node into a new node of the given type on the growth
+    // ladder. The caller replaces and frees the old node
+    uint8_t keys[256];
+    NodeRef children[256];
+    unsigned count = sortedChildren(node, keys, children);
+    switch (type) {
+        case NodeType4: {
+            Node4* newNode = allocNodeLike<Node4>(tree, node);
+            memcpy(newNode->key, keys, count);
+            memcpy(newNode->child, children, count * sizeof(NodeRef));
+            return newNode;
+        }
+        case NodeType8: {
+            Node8* newNode = allocNodeLike<Node8>(tree, node);
+            memcpy(newNode->key, keys, count);
+            memcpy(newNode->child, children, count * sizeof(NodeRef));
+            return newNode;
+        }
+        case NodeType16: {
+            Node16* newNode = allocNodeLike<Node16>(tree, node);
+            for (unsigned i = 0; i < count; i++)
+                newNode->key[i] = flipSign(keys[i]);
+            memcpy(newNode->child, children, count * sizeof(NodeRef));
+            return newNode;
+        }
+        case NodeType32: {
+            Node32* newNode = allocNodeLike<Node32>(tree, node);
+            for (unsigned i = 0; i < count; i++)
+                newNode->key[i] = flipSign(keys[i]);
+            memcpy(newNode->child, children, count * sizeof(NodeRef));
+            return newNode;
+        }
+        case NodeType48: {
+            Node48* newNode = allocNodeLike<Node48>(tree, node);
+            for (unsigned i = 0; i < count; i++) {
+                newNode->childIndex[keys[i]] = i;
+                newNode->child[i] = children[i];
+            }
+            return newNode;
+        }
+        case NodeType256: {
+            Node256* newNode = allocNodeLike<Node256>(tree, node);
+            for (unsigned i = 0; i < count; i++)
+                newNode->child[keys[i]] = children[i];
+            return newNode;
+        }
+    }
+    throw;  // Unreachable
+}
+
+ArtNode* growNode(ART* tree, ArtNode* node) {
+    // Copy a full node into the next larger type on the growth ladder
+    return resizeNode(tree, node, grownType(node->type));
+}
+
+NodeRef* childRef(ArtNode* node, ArtNode* child) {
+    // The cell of an inner node that refers to child, NULL if there is none
+    switch (node->type) {
+        case NodeType4: {
+            Node4* n = static_cast<Node4*>(node);
+            for (unsigned i = 0; i < n->count; i++)
+                if (n->child[i] == child) return &n->child[i];
+            break;
+        }
+        case NodeType8: {
+            Node8* n = static_cast<Node8*>(node);
+            for (unsigned i = 0; i < n->count; i++)
+                if (n->child[i] == child) return &n->child[i];
+            break;
+        }
+        case NodeType16: {
+            Node16* n = static_cast<Node16*>(node);
+            for (unsigned i = 0; i < n->count; i++)
+                if (n->child[i] == child) return &n->child[i];
+            break;
+        }
+        case NodeType32: {
+            Node32* n = static_cast<Node32*>(node);
+            for (unsigned i = 0; i < n->count; i++)
+                if (n->child[i] == child) return &n->child[i];
+            break;
+        }
+        case NodeType48: {
+            Node48* n = static_cast<Node48*>(node);
+            for (unsigned i = 0; i < 48; i++)
+                if (n->child[i] == child) return &n->child[i];
+            break;
+        }
+        case NodeType256: {
+            Node256* n = static_cast<Node256*>(node);
+            for (unsigned i = 0; i < 256; i++)
+                if (n->child[i] == child) return &n->child[i];
+            break;
+        }
+    }
+    return NULL;
+}
+
+unsigned childSlots(ArtNode* node, NodeRef** slots) {
+    // The child cells of a node and their number, empty cells of Node48 and
+    // Node256 are NULL. Buckets only hold leaves
+    switch (node->type) {
+        case NodeType4:
+            *slots = static_cast<Node4*>(node)->child;
+            return node->count;
+        case NodeType8:
+            *slots = static_cast<Node8*>(node)->child;
+            return node->count;
+        case NodeType16:
+            *slots = static_cast<Node16*>(node)->child;
+            return node->count;
+        case NodeType32:
+            *slots = static_cast<Node32*>(node)->child;
+            return node->count;
+        case NodeType48:
+            *slots = static_cast<Node48*>(node)->child;
+            return 48;
+        case NodeType256:
+            *slots = static_cast<Node256*>(node)->child;
+            return 256;
+        case NodeTypeBucket:
+            *slots = static_cast<NodeBucket*>(node)->child;
+            return node->count;
+    }
+    return 0;
+}
+
+void insertChild(ART* tree, NodeRef* nodeRef, ArtNode* node, uint8_t keyByte,
+                 ArtNode* child) {
+    switch (node->type) {
+        case NodeType4:
+            static_cast<Node4*>(node)->insertNode4(tree, nodeRef, keyByte,
+                                                   child);
+            break;
+        case NodeType8:
+            static_cast<Node8*>(node)->insertNode8(tree, nodeRef, keyByte,
+                                                   child);
+            break;
+        case NodeType16:
+            static_cast<Node16*>(node)->insertNode16(tree, nodeRef, keyByte,
+                                                     child);
+            break;
+        case NodeType32:
+            static_cast<Node32*>(node)->insertNode32(tree, nodeRef, keyByte,
+                                                     child);
+            break;
+        case NodeType48:
+            static_cast<Node48*>(node)->insertNode48(tree, nodeRef, keyByte,
+                                                     child);
+            break;
+        case NodeType256:
+            static_cast<Node256*>(node)->insertNode256(tree, nodeRef, keyByte,
+                                                       child);
+            break;
+    }
+}
+
+void Node4::insertNode4(ART* tree, NodeRef* nodeRef, uint8_t keyByte,
                         ArtNode* child) {
     // Insert leaf into inner node
     if (this->count < 4) {
@@ -229,39 +972,41 @@ void Node4::insertNode4(ART* tree, ArtNode** nodeRef, uint8_t keyByte,
         // key/child. This preserves the sorted order of keys in the node.
         memmove(this->key + pos + 1, this->key + pos, this->count - pos);
         memmove(this->child + pos + 1, this->child + pos,
-                (this->count - pos) * sizeof(uintptr_t));
+                (this->count - pos) * sizeof(NodeRef));
         this->key[pos] = keyByte;
         this->child[pos] = child;
         this->count++;
     } else {
-        // Grow to Node16
-        Node16* newNode = new Node16();
+        // Grow to Node8 or Node16
+        ArtNode* newNode = growNode(tree, this);
         *nodeRef = newNode;
-        newNode->count = 4;
-        copyPrefix(this, newNode);
-        for (unsigned i = 0; i < 4; i++)
-            newNode->key[i] = flipSign(this->key[i]);
-        memcpy(newNode->child, this->child, this->count * sizeof(uintptr_t));
-        delete this;
-        return newNode->insertNode16(tree, nodeRef, keyByte, child);
+        freeNode(tree, this);
+        return insertChild(tree, nodeRef, newNode, keyByte, child);
     }
 }
 
-void Node4::eraseNode4(ART* tree [[maybe_unused]], ArtNode** nodeRef,
-                       ArtNode** leafPlace) {
+void Node4::eraseNode4(ART* tree, NodeRef* nodeRef, NodeRef* leafPlace) {
     // Delete leaf from inner node
     unsigned pos = leafPlace - this->child;
     // Shift keys and children to the left to fill the gap left by the removed
     // key/child. This keeps the keys and children arrays compact and ordered.
     memmove(this->key + pos, this->key + pos + 1, this->count - pos - 1);
     memmove(this->child + pos, this->child + pos + 1,
-            (this->count - pos - 1) * sizeof(uintptr_t));
+            (this->count - pos - 1) * sizeof(NodeRef));
     this->count--;
 
     if (this->count == 1) {
         // Get rid of one-way node
         ArtNode* child = this->child[0];
-        if (!isLeaf(child)) {
+        if (!isLeaf(child) && child->type == NodeTypeBucket) {
+            // A bucket keeps the depth it starts at instead of a prefix
+            static_cast<NodeBucket*>(child)->depth -= this->prefixLength + 1;
+        } else if (!isLeaf(child) && child->type == NodeTypeInterval) {
+            // An interval may grow over the key bytes of the node as well
+            NodeInterval* interval = static_cast<NodeInterval*>(child);
+            for (unsigned i = 0; i <= this->prefixLength; i++)
+                interval->mask = interval->mask << 8 | 0xFF;
+        } else if (!isLeaf(child)) {
             // Concantenate prefixes
             unsigned l1 = this->prefixLength;
             if (l1 < maxPrefixLength) {
@@ -278,11 +1023,54 @@ void Node4::eraseNode4(ART* tree [[maybe_unused]], ArtNode** nodeRef,
             child->prefixLength += this->prefixLength + 1;
         }
         *nodeRef = child;
-        delete this;
+        freeNode(tree, this);
     }
 }
 
-void Node16::insertNode16(ART* tree, ArtNode** nodeRef, uint8_t keyByte,
+void Node8::insertSorted(uint8_t keyByte, ArtNode* child) {
+    // Keys are kept unflipped as in Node4, a linear scan over 8 bytes finds
+    // the position
+    unsigned pos;
+    for (pos = 0; (pos < this->count) && (this->key[pos] < keyByte); pos++)
+        ;
+    memmove(this->key + pos + 1, this->key + pos, this->count - pos);
+    memmove(this->child + pos + 1, this->child + pos,
+            (this->count - pos) * sizeof(NodeRef));
+    this->key[pos] = keyByte;
+    this->child[pos] = child;
+    this->count++;
+}
+
+void Node8::insertNode8(ART* tree, NodeRef* nodeRef, uint8_t keyByte,
+                        ArtNode* child) {
+    // Insert leaf into inner node
+    if (this->count < 8) {
+        insertSorted(keyByte, child);
+    } else {
+        // Grow to Node16
+        ArtNode* newNode = growNode(tree, this);
+        *nodeRef = newNode;
+        freeNode(tree, this);
+        return insertChild(tree, nodeRef, newNode, keyByte, child);
+    }
+}
+
+void Node8::eraseNode8(ART* tree, NodeRef* nodeRef, NodeRef* leafPlace) {
+    // Delete leaf from inner node
+    unsigned pos = leafPlace - this->child;
+    memmove(this->key + pos, this->key + pos + 1, this->count - pos - 1);
+    memmove(this->child + pos, this->child + pos + 1,
+            (this->count - pos - 1) * sizeof(NodeRef));
+    this->count--;
+
+    if (this->count == shrinkCount(NodeType8)) {
+        // Shrink to Node4
+        *nodeRef = resizeNode(tree, this, shrunkType(NodeType8));
+        freeNode(tree, this);
+    }
+}
+
+void Node16::insertNode16(ART* tree, NodeRef* nodeRef, uint8_t keyByte,
                           ArtNode* child) {
     // Insert leaf into inner node
     if (this->count < 16) {
@@ -313,49 +1101,113 @@ void Node16::insertNode16(ART* tree, ArtNode** nodeRef, uint8_t keyByte,
         // key/child. This preserves the sorted order of keys in the node.
         memmove(this->key + pos + 1, this->key + pos, this->count - pos);
         memmove(this->child + pos + 1, this->child + pos,
-                (this->count - pos) * sizeof(uintptr_t));
+                (this->count - pos) * sizeof(NodeRef));
         this->key[pos] = keyByteFlipped;
         this->child[pos] = child;
         this->count++;
     } else {
-        // Grow to Node48
-        Node48* newNode = new Node48();
+        // Grow to Node32 or Node48
+        ArtNode* newNode = growNode(tree, this);
         *nodeRef = newNode;
-        memcpy(newNode->child, this->child, this->count * sizeof(uintptr_t));
-        for (unsigned i = 0; i < this->count; i++)
-            newNode->childIndex[flipSign(this->key[i])] = i;
-        copyPrefix(this, newNode);
-        newNode->count = this->count;
-        delete this;
-        return newNode->insertNode48(tree, nodeRef, keyByte, child);
+        freeNode(tree, this);
+        return insertChild(tree, nodeRef, newNode, keyByte, child);
     }
 }
 
-void Node16::eraseNode16(ART* tree [[maybe_unused]], ArtNode** nodeRef,
-                         ArtNode** leafPlace) {
+void Node16::eraseNode16(ART* tree, NodeRef* nodeRef, NodeRef* leafPlace) {
     // Delete leaf from inner node
     unsigned pos = leafPlace - this->child;
     // Shift keys and children to the left to fill the gap left by the removed
     // key/child. This keeps the keys and children arrays compact and ordered.
     memmove(this->key + pos, this->key + pos + 1, this->count - pos - 1);
     memmove(this->child + pos, this->child + pos + 1,
-            (this->count - pos - 1) * sizeof(uintptr_t));
+            (this->count - pos - 1) * sizeof(NodeRef));
     this->count--;
 
-    if (this->count == 3) {
-        // Shrink to Node4
-        Node4* newNode = new Node4();
-        newNode->count = this->count;
-        copyPrefix(this, newNode);
-        for (unsigned i = 0; i < 4; i++)
-            newNode->key[i] = flipSign(this->key[i]);
-        memcpy(newNode->child, this->child, sizeof(uintptr_t) * 4);
+    if (this->count == shrinkCount(NodeType16)) {
+        // Shrink to Node8 or Node4
+        *nodeRef = resizeNode(tree, this, shrunkType(NodeType16));
+        freeNode(tree, this);
+    }
+}
+
+uint32_t Node32::equalMask(uint8_t keyByte) const {
+    // SIMD: Compare keyByte (after flipSign) with all 32 keys in parallel,
+    // in one AVX2 register or in two SSE halves
+#ifdef __AVX2__
+    __m256i needle = _mm256_set1_epi8(flipSign(keyByte));
+    __m256i keys = _mm256_load_si256(reinterpret_cast<const __m256i*>(key));
+    uint32_t bitfield = _mm256_movemask_epi8(_mm256_cmpeq_epi8(needle, keys));
+#else
+    __m128i needle = _mm_set1_epi8(flipSign(keyByte));
+    __m128i lo = _mm_load_si128(reinterpret_cast<const __m128i*>(key));
+    __m128i hi = _mm_load_si128(reinterpret_cast<const __m128i*>(key + 16));
+    uint32_t bitfield =
+        _mm_movemask_epi8(_mm_cmpeq_epi8(needle, lo)) |
+        (uint32_t(_mm_movemask_epi8(_mm_cmpeq_epi8(needle, hi))) << 16);
+#endif
+    return bitfield & uint32_t((uint64_t(1) << this->count) - 1);
+}
+
+uint32_t Node32::greaterMask(uint8_t keyByte) const {
+    // Signed comparison of the flipped keys, as in Node16
+#ifdef __AVX2__
+    __m256i needle = _mm256_set1_epi8(flipSign(keyByte));
+    __m256i keys = _mm256_load_si256(reinterpret_cast<const __m256i*>(key));
+    uint32_t bitfield = _mm256_movemask_epi8(_mm256_cmpgt_epi8(keys, needle));
+#else
+    __m128i needle = _mm_set1_epi8(flipSign(keyByte));
+    __m128i lo = _mm_load_si128(reinterpret_cast<const __m128i*>(key));
+    __m128i hi = _mm_load_si128(reinterpret_cast<const __m128i*>(key + 16));
+    uint32_t bitfield =
+        _mm_movemask_epi8(_mm_cmpgt_epi8(lo, needle)) |
+        (uint32_t(_mm_movemask_epi8(_mm_cmpgt_epi8(hi, needle))) << 16);
+#endif
+    return bitfield & uint32_t((uint64_t(1) << this->count) - 1);
+}
+
+void Node32::insertSorted(uint8_t keyByte, ArtNode* child) {
+    // Position of the first key greater than keyByte
+    uint32_t bitfield = greaterMask(keyByte);
+    unsigned pos = bitfield ? __builtin_ctz(bitfield) : this->count;
+    memmove(this->key + pos + 1, this->key + pos, this->count - pos);
+    memmove(this->child + pos + 1, this->child + pos,
+            (this->count - pos) * sizeof(NodeRef));
+    this->key[pos] = flipSign(keyByte);
+    this->child[pos] = child;
+    this->count++;
+}
+
+void Node32::insertNode32(ART* tree, NodeRef* nodeRef, uint8_t keyByte,
+                          ArtNode* child) {
+    // Insert leaf into inner node
+    if (this->count < 32) {
+        insertSorted(keyByte, child);
+    } else {
+        // Grow to Node48
+        ArtNode* newNode = growNode(tree, this);
         *nodeRef = newNode;
-        delete this;
+        freeNode(tree, this);
+        return insertChild(tree, nodeRef, newNode, keyByte, child);
     }
 }
 
-void Node48::insertNode48(ART* tree, ArtNode** nodeRef, uint8_t keyByte,
+void Node32::eraseNode32(ART* tree, NodeRef* nodeRef, NodeRef* leafPlace) {
+    // Delete leaf from inner node
+    unsigned pos = leafPlace - this->child;
+    memmove(this->key + pos, this->key + pos + 1, this->count - pos - 1);
+    memmove(this->child + pos, this->child + pos + 1,
+            (this->count - pos - 1) * sizeof(NodeRef));
+    this->count--;
+
+    if (this->count == shrinkCount(NodeType32)) {
+        // Shrink to Node16
+        *nodeRef = resizeNode(tree, this, shrunkType(NodeType32));
+        freeNode(tree, this);
+    }
+}
+
+void Node48::insertNode48(ART* tree, NodeRef* nodeRef, uint8_t keyByte,
                           ArtNode* child) {
     // Insert leaf into inner node
     if (this->count < 48) {
@@ -371,20 +1223,19 @@ void Node48::insertNode48(ART* tree, ArtNode** nodeRef, uint8_t keyByte,
         this->count++;
     } else {
         // Grow to Node256
-        Node256* newNode = new Node256();
+        Node256* newNode = allocNode<Node256>(tree);
         for (unsigned i = 0; i < 256; i++)
             if (this->childIndex[i] != 48)
                 newNode->child[i] = this->child[this->childIndex[i]];
         newNode->count = this->count;
         copyPrefix(this, newNode);
         *nodeRef = newNode;
-        delete this;
+        freeNode(tree, this);
         return newNode->insertNode256(tree, nodeRef, keyByte, child);
     }
 }
 
-void Node48::eraseNode48(ART* tree [[maybe_unused]], ArtNode** nodeRef,
-                         uint8_t keyByte) {
+void Node48::eraseNode48(ART* tree, NodeRef* nodeRef, uint8_t keyByte) {
     // Delete leaf from inner node
     // No memmove needed here because Node48 uses a mapping (childIndex) and a
     // dense array.
@@ -392,25 +1243,15 @@ void Node48::eraseNode48(ART* tree [[maybe_unused]], ArtNode** nodeRef,
     this->childIndex[keyByte] = emptyMarker;
     this->count--;
 
-    if (this->count == 12) {
-        // Shrink to Node16
-        Node16* newNode = new Node16();
-        *nodeRef = newNode;
-        copyPrefix(this, newNode);
-        for (unsigned b = 0; b < 256; b++) {
-            if (this->childIndex[b] != emptyMarker) {
-                newNode->key[newNode->count] = flipSign(b);
-                newNode->child[newNode->count] =
-                    this->child[this->childIndex[b]];
-                newNode->count++;
-            }
-        }
-        delete this;
+    if (this->count == shrinkCount(NodeType48)) {
+        // Shrink to Node32 or Node16
+        *nodeRef = resizeNode(tree, this, shrunkType(NodeType48));
+        freeNode(tree, this);
     }
 }
 
 void Node256::insertNode256(ART* tree [[maybe_unused]],
-                            ArtNode** nodeRef [[maybe_unused]], uint8_t keyByte,
+                            NodeRef* nodeRef [[maybe_unused]], uint8_t keyByte,
                             ArtNode* child) {
     // Insert leaf into inner node
     // No memmove needed here because Node256 uses a direct mapping for all
@@ -419,8 +1260,7 @@ void Node256::insertNode256(ART* tree [[maybe_unused]],
     this->child[keyByte] = child;
 }
 
-void Node256::eraseNode256(ART* tree [[maybe_unused]], ArtNode** nodeRef,
-                           uint8_t keyByte) {
+void Node256::eraseNode256(ART* tree, NodeRef* nodeRef, uint8_t keyByte) {
     // Delete leaf from inner node
     // No memmove needed here because Node256 uses a direct mapping for all
     // possible keys.
@@ -429,7 +1269,7 @@ void Node256::eraseNode256(ART* tree [[maybe_unused]], ArtNode** nodeRef,
 
     if (this->count == 37) {
         // Shrink to Node48
-        Node48* newNode = new Node48();
+        Node48* newNode = allocNode<Node48>(tree);
         *nodeRef = newNode;
         copyPrefix(this, newNode);
         for (unsigned b = 0; b < 256; b++) {
@@ -439,11 +1279,103 @@ void Node256::eraseNode256(ART* tree [[maybe_unused]], ArtNode** nodeRef,
                 newNode->count++;
             }
         }
-        delete this;
+        freeNode(tree, this);
+    }
+}
+
+unsigned NodeBitmap::nextSet(unsigned from) const {
+    // Scan the occupancy words upwards from the word holding from
+    for (unsigned word = from >> 6; word < 4; word++) {
+        uint64_t mask = this->bits[word];
+        if (word == from >> 6) mask &= ~uint64_t(0) << (from & 63);
+        if (mask) return word * 64 + __builtin_ctzll(mask);
+    }
+    return 256;
+}
+
+int NodeBitmap::prevSet(int from) const {
+    // Scan the occupancy words downwards from the word holding from
+    for (int word = from >> 6; word >= 0; word--) {
+        uint64_t mask = this->bits[word];
+        if (word == from >> 6) mask &= ~uint64_t(0) >> (63 - (from & 63));
+        if (mask) return word * 64 + 63 - __builtin_clzll(mask);
     }
+    return -1;
+}
+
+unsigned NodeBitmap::countBelow(unsigned keyByte) const {
+    unsigned count = 0;
+    for (unsigned word = 0; word < keyByte >> 6; word++)
+        count += __builtin_popcountll(this->bits[word]);
+    if (keyByte & 63)
+        count += __builtin_popcountll(this->bits[keyByte >> 6] &
+                                      (~uint64_t(0) >> (64 - (keyByte & 63))));
+    return count;
 }
 
-ArtNode** findChild(ArtNode* n, uint8_t keyByte) {
+unsigned NodeBitmap::nthSet(unsigned k) const {
+    // Skip whole words, then clear the lowest bits of the word holding it
+    unsigned word = 0;
+    for (unsigned set; k >= (set = __builtin_popcountll(this->bits[word]));
+         word++)
+        k -= set;
+    uint64_t mask = this->bits[word];
+    for (; k > 0; k--) mask &= mask - 1;
+    return word * 64 + __builtin_ctzll(mask);
+}
+
+ArtNode* NodeBitmap::leaf(uint8_t keyByte) const {
+    return makeLeaf(this->base | keyByte);
+}
+
+void NodeBitmap::insertBitmap(ART* tree, NodeRef* nodeRef, uint8_t keyByte) {
+    // Insert leaf into inner node
+    // A bitmap covers all possible key bytes, so setting the bit is enough
+    if (!contains(keyByte)) {
+        this->count++;
+        countLeaves(tree, 1);
+    }
+    this->bits[keyByte >> 6] |= uint64_t(1) << (keyByte & 63);
+    // Once every key byte is present the node collapses into an interval
+    if (this->count == 256) collapseBitmap(tree, nodeRef, this);
+}
+
+void NodeBitmap::eraseBitmap(ART* tree, NodeRef* nodeRef, uint8_t keyByte) {
+    // Delete leaf from inner node
+    this->bits[keyByte >> 6] &= ~(uint64_t(1) << (keyByte & 63));
+    this->count--;
+
+    if (this->count == 1) {
+        // Get rid of one-way node, the remaining leaf takes its place
+        *nodeRef = leaf(nextSet(0));
+        freeNode(tree, this);
+    }
+}
+
+unsigned NodeBucket::lowerBound(uintptr_t value) const {
+    // Binary search, key order is the order of the leaf values
+    unsigned lo = 0, hi = count;
+    while (lo < hi) {
+        unsigned mid = (lo + hi) / 2;
+        if (getLeafValue(child[mid]) < value)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+ArtNode* NodeBucket::find(uintptr_t value) const {
+    unsigned pos = lowerBound(value);
+    if (pos < count && getLeafValue(child[pos]) == value) return child[pos];
+    return NULL;
+}
+
+// Leaf synthesized by findChild for a NodeBitmap, it is only valid until the
+// next call
+NodeRef bitmapLeaf = NULL;
+
+NodeRef* findChild(ArtNode* n, uint8_t keyByte) {
     // Find the next child for the keyByte
     switch (n->type) {
         case NodeType4: {
@@ -468,6 +1400,28 @@ ArtNode** findChild(ArtNode* n, uint8_t keyByte) {
             else
                 return &nullNode;
         }
+        case NodeType8: {
+            Node8* node = static_cast<Node8*>(n);
+            // SIMD: Compare keyByte with the 8 keys in the low half of an SSE
+            // register
+            __m128i cmp = _mm_cmpeq_epi8(
+                _mm_set1_epi8(keyByte),
+                _mm_loadl_epi64(reinterpret_cast<__m128i*>(node->key)));
+            unsigned bitfield =
+                _mm_movemask_epi8(cmp) & ((1 << node->count) - 1);
+            if (bitfield)
+                return &node->child[ctz(bitfield)];
+            else
+                return &nullNode;
+        }
+        case NodeType32: {
+            Node32* node = static_cast<Node32*>(n);
+            uint32_t bitfield = node->equalMask(keyByte);
+            if (bitfield)
+                return &node->child[__builtin_ctz(bitfield)];
+            else
+                return &nullNode;
+        }
         case NodeType48: {
             Node48* node = static_cast<Node48*>(n);
             if (node->childIndex[keyByte] != emptyMarker)
@@ -479,6 +1433,12 @@ ArtNode** findChild(ArtNode* n, uint8_t keyByte) {
             Node256* node = static_cast<Node256*>(n);
             return &(node->child[keyByte]);
         }
+        case NodeTypeBitmap: {
+            NodeBitmap* node = static_cast<NodeBitmap*>(n);
+            if (!node->contains(keyByte)) return &nullNode;
+            bitmapLeaf = node->leaf(keyByte);
+            return &bitmapLeaf;
+        }
     }
     throw;  // Unreachable
 }
@@ -498,6 +1458,14 @@ ArtNode* minimum(ArtNode* node) {
             Node16* n = static_cast<Node16*>(node);
             return minimum(n->child[0]);
         }
+        case NodeType8: {
+            Node8* n = static_cast<Node8*>(node);
+            return minimum(n->child[0]);
+        }
+        case NodeType32: {
+            Node32* n = static_cast<Node32*>(node);
+            return minimum(n->child[0]);
+        }
         case NodeType48: {
             Node48* n = static_cast<Node48*>(node);
             unsigned pos = 0;
@@ -510,6 +1478,14 @@ ArtNode* minimum(ArtNode* node) {
             while (!n->child[pos]) pos++;
             return minimum(n->child[pos]);
         }
+        case NodeTypeBitmap: {
+            NodeBitmap* n = static_cast<NodeBitmap*>(node);
+            return n->leaf(n->nextSet(0));
+        }
+        case NodeTypeInterval:
+            return makeLeaf(static_cast<NodeInterval*>(node)->lo);
+        case NodeTypeBucket:
+            return static_cast<NodeBucket*>(node)->child[0];
     }
     throw;  // Unreachable
 }
@@ -529,6 +1505,14 @@ ArtNode* maximum(ArtNode* node) {
             Node16* n = static_cast<Node16*>(node);
             return maximum(n->child[n->count - 1]);
         }
+        case NodeType8: {
+            Node8* n = static_cast<Node8*>(node);
+            return maximum(n->child[n->count - 1]);
+        }
+        case NodeType32: {
+            Node32* n = static_cast<Node32*>(node);
+            return maximum(n->child[n->count - 1]);
+        }
         case NodeType48: {
             Node48* n = static_cast<Node48*>(node);
             unsigned pos = 255;
@@ -541,18 +1525,218 @@ ArtNode* maximum(ArtNode* node) {
             while (!n->child[pos]) pos--;
             return maximum(n->child[pos]);
         }
+        case NodeTypeBitmap: {
+            NodeBitmap* n = static_cast<NodeBitmap*>(node);
+            return n->leaf(n->prevSet(255));
+        }
+        case NodeTypeInterval:
+            return makeLeaf(static_cast<NodeInterval*>(node)->hi);
+        case NodeTypeBucket: {
+            NodeBucket* n = static_cast<NodeBucket*>(node);
+            return n->child[n->count - 1];
+        }
+    }
+    throw;  // Unreachable
+}
+
+// Children in key order, for iterators. The slot of a child is its index in
+// a Node4..Node32 or a bucket, and its key byte in a Node48, a Node256 or a
+// bitmap node. Intervals have no slots
+
+int nextSlot(ArtNode* node, int after) {
+    // Smallest occupied slot above after, -1 if there is none
+    unsigned from = after + 1;
+    switch (node->type) {
+        case NodeType48: {
+            // SIMD: 16 index bytes per compare, empty ones hold emptyMarker
+            Node48* n = static_cast<Node48*>(node);
+            for (unsigned chunk = from & ~15u; chunk < 256; chunk += 16) {
+                __m128i index = _mm_loadu_si128(
+                    reinterpret_cast<__m128i*>(n->childIndex + chunk));
+                unsigned used = ~_mm_movemask_epi8(_mm_cmpeq_epi8(
+                                    index, _mm_set1_epi8(emptyMarker))) &
+                                0xFFFF;
+                if (chunk < from) used &= 0xFFFF << (from - chunk);
+                if (used) return chunk + __builtin_ctz(used);
+            }
+            return -1;
+        }
+        case NodeType256: {
+            // SIMD: 16 bytes of children per compare, a child is set if any
+            // of its bytes is
+            Node256* n = static_cast<Node256*>(node);
+            const unsigned width = sizeof(NodeRef), perChunk = 16 / width;
+            const char* bytes = reinterpret_cast<const char*>(n->child);
+            for (unsigned chunk = from - from % perChunk; chunk < 256;
+                 chunk += perChunk) {
+                __m128i children = _mm_loadu_si128(
+                    reinterpret_cast<const __m128i*>(bytes + chunk * width));
+                unsigned used = ~_mm_movemask_epi8(_mm_cmpeq_epi8(
+                                    children, _mm_setzero_si128())) &
+                                0xFFFF;
+                if (chunk < from) used &= 0xFFFF << (from - chunk) * width;
+                if (used) return chunk + __builtin_ctz(used) / width;
+            }
+            return -1;
+        }
+        case NodeTypeBitmap: {
+            unsigned keyByte =
+                from < 256 ? static_cast<NodeBitmap*>(node)->nextSet(from)
+                           : 256;
+            return keyByte < 256 ? int(keyByte) : -1;
+        }
+    }
+    // Slots of the sorted nodes and buckets are their first count indexes
+    return from < node->count ? int(from) : -1;
+}
+
+int prevSlot(ArtNode* node, int before) {
+    // Largest occupied slot below before, -1 if there is none
+    int to = before - 1;
+    if (to < 0) return -1;
+    switch (node->type) {
+        case NodeType48: {
+            Node48* n = static_cast<Node48*>(node);
+            for (int chunk = to & ~15; chunk >= 0; chunk -= 16) {
+                __m128i index = _mm_loadu_si128(
+                    reinterpret_cast<__m128i*>(n->childIndex + chunk));
+                unsigned used = ~_mm_movemask_epi8(_mm_cmpeq_epi8(
+                                    index, _mm_set1_epi8(emptyMarker))) &
+                                0xFFFF;
+                if (chunk + 15 > to) used &= 0xFFFF >> (chunk + 15 - to);
+                if (used) return chunk + 31 - __builtin_clz(used);
+            }
+            return -1;
+        }
+        case NodeType256: {
+            Node256* n = static_cast<Node256*>(node);
+            const int width = sizeof(NodeRef), perChunk = 16 / width;
+            const char* bytes = reinterpret_cast<const char*>(n->child);
+            for (int chunk = to - to % perChunk; chunk >= 0;
+                 chunk -= perChunk) {
+                __m128i children = _mm_loadu_si128(
+                    reinterpret_cast<const __m128i*>(bytes + chunk * width));
+                unsigned used = ~_mm_movemask_epi8(_mm_cmpeq_epi8(
+                                    children, _mm_setzero_si128())) &
+                                0xFFFF;
+                if (chunk + perChunk - 1 > to)
+                    used &= 0xFFFF >> (chunk + perChunk - 1 - to) * width;
+                if (used) return chunk + (31 - __builtin_clz(used)) / width;
+            }
+            return -1;
+        }
+        case NodeTypeBitmap:
+            return static_cast<NodeBitmap*>(node)->prevSet(std::min(to, 255));
+    }
+    return std::min(to, int(node->count) - 1);
+}
+
+int lowerSlot(ArtNode* node, uint8_t keyByte) {
+    // Smallest occupied slot of an inner node whose key byte is not below
+    // keyByte, -1 if there is none
+    switch (node->type) {
+        case NodeType4: {
+            Node4* n = static_cast<Node4*>(node);
+            for (unsigned i = 0; i < n->count; i++)
+                if (n->key[i] >= keyByte) return i;
+            return -1;
+        }
+        case NodeType8: {
+            Node8* n = static_cast<Node8*>(node);
+            for (unsigned i = 0; i < n->count; i++)
+                if (n->key[i] >= keyByte) return i;
+            return -1;
+        }
+        case NodeType16: {
+            // SIMD: the keys below keyByte are a prefix of the sorted keys,
+            // their number is the slot
+            Node16* n = static_cast<Node16*>(node);
+            __m128i less = _mm_cmplt_epi8(
+                _mm_loadu_si128(reinterpret_cast<__m128i*>(n->key)),
+                _mm_set1_epi8(flipSign(keyByte)));
+            unsigned below = __builtin_popcount(_mm_movemask_epi8(less) &
+                                                ((1 << n->count) - 1));
+            return below < n->count ? int(below) : -1;
+        }
+        case NodeType32: {
+            Node32* n = static_cast<Node32*>(node);
+            if (keyByte == 0) return n->count ? 0 : -1;
+            uint32_t bitfield = n->greaterMask(keyByte - 1);
+            return bitfield ? __builtin_ctz(bitfield) : -1;
+        }
+    }
+    return nextSlot(node, int(keyByte) - 1);
+}
+
+uint8_t slotKey(ArtNode* node, int slot) {
+    // The key byte of a slot of an inner node
+    switch (node->type) {
+        case NodeType4:
+            return static_cast<Node4*>(node)->key[slot];
+        case NodeType8:
+            return static_cast<Node8*>(node)->key[slot];
+        case NodeType16:
+            return flipSign(static_cast<Node16*>(node)->key[slot]);
+        case NodeType32:
+            return flipSign(static_cast<Node32*>(node)->key[slot]);
+    }
+    return slot;
+}
+
+ArtNode* slotChild(ArtNode* node, int slot) {
+    // The child in a slot, a leaf rebuilt from its bit in a bitmap node
+    switch (node->type) {
+        case NodeType4:
+            return static_cast<Node4*>(node)->child[slot];
+        case NodeType8:
+            return static_cast<Node8*>(node)->child[slot];
+        case NodeType16:
+            return static_cast<Node16*>(node)->child[slot];
+        case NodeType32:
+            return static_cast<Node32*>(node)->child[slot];
+        case NodeType48: {
+            Node48* n = static_cast<Node48*>(node);
+            return n->child[n->childIndex[slot]];
+        }
+        case NodeType256:
+            return static_cast<Node256*>(node)->child[slot];
+        case NodeTypeBitmap:
+            return static_cast<NodeBitmap*>(node)->leaf(slot);
+        case NodeTypeBucket:
+            return static_cast<NodeBucket*>(node)->child[slot];
     }
     throw;  // Unreachable
 }
 
+#ifdef ART_ORDER_STATISTICS
+uint64_t subtreeSize(ArtNode* node) {
+    // Number of keys below a node, read from the node without a descent
+    if (node == NULL) return 0;
+    if (isLeaf(node)) return 1;
+    switch (node->type) {
+        case NodeTypeInterval: {
+            NodeInterval* interval = static_cast<NodeInterval*>(node);
+            return interval->hi - interval->lo + 1;
+        }
+        case NodeTypeBitmap:
+        case NodeTypeBucket:
+            return node->count;
+    }
+    return node->leaves;
+}
+#endif
+
 bool leafMatches(ArtNode* leaf, uint8_t key[], unsigned keyLength,
                  unsigned depth, unsigned maxKeyLength) {
     // Check if the key of the leaf is equal to the searched key
+    if (maxKeyLength == variableKeyLength &&
+        leafRecord(leaf)->key != keyLength)
+        return false;
     if (depth != keyLength) {
-        uint8_t leafKey[maxKeyLength];
-        loadKey(getLeafValue(leaf), leafKey);
+        uint8_t buffer[maxKeyWidth];
+        const uint8_t* leafBytes = leafKey(leaf, buffer, maxKeyLength);
         for (unsigned i = depth; i < keyLength; i++)
-            if (leafKey[i] != key[i]) return false;
+            if (leafBytes[i] != key[i]) return false;
     }
     return true;
 }
@@ -565,8 +1749,10 @@ unsigned prefixMismatch(ArtNode* node, uint8_t key[], unsigned depth,
     if (node->prefixLength > maxPrefixLength) {
         for (pos = 0; pos < maxPrefixLength; pos++)
             if (key[depth + pos] != node->prefix[pos]) return pos;
-        uint8_t minKey[maxKeyLength];
-        loadKey(getLeafValue(minimum(node)), minKey);
+        // A variable-length key ends with a byte that no prefix has, so the
+        // comparison stops before it runs past the key
+        uint8_t buffer[maxKeyWidth];
+        const uint8_t* minKey = leafKey(minimum(node), buffer, maxKeyLength);
         for (; pos < node->prefixLength; pos++)
             if (key[depth + pos] != minKey[depth + pos]) return pos;
     } else {
@@ -576,6 +1762,16 @@ unsigned prefixMismatch(ArtNode* node, uint8_t key[], unsigned depth,
     return pos;
 }
 
+ArtNode* lookupTerminal(ArtNode* node, uint8_t key[], unsigned keyLength) {
+    // Find the leaf of a full key in an interval or bucket node
+    uintptr_t value = keyValue(key, keyLength);
+    if (node->type == NodeTypeBucket)
+        return static_cast<NodeBucket*>(node)->find(value);
+    if (static_cast<NodeInterval*>(node)->contains(value))
+        return makeLeaf(value);
+    return NULL;
+}
+
 ArtNode* lookupPessimistic(ArtNode* node, uint8_t key[], unsigned keyLength,
                            unsigned depth, unsigned maxKeyLength) {
     // Find the node with a matching key, alternative pessimistic version
@@ -587,6 +1783,8 @@ ArtNode* lookupPessimistic(ArtNode* node, uint8_t key[], unsigned keyLength,
             return NULL;
         }
 
+        if (isTerminal(node)) return lookupTerminal(node, key, keyLength);
+
         if (prefixMismatch(node, key, depth, maxKeyLength) !=
             node->prefixLength)
             return NULL;
@@ -600,7 +1798,7 @@ ArtNode* lookupPessimistic(ArtNode* node, uint8_t key[], unsigned keyLength,
     return NULL;
 }
 
-void printFpPath(std::array<ArtNode*, maxPrefixLength> path,
+void printFpPath(std::array<ArtNode*, maxKeyWidth> path,
                  size_t path_length) {
     // Print the fp path for debugging
     for (size_t i = 0; i < path_length; i++) {
@@ -611,15 +1809,30 @@ void printFpPath(std::array<ArtNode*, maxPrefixLength> path,
                 case NodeType4:
                     printf("Node4 %p\n", path[i]);
                     break;
+                case NodeType8:
+                    printf("Node8 %p\n", path[i]);
+                    break;
                 case NodeType16:
                     printf("Node16 %p\n", path[i]);
                     break;
+                case NodeType32:
+                    printf("Node32 %p\n", path[i]);
+                    break;
                 case NodeType48:
                     printf("Node48 %p\n", path[i]);
                     break;
                 case NodeType256:
                     printf("Node256 %p\n", path[i]);
                     break;
+                case NodeTypeBitmap:
+                    printf("NodeBitmap %p\n", path[i]);
+                    break;
+                case NodeTypeInterval:
+                    printf("NodeInterval %p\n", path[i]);
+                    break;
+                case NodeTypeBucket:
+                    printf("NodeBucket %p\n", path[i]);
+                    break;
                 default:
                     printf("Unknown NodeType %p\n", path[i]);
                     break;
@@ -628,4 +1841,93 @@ void printFpPath(std::array<ArtNode*, maxPrefixLength> path,
     }
 }
 
+// Byte range of a member within its node, for the layout report
+template <class T, class M>
+std::pair<size_t, size_t> memberRange(const T& node, const M& member) {
+    size_t begin = reinterpret_cast<const char*>(&member) -
+                   reinterpret_cast<const char*>(&node);
+    return {begin, begin + sizeof(member)};
+}
+
+unsigned linesTouched(size_t end) {
+    // Number of cache lines covering the bytes [0, end) of a node
+    return (end + NodeAllocator::cacheLineSize - 1) /
+           NodeAllocator::cacheLineSize;
+}
+
+std::string byteRange(std::pair<size_t, size_t> range) {
+    // Format a byte range for the layout report, "-" if it is empty
+    if (range.first == range.second) return "-";
+    return std::to_string(range.first) + ".." + std::to_string(range.second);
+}
+
+void printNodeLayout(const char* name, size_t size,
+                     std::pair<size_t, size_t> header,
+                     std::pair<size_t, size_t> keys,
+                     std::pair<size_t, size_t> children, unsigned lines) {
+    printf("%-8s %6zu %6zu %8s %10s %10s %6u\n", name,
+           NodeAllocator::allocationSize(size),
+           NodeAllocator::alignmentFor(size), byteRange(header).c_str(),
+           byteRange(keys).c_str(), byteRange(children).c_str(), lines);
+}
+
+void printNodeLayouts() {
+    // Print the byte offsets of every node type and the number of cache
+    // lines findChild reads before it reaches the child pointer: the header
+    // and the key bytes it compares, or the childIndex byte of Node48
+    printf("%-8s %6s %6s %8s %10s %10s %6s\n", "node", "bytes", "align",
+           "header", "keys", "children", "lines");
+    Node4 node4;
+    auto header = std::make_pair(size_t(0),
+                                 memberRange(node4, node4.prefix).second);
+    auto keys4 = memberRange(node4, node4.key);
+    printNodeLayout("Node4", sizeof(Node4), header, keys4,
+                    memberRange(node4, node4.child),
+                    linesTouched(keys4.second));
+    // Node8 and Node32 are only allocated if they are on the growth ladder
+    Node8 node8;
+    auto keys8 = memberRange(node8, node8.key);
+    printNodeLayout("Node8", sizeof(Node8), header, keys8,
+                    memberRange(node8, node8.child),
+                    linesTouched(keys8.second));
+    Node16 node16;
+    auto keys16 = memberRange(node16, node16.key);
+    printNodeLayout("Node16", sizeof(Node16), header, keys16,
+                    memberRange(node16, node16.child),
+                    linesTouched(keys16.second));
+    Node32 node32;
+    auto keys32 = memberRange(node32, node32.key);
+    printNodeLayout("Node32", sizeof(Node32), header, keys32,
+                    memberRange(node32, node32.child),
+                    linesTouched(keys32.second));
+    // The header is in the first line, the index byte of the searched key
+    // may be in any of the lines covered by childIndex
+    Node48 node48;
+    auto keys48 = memberRange(node48, node48.childIndex);
+    printNodeLayout("Node48", sizeof(Node48), header, keys48,
+                    memberRange(node48, node48.child),
+                    linesTouched(keys48.second) > 1 ? 2 : 1);
+    Node256 node256;
+    printNodeLayout("Node256", sizeof(Node256), header, {0, 0},
+                    memberRange(node256, node256.child),
+                    linesTouched(header.second));
+    // Leaves of a NodeBitmap are rebuilt from base and the occupancy bits
+    NodeBitmap bitmap;
+    auto keysBitmap = memberRange(bitmap, bitmap.bits);
+    printNodeLayout("Bitmap", sizeof(NodeBitmap), header, keysBitmap,
+                    {0, 0}, linesTouched(keysBitmap.second));
+    // A lookup in a NodeInterval only compares the key against lo and hi
+    NodeInterval interval;
+    auto keysInterval =
+        std::make_pair(memberRange(interval, interval.lo).first,
+                       memberRange(interval, interval.hi).second);
+    printNodeLayout("Interval", sizeof(NodeInterval), header, keysInterval,
+                    {0, 0}, linesTouched(keysInterval.second));
+    // The smallest NodeBucket, a lookup binary searches its leaves
+    size_t bucketSize = NodeBucket::sizeFor(NodeBucket::capacityFor(1));
+    auto leavesBucket = std::make_pair(sizeof(NodeBucket), bucketSize);
+    printNodeLayout("Bucket", bucketSize, header, {0, 0}, leavesBucket,
+                    linesTouched(leavesBucket.second));
+}
+
 }  // namespace ART
\ No newline at end of file
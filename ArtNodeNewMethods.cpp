@@ -6,10 +6,79 @@
  */
 
 namespace ART {
+// Put a grown node in place of node on the temporary path of a tail insert.
+// If node is on the fast path and the new value does not become fp_leaf, the
+// remainder of the fast path below node is kept
+void tailReplaceGrown(ART* tree, ArtNode* node, ArtNode* newNode,
+                      ArtNode* child,
+                      std::array<ArtNode*, maxKeyWidth>& temp_fp_path,
+                      size_t temp_fp_path_length) {
+    // The sizes of temp_fp_path and fp_path before operations
+    int temp_fp_path_length_old = temp_fp_path_length;
+    int fp_path_length_old = tree->fp_path_length;
+    // If the changing node is on the fp_path
+    if (temp_fp_path_length_old <= fp_path_length_old &&
+        tree->fp_path[temp_fp_path_length_old - 1] == node) {
+        // Change the node to the newNode which has a greater capacity
+        temp_fp_path[temp_fp_path_length_old - 1] = newNode;
+        // If the new value doesn't create a new fp_leaf, restore the
+        // remaining part of the fp_path
+        if (getLeafValue(child) < getLeafValue(tree->fp_leaf)) {
+            // create a deep copy of remainder of fp_path here
+            std::array<ArtNode*, maxKeyWidth> fp_path_remainder;
+            std::copy(tree->fp_path.begin() + temp_fp_path_length_old,
+                      tree->fp_path.end(), fp_path_remainder.begin());
+            tree->fp_path = temp_fp_path;  // update fp_path
+            tree->fp_path_length =
+                temp_fp_path_length_old;  // update fp_path size
+            // Add the remaining part of the fp_path
+            for (int i = 0; i < fp_path_length_old - temp_fp_path_length_old;
+                 i++) {
+                tree->fp_path[i + temp_fp_path_length_old] =
+                    fp_path_remainder[i];
+                tree->fp_path_length++;
+            }
+            tree->fp = tree->fp_path[tree->fp_path_length - 1];
+        }
+    }
+}
+
+// Inserting into a node with sorted children shifts the cells after the new
+// key, fp_ref follows if it pointed into node
+void preserveFpShifted(ART* tree, ArtNode* node) {
+    if (tree->fp_path_length >= 2 &&
+        tree->fp_path[tree->fp_path_length - 2] == node) {
+        NodeRef* fpRef = childRef(node, tree->fp);
+        if (fpRef) tree->fp_ref = fpRef;
+    }
+}
+
+// Put a grown node in place of node on the fast path of an insert that does
+// not change fp_leaf, fp_ref follows if it pointed into node
+void preserveFpReplaceGrown(ART* tree, NodeRef* nodeRef, ArtNode* node,
+                            ArtNode* newNode) {
+    // If the changing node is the fast path node
+    if (tree->fp == node) {
+        // Adjust fp information
+        tree->fp = newNode;
+        tree->fp_path[tree->fp_path_length - 1] = newNode;
+        tree->fp_ref = nodeRef;
+    }
+    // If the changing node hosts the cell fp_ref points to
+    else if (tree->fp_path_length >= 2 &&
+             tree->fp_path[tree->fp_path_length - 2] == node) {
+        tree->fp_path[tree->fp_path_length - 2] = newNode;
+        // Find the cell that points to the fast path node and update the
+        // fp_ref to point to the cell
+        NodeRef* fpRef = childRef(newNode, tree->fp);
+        if (fpRef) tree->fp_ref = fpRef;
+    }
+}
+
 // fp insert method for Node4
-void Node4::tailInsertNode4(ART* tree, ArtNode** nodeRef, uint8_t keyByte,
+void Node4::tailInsertNode4(ART* tree, NodeRef* nodeRef, uint8_t keyByte,
                             ArtNode* child,
-                            std::array<ArtNode*, maxPrefixLength>& temp_fp_path,
+                            std::array<ArtNode*, maxKeyWidth>& temp_fp_path,
                             size_t& temp_fp_path_length, size_t depth_prev) {
     // Insert leaf into inner node
     if (this->count < 4) {
@@ -21,9 +90,12 @@ void Node4::tailInsertNode4(ART* tree, ArtNode** nodeRef, uint8_t keyByte,
         // key/child. This preserves the sorted order of keys in the node.
         memmove(this->key + pos + 1, this->key + pos, this->count - pos);
         memmove(this->child + pos + 1, this->child + pos,
-                (this->count - pos) * sizeof(uintptr_t));
+                (this->count - pos) * sizeof(NodeRef));
         this->key[pos] = keyByte;
         this->child[pos] = child;
+        this->count++;
+        // The cells after keyByte moved, fp_ref follows
+        preserveFpShifted(tree, this);
 
         // If what's being inserted is a leaf
         if (isLeaf(child)) {
@@ -39,58 +111,22 @@ void Node4::tailInsertNode4(ART* tree, ArtNode** nodeRef, uint8_t keyByte,
                 tree->fp_ref = nodeRef;
             }
         }
-
-        this->count++;
     } else {
-        // Grow to Node16
-        Node16* newNode = new Node16();
+        // Grow to Node8 or Node16
+        ArtNode* newNode = growNode(tree, this);
         *nodeRef = newNode;
-        newNode->count = 4;
-        copyPrefix(this, newNode);
-        for (unsigned i = 0; i < 4; i++)
-            newNode->key[i] = flipSign(this->key[i]);
-        memcpy(newNode->child, this->child, this->count * sizeof(uintptr_t));
-
-        // The sizes of temp_fp_path and fp_path before operations
-        int temp_fp_path_length_old = temp_fp_path_length;
-        int fp_path_length_old = tree->fp_path_length;
-        // If the changing node is on the fp_path
-        if (temp_fp_path_length_old <= fp_path_length_old &&
-            tree->fp_path[temp_fp_path_length_old - 1] == this) {
-            // Change the node to the newNode which has a greater capacity
-            temp_fp_path[temp_fp_path_length_old - 1] = newNode;
-            // If the new value doesn't create a new fp_leaf, restore the
-            // remaining part of the fp_path
-            if (getLeafValue(child) < getLeafValue(tree->fp_leaf)) {
-                // create a deep copy of remainder of fp_path here
-                std::array<ArtNode*, maxPrefixLength> fp_path_remainder;
-                std::copy(tree->fp_path.begin() + temp_fp_path_length_old,
-                          tree->fp_path.end(), fp_path_remainder.begin());
-                tree->fp_path = temp_fp_path;  // update fp_path
-                tree->fp_path_length =
-                    temp_fp_path_length_old;  // update fp_path size
-                // Add the remaining part of the fp_path
-                for (int i = 0;
-                     i < fp_path_length_old - temp_fp_path_length_old; i++) {
-                    tree->fp_path[i + temp_fp_path_length_old] =
-                        fp_path_remainder[i];
-                    tree->fp_path_length++;
-                }
-                tree->fp = tree->fp_path[tree->fp_path_length - 1];
-            }
-        }
-
-        delete this;
-        return newNode->tailInsertNode16(tree, nodeRef, keyByte, child,
-                                         temp_fp_path, temp_fp_path_length,
-                                         depth_prev);
+        tailReplaceGrown(tree, this, newNode, child, temp_fp_path,
+                         temp_fp_path_length);
+        freeNode(tree, this);
+        return tailInsertChild(tree, nodeRef, newNode, keyByte, child,
+                               temp_fp_path, temp_fp_path_length, depth_prev);
     }
 }
 
 // fp insert method for Node16
 void Node16::tailInsertNode16(
-    ART* tree, ArtNode** nodeRef, uint8_t keyByte, ArtNode* child,
-    std::array<ArtNode*, maxPrefixLength>& temp_fp_path,
+    ART* tree, NodeRef* nodeRef, uint8_t keyByte, ArtNode* child,
+    std::array<ArtNode*, maxKeyWidth>& temp_fp_path,
     size_t& temp_fp_path_length, size_t depth_prev) {
     // Insert leaf into inner node
     if (this->count < 16) {
@@ -121,10 +157,12 @@ void Node16::tailInsertNode16(
         // key/child. This preserves the sorted order of keys in the node.
         memmove(this->key + pos + 1, this->key + pos, this->count - pos);
         memmove(this->child + pos + 1, this->child + pos,
-                (this->count - pos) * sizeof(uintptr_t));
+                (this->count - pos) * sizeof(NodeRef));
         this->key[pos] = keyByteFlipped;
         this->child[pos] = child;
         this->count++;
+        // The cells after keyByte moved, fp_ref follows
+        preserveFpShifted(tree, this);
 
         // If what's being inserted is a leaf
         if (isLeaf(child)) {
@@ -140,56 +178,21 @@ void Node16::tailInsertNode16(
             }
         }
     } else {
-        // Grow to Node48
-        Node48* newNode = new Node48();
+        // Grow to Node32 or Node48
+        ArtNode* newNode = growNode(tree, this);
         *nodeRef = newNode;
-        memcpy(newNode->child, this->child, this->count * sizeof(uintptr_t));
-        for (unsigned i = 0; i < this->count; i++)
-            newNode->childIndex[flipSign(this->key[i])] = i;
-        copyPrefix(this, newNode);
-        newNode->count = this->count;
-
-        // The sizes of temp_fp_path and fp_path before operations
-        int temp_fp_path_length_old = temp_fp_path_length;
-        int fp_path_length_old = tree->fp_path_length;
-        // If the changing node is on the fp_path
-        if (temp_fp_path_length_old <= fp_path_length_old &&
-            tree->fp_path[temp_fp_path_length_old - 1] == this) {
-            // Change the node to the newNode which has a greater capacity
-            temp_fp_path[temp_fp_path_length_old - 1] = newNode;
-            // If the new value doesn't create a new fp_leaf, restore the
-            // remaining part of the fp_path
-            if (getLeafValue(child) < getLeafValue(tree->fp_leaf)) {
-                // create a deep copy of remainder of fp_path here
-                std::array<ArtNode*, maxPrefixLength> fp_path_remainder;
-                std::copy(tree->fp_path.begin() + temp_fp_path_length_old,
-                          tree->fp_path.end(), fp_path_remainder.begin());
-                tree->fp_path = temp_fp_path;  // update fp_path
-                tree->fp_path_length =
-                    temp_fp_path_length_old;  // update fp_path size
-                // Add the remaining part of the fp_path
-                for (int i = 0;
-                     i < fp_path_length_old - temp_fp_path_length_old; i++) {
-                    tree->fp_path[i + temp_fp_path_length_old] =
-                        fp_path_remainder[i];
-                    tree->fp_path_length++;
-                }
-                tree->fp = tree->fp_path[tree->fp_path_length -
-                                         1];  // update the fp pointer
-            }
-        }
-
-        delete this;
-        return newNode->tailInsertNode48(tree, nodeRef, keyByte, child,
-                                         temp_fp_path, temp_fp_path_length,
-                                         depth_prev);
+        tailReplaceGrown(tree, this, newNode, child, temp_fp_path,
+                         temp_fp_path_length);
+        freeNode(tree, this);
+        return tailInsertChild(tree, nodeRef, newNode, keyByte, child,
+                               temp_fp_path, temp_fp_path_length, depth_prev);
     }
 }
 
 // fp insert method for Node48
 void Node48::tailInsertNode48(
-    ART* tree, ArtNode** nodeRef, uint8_t keyByte, ArtNode* child,
-    std::array<ArtNode*, maxPrefixLength>& temp_fp_path,
+    ART* tree, NodeRef* nodeRef, uint8_t keyByte, ArtNode* child,
+    std::array<ArtNode*, maxKeyWidth>& temp_fp_path,
     size_t& temp_fp_path_length, size_t depth_prev) {
     // Insert leaf into inner node
     if (this->count < 48) {
@@ -221,7 +224,7 @@ void Node48::tailInsertNode48(
 
     } else {
         // Grow to Node256
-        Node256* newNode = new Node256();
+        Node256* newNode = allocNode<Node256>(tree);
         for (unsigned i = 0; i < 256; i++)
             if (this->childIndex[i] != 48)
                 newNode->child[i] = this->child[this->childIndex[i]];
@@ -241,7 +244,7 @@ void Node48::tailInsertNode48(
             // remaining part of the fp_path
             if (getLeafValue(child) < getLeafValue(tree->fp_leaf)) {
                 // create a deep copy of remainder of fp_path here
-                std::array<ArtNode*, maxPrefixLength> fp_path_remainder;
+                std::array<ArtNode*, maxKeyWidth> fp_path_remainder;
                 std::copy(tree->fp_path.begin() + temp_fp_path_length_old,
                           tree->fp_path.end(), fp_path_remainder.begin());
                 tree->fp_path = temp_fp_path;  // update fp_path
@@ -259,7 +262,7 @@ void Node48::tailInsertNode48(
             }
         }
 
-        delete this;
+        freeNode(tree, this);
         return newNode->tailInsertNode256(tree, nodeRef, keyByte, child,
                                           temp_fp_path, temp_fp_path_length,
                                           depth_prev);
@@ -268,8 +271,8 @@ void Node48::tailInsertNode48(
 
 // fp insert method for Node256
 void Node256::tailInsertNode256(
-    ART* tree, ArtNode** nodeRef, uint8_t keyByte, ArtNode* child,
-    std::array<ArtNode*, maxPrefixLength>& temp_fp_path,
+    ART* tree, NodeRef* nodeRef, uint8_t keyByte, ArtNode* child,
+    std::array<ArtNode*, maxKeyWidth>& temp_fp_path,
     size_t& temp_fp_path_length, size_t depth_prev) {
     // Insert leaf into inner node
     // No memmove needed here because Node256 uses a direct mapping for all
@@ -293,7 +296,31 @@ void Node256::tailInsertNode256(
     }
 }
 
-void Node4::lilInsertNode4(ART* tree, ArtNode** nodeRef, uint8_t keyByte,
+// fp insert method for NodeBitmap
+void NodeBitmap::tailInsertBitmap(
+    ART* tree, NodeRef* nodeRef, uint8_t keyByte,
+    std::array<ArtNode*, maxKeyWidth>& temp_fp_path,
+    size_t& temp_fp_path_length, size_t depth_prev) {
+    // Insert leaf into inner node by setting its bit. A full node collapses
+    // into an interval, which then takes its place on the path
+    ArtNode* child = this->leaf(keyByte);
+    this->insertBitmap(tree, nodeRef, keyByte);
+    if (*nodeRef != this && temp_fp_path[temp_fp_path_length - 1] == this)
+        temp_fp_path[temp_fp_path_length - 1] = *nodeRef;
+
+    // If the new value is greater than or equal to the current fp_leaf,
+    // update the fp_leaf, fp and fp_path
+    if (getLeafValue(child) >= getLeafValue(tree->fp_leaf)) {
+        tree->fp_leaf = child;
+        tree->fp = temp_fp_path[temp_fp_path_length - 1];
+        tree->fp_path = temp_fp_path;
+        tree->fp_path_length = temp_fp_path_length;
+        tree->fp_depth = depth_prev;
+        tree->fp_ref = nodeRef;
+    }
+}
+
+void Node4::lilInsertNode4(ART* tree, NodeRef* nodeRef, uint8_t keyByte,
                            ArtNode* child) {
     // Insert leaf into inner node
     if (this->count < 4) {
@@ -303,13 +330,13 @@ void Node4::lilInsertNode4(ART* tree, ArtNode** nodeRef, uint8_t keyByte,
             ;
         memmove(this->key + pos + 1, this->key + pos, this->count - pos);
         memmove(this->child + pos + 1, this->child + pos,
-                (this->count - pos) * sizeof(uintptr_t));
+                (this->count - pos) * sizeof(NodeRef));
         this->key[pos] = keyByte;
         this->child[pos] = child;
         this->count++;
     } else {
-        // Grow to Node16
-        Node16* newNode = new Node16();
+        // Grow to Node8 or Node16
+        ArtNode* newNode = growNode(tree, this);
         *nodeRef = newNode;
 
         // update fast path
@@ -317,17 +344,12 @@ void Node4::lilInsertNode4(ART* tree, ArtNode** nodeRef, uint8_t keyByte,
         tree->fp_path[tree->fp_path_length - 1] = newNode;
         tree->fp_path_ref[tree->fp_path_length - 1] = nodeRef;
 
-        newNode->count = 4;
-        copyPrefix(this, newNode);
-        for (unsigned i = 0; i < 4; i++)
-            newNode->key[i] = flipSign(this->key[i]);
-        memcpy(newNode->child, this->child, this->count * sizeof(uintptr_t));
-        delete this;
-        return newNode->lilInsertNode16(tree, nodeRef, keyByte, child);
+        freeNode(tree, this);
+        return lilInsertChild(tree, nodeRef, newNode, keyByte, child);
     }
 }
 
-void Node16::lilInsertNode16(ART* tree, ArtNode** nodeRef, uint8_t keyByte,
+void Node16::lilInsertNode16(ART* tree, NodeRef* nodeRef, uint8_t keyByte,
                              ArtNode* child) {
     // Insert leaf into inner node
     if (this->count < 16) {
@@ -341,13 +363,13 @@ void Node16::lilInsertNode16(ART* tree, ArtNode** nodeRef, uint8_t keyByte,
         unsigned pos = bitfield ? ctz(bitfield) : this->count;
         memmove(this->key + pos + 1, this->key + pos, this->count - pos);
         memmove(this->child + pos + 1, this->child + pos,
-                (this->count - pos) * sizeof(uintptr_t));
+                (this->count - pos) * sizeof(NodeRef));
         this->key[pos] = keyByteFlipped;
         this->child[pos] = child;
         this->count++;
     } else {
-        // Grow to Node48
-        Node48* newNode = new Node48();
+        // Grow to Node32 or Node48
+        ArtNode* newNode = growNode(tree, this);
         *nodeRef = newNode;
 
         // update fast path
@@ -355,17 +377,12 @@ void Node16::lilInsertNode16(ART* tree, ArtNode** nodeRef, uint8_t keyByte,
         tree->fp_path[tree->fp_path_length - 1] = newNode;
         tree->fp_path_ref[tree->fp_path_length - 1] = nodeRef;
 
-        memcpy(newNode->child, this->child, this->count * sizeof(uintptr_t));
-        for (unsigned i = 0; i < this->count; i++)
-            newNode->childIndex[flipSign(this->key[i])] = i;
-        copyPrefix(this, newNode);
-        newNode->count = this->count;
-        delete this;
-        return newNode->lilInsertNode48(tree, nodeRef, keyByte, child);
+        freeNode(tree, this);
+        return lilInsertChild(tree, nodeRef, newNode, keyByte, child);
     }
 }
 
-void Node48::lilInsertNode48(ART* tree, ArtNode** nodeRef, uint8_t keyByte,
+void Node48::lilInsertNode48(ART* tree, NodeRef* nodeRef, uint8_t keyByte,
                              ArtNode* child) {
     // Insert leaf into inner node
     if (this->count < 48) {
@@ -379,7 +396,7 @@ void Node48::lilInsertNode48(ART* tree, ArtNode** nodeRef, uint8_t keyByte,
         this->count++;
     } else {
         // Grow to Node256
-        Node256* newNode = new Node256();
+        Node256* newNode = allocNode<Node256>(tree);
         for (unsigned i = 0; i < 256; i++)
             if (this->childIndex[i] != 48)
                 newNode->child[i] = this->child[this->childIndex[i]];
@@ -392,14 +409,14 @@ void Node48::lilInsertNode48(ART* tree, ArtNode** nodeRef, uint8_t keyByte,
         tree->fp_path[tree->fp_path_length - 1] = newNode;
         tree->fp_path_ref[tree->fp_path_length - 1] = nodeRef;
 
-        delete this;
+        freeNode(tree, this);
         return newNode->lilInsertNode256(tree, nodeRef, keyByte, child);
     }
 }
 
 // suppress warnings about unused parameters to ensure consistency
 void Node256::lilInsertNode256(ART* tree [[maybe_unused]],
-                               ArtNode** nodeRef [[maybe_unused]],
+                               NodeRef* nodeRef [[maybe_unused]],
                                uint8_t keyByte, ArtNode* child) {
     // Insert leaf into inner node
     this->count++;
@@ -407,7 +424,7 @@ void Node256::lilInsertNode256(ART* tree [[maybe_unused]],
 }
 
 // fp insert method for Node4 that changes fp_leaf
-void Node4::stailInsertNode4ChangeFp(ART* tree, ArtNode** nodeRef,
+void Node4::stailInsertNode4ChangeFp(ART* tree, NodeRef* nodeRef,
                                      uint8_t keyByte, ArtNode* child) {
     // Insert leaf into inner node
     if (this->count < 4) {
@@ -417,7 +434,7 @@ void Node4::stailInsertNode4ChangeFp(ART* tree, ArtNode** nodeRef,
             ;
         memmove(this->key + pos + 1, this->key + pos, this->count - pos);
         memmove(this->child + pos + 1, this->child + pos,
-                (this->count - pos) * sizeof(uintptr_t));
+                (this->count - pos) * sizeof(NodeRef));
         this->key[pos] = keyByte;
         this->child[pos] = child;
 
@@ -428,26 +445,20 @@ void Node4::stailInsertNode4ChangeFp(ART* tree, ArtNode** nodeRef,
 
         this->count++;
     } else {
-        // Grow to Node16
-        Node16* newNode = new Node16();
+        // Grow to Node8 or Node16
+        ArtNode* newNode = growNode(tree, this);
         *nodeRef = newNode;
-        newNode->count = 4;
-        copyPrefix(this, newNode);
-        for (unsigned i = 0; i < 4; i++)
-            newNode->key[i] = flipSign(this->key[i]);
-        memcpy(newNode->child, this->child, this->count * sizeof(uintptr_t));
 
         // Add the newNode to the fast path
         tree->fp_path[tree->fp_path_length - 1] = newNode;
 
-        delete this;
-        return newNode->stailInsertNode16ChangeFp(tree, nodeRef, keyByte,
-                                                  child);
+        freeNode(tree, this);
+        return stailInsertChildChangeFp(tree, nodeRef, newNode, keyByte, child);
     }
 }
 
 // fp insert method for Node16 that changes fp_leaf
-void Node16::stailInsertNode16ChangeFp(ART* tree, ArtNode** nodeRef,
+void Node16::stailInsertNode16ChangeFp(ART* tree, NodeRef* nodeRef,
                                        uint8_t keyByte, ArtNode* child) {
     // Insert leaf into inner node
     if (this->count < 16) {
@@ -461,7 +472,7 @@ void Node16::stailInsertNode16ChangeFp(ART* tree, ArtNode** nodeRef,
         unsigned pos = bitfield ? ctz(bitfield) : this->count;
         memmove(this->key + pos + 1, this->key + pos, this->count - pos);
         memmove(this->child + pos + 1, this->child + pos,
-                (this->count - pos) * sizeof(uintptr_t));
+                (this->count - pos) * sizeof(NodeRef));
 
         this->key[pos] = keyByteFlipped;
         this->child[pos] = child;
@@ -473,26 +484,20 @@ void Node16::stailInsertNode16ChangeFp(ART* tree, ArtNode** nodeRef,
 
         this->count++;
     } else {
-        // Grow to Node48
-        Node48* newNode = new Node48();
+        // Grow to Node32 or Node48
+        ArtNode* newNode = growNode(tree, this);
         *nodeRef = newNode;
-        memcpy(newNode->child, this->child, this->count * sizeof(uintptr_t));
-        for (unsigned i = 0; i < this->count; i++)
-            newNode->childIndex[flipSign(this->key[i])] = i;
-        copyPrefix(this, newNode);
-        newNode->count = this->count;
 
         // Add the newNode to the fast path
         tree->fp_path[tree->fp_path_length - 1] = newNode;
 
-        delete this;
-        return newNode->stailInsertNode48ChangeFp(tree, nodeRef, keyByte,
-                                                  child);
+        freeNode(tree, this);
+        return stailInsertChildChangeFp(tree, nodeRef, newNode, keyByte, child);
     }
 }
 
 // fp insert method for Node48 that changes fp_leaf
-void Node48::stailInsertNode48ChangeFp(ART* tree, ArtNode** nodeRef,
+void Node48::stailInsertNode48ChangeFp(ART* tree, NodeRef* nodeRef,
                                        uint8_t keyByte, ArtNode* child) {
     // Insert leaf into inner node
     if (this->count < 48) {
@@ -512,7 +517,7 @@ void Node48::stailInsertNode48ChangeFp(ART* tree, ArtNode** nodeRef,
 
     } else {
         // Grow to Node256
-        Node256* newNode = new Node256();
+        Node256* newNode = allocNode<Node256>(tree);
         for (unsigned i = 0; i < 256; i++)
             if (this->childIndex[i] != 48)
                 newNode->child[i] = this->child[this->childIndex[i]];
@@ -523,14 +528,14 @@ void Node48::stailInsertNode48ChangeFp(ART* tree, ArtNode** nodeRef,
         // Add the newNode to the fast path
         tree->fp_path[tree->fp_path_length - 1] = newNode;
 
-        delete this;
+        freeNode(tree, this);
         return newNode->stailInsertNode256ChangeFp(tree, nodeRef, keyByte,
                                                    child);
     }
 }
 
 // fp insert method for Node256 that changes fp_leaf
-void Node256::stailInsertNode256ChangeFp(ART* tree, ArtNode** nodeRef,
+void Node256::stailInsertNode256ChangeFp(ART* tree, NodeRef* nodeRef,
                                          uint8_t keyByte, ArtNode* child) {
     // Insert leaf into inner node
     this->count++;
@@ -542,10 +547,24 @@ void Node256::stailInsertNode256ChangeFp(ART* tree, ArtNode** nodeRef,
     tree->fp_ref = nodeRef;
 }
 
+// fp insert method for NodeBitmap that changes fp_leaf
+void NodeBitmap::stailInsertBitmapChangeFp(ART* tree, NodeRef* nodeRef,
+                                           uint8_t keyByte) {
+    // Insert leaf into inner node by setting its bit, a full node collapses
+    // into an interval in its place
+    ArtNode* child = this->leaf(keyByte);
+    this->insertBitmap(tree, nodeRef, keyByte);
+
+    // Update fp parameters
+    tree->fp_leaf = child;
+    tree->fp = *nodeRef;
+    tree->fp_ref = nodeRef;
+}
+
 // fp insert method for Node4 that correctly tracks fp_ref in a
 // very special case of prefix expansion
 void Node4::stailInsertNode4PreserveFpPrefixExpansion(ART* tree,
-                                                      ArtNode** nodeRef,
+                                                      NodeRef* nodeRef,
                                                       uint8_t keyByte,
                                                       ArtNode* child) {
     // Insert element
@@ -554,7 +573,7 @@ void Node4::stailInsertNode4PreserveFpPrefixExpansion(ART* tree,
         ;
     memmove(this->key + pos + 1, this->key + pos, this->count - pos);
     memmove(this->child + pos + 1, this->child + pos,
-            (this->count - pos) * sizeof(uintptr_t));
+            (this->count - pos) * sizeof(NodeRef));
     this->key[pos] = keyByte;
     this->child[pos] = child;
     this->count++;
@@ -567,7 +586,7 @@ void Node4::stailInsertNode4PreserveFpPrefixExpansion(ART* tree,
 }
 
 // fp insert method for Node4 that does not change fp_leaf
-void Node4::stailInsertNode4PreserveFp(ART* tree, ArtNode** nodeRef,
+void Node4::stailInsertNode4PreserveFp(ART* tree, NodeRef* nodeRef,
                                        uint8_t keyByte, ArtNode* child) {
     // Insert leaf into inner node
     if (this->count < 4) {
@@ -577,49 +596,24 @@ void Node4::stailInsertNode4PreserveFp(ART* tree, ArtNode** nodeRef,
             ;
         memmove(this->key + pos + 1, this->key + pos, this->count - pos);
         memmove(this->child + pos + 1, this->child + pos,
-                (this->count - pos) * sizeof(uintptr_t));
+                (this->count - pos) * sizeof(NodeRef));
         this->key[pos] = keyByte;
         this->child[pos] = child;
         this->count++;
+        preserveFpShifted(tree, this);
     } else {
-        // Grow to Node16
-        Node16* newNode = new Node16();
+        // Grow to Node8 or Node16
+        ArtNode* newNode = growNode(tree, this);
         *nodeRef = newNode;
-        newNode->count = 4;
-        copyPrefix(this, newNode);
-        for (unsigned i = 0; i < 4; i++)
-            newNode->key[i] = flipSign(this->key[i]);
-        memcpy(newNode->child, this->child, this->count * sizeof(uintptr_t));
-
-        // If the changing node is the fast path node
-        if (tree->fp == this) {
-            // Adjust fp information
-            tree->fp = newNode;
-            tree->fp_path[tree->fp_path_length - 1] = newNode;
-            tree->fp_ref = nodeRef;
-        }
-        // If the changing node hosts the cell fp_ref points to
-        else if (tree->fp_path_length >= 2 && tree->fp_path[tree->fp_path_length - 2] == this) {
-            tree->fp_path[tree->fp_path_length - 2] = newNode;
-            // Find the cell that points to the fast path node
-            // and update the fp_ref to point to the cell
-            for (size_t i = 0; i < newNode->count; i++) {
-                if (newNode->child[i] == tree->fp) {
-                    tree->fp_ref = &newNode->child[i];
-                    break;
-                }
-            }
-        }
-
-        delete this;
-
-        return newNode->stailInsertNode16PreserveFp(tree, nodeRef, keyByte,
-                                                    child);
+        preserveFpReplaceGrown(tree, nodeRef, this, newNode);
+        freeNode(tree, this);
+        return stailInsertChildPreserveFp(tree, nodeRef, newNode, keyByte,
+                                          child);
     }
 }
 
 // fp insert method for Node16 that does not change fp_leaf
-void Node16::stailInsertNode16PreserveFp(ART* tree, ArtNode** nodeRef,
+void Node16::stailInsertNode16PreserveFp(ART* tree, NodeRef* nodeRef,
                                          uint8_t keyByte, ArtNode* child) {
     // Insert leaf into inner node
     if (this->count < 16) {
@@ -633,48 +627,23 @@ void Node16::stailInsertNode16PreserveFp(ART* tree, ArtNode** nodeRef,
         unsigned pos = bitfield ? ctz(bitfield) : this->count;
         memmove(this->key + pos + 1, this->key + pos, this->count - pos);
         memmove(this->child + pos + 1, this->child + pos,
-                (this->count - pos) * sizeof(uintptr_t));
+                (this->count - pos) * sizeof(NodeRef));
         this->key[pos] = keyByteFlipped;
         this->child[pos] = child;
         this->count++;
+        preserveFpShifted(tree, this);
     } else {
-        // Grow to Node48
-        Node48* newNode = new Node48();
+        // Grow to Node32 or Node48
+        ArtNode* newNode = growNode(tree, this);
         *nodeRef = newNode;
-
-        memcpy(newNode->child, this->child, this->count * sizeof(uintptr_t));
-        for (unsigned i = 0; i < this->count; i++)
-            newNode->childIndex[flipSign(this->key[i])] = i;
-        copyPrefix(this, newNode);
-        newNode->count = this->count;
-
-        // If the changing node is the fast path node
-        if (tree->fp == this) {
-            tree->fp = newNode;
-            tree->fp_path[tree->fp_path_length - 1] = newNode;
-            tree->fp_ref = nodeRef;
-        }
-        // If the changing node hosts the cell fp_ref points to
-        else if (tree->fp_path_length >= 2 && tree->fp_path[tree->fp_path_length - 2] == this) {
-            tree->fp_path[tree->fp_path_length - 2] = newNode;
-            // Find the cell that points to the fast path node
-            // and update the fp_ref to point to the cell
-            for (size_t i = 0; i < newNode->count; i++) {
-                if (newNode->child[i] == tree->fp) {
-                    tree->fp_ref = &newNode->child[i];
-                    break;
-                }
-            }
-        }
-
-        delete this;
-
-        return newNode->stailInsertNode48PreserveFp(tree, nodeRef, keyByte,
-                                                    child);
+        preserveFpReplaceGrown(tree, nodeRef, this, newNode);
+        freeNode(tree, this);
+        return stailInsertChildPreserveFp(tree, nodeRef, newNode, keyByte,
+                                          child);
     }
 }
 
-void Node48::stailInsertNode48PreserveFp(ART* tree, ArtNode** nodeRef,
+void Node48::stailInsertNode48PreserveFp(ART* tree, NodeRef* nodeRef,
                                          uint8_t keyByte, ArtNode* child) {
     // Insert leaf into inner node
     if (this->count < 48) {
@@ -688,7 +657,7 @@ void Node48::stailInsertNode48PreserveFp(ART* tree, ArtNode** nodeRef,
         this->count++;
     } else {
         // Grow to Node256
-        Node256* newNode = new Node256();
+        Node256* newNode = allocNode<Node256>(tree);
         for (unsigned i = 0; i < 256; i++)
             if (this->childIndex[i] != 48)
                 newNode->child[i] = this->child[this->childIndex[i]];
@@ -715,7 +684,7 @@ void Node48::stailInsertNode48PreserveFp(ART* tree, ArtNode** nodeRef,
             }
         }
 
-        delete this;
+        freeNode(tree, this);
 
         // There is no need for a stailInsertNode256PreserveFp method
         // because Node256 can't expand further
@@ -724,7 +693,7 @@ void Node48::stailInsertNode48PreserveFp(ART* tree, ArtNode** nodeRef,
 }
 
 // fp insert method for Node4 that changes fp_leaf
-void Node4::lilCanInsertNode4ChangeFp(ART* tree, ArtNode** nodeRef,
+void Node4::lilCanInsertNode4ChangeFp(ART* tree, NodeRef* nodeRef,
                                      uint8_t keyByte, ArtNode* child) {
     // Insert leaf into inner node
     if (this->count < 4) {
@@ -734,7 +703,7 @@ void Node4::lilCanInsertNode4ChangeFp(ART* tree, ArtNode** nodeRef,
             ;
         memmove(this->key + pos + 1, this->key + pos, this->count - pos);
         memmove(this->child + pos + 1, this->child + pos,
-                (this->count - pos) * sizeof(uintptr_t));
+                (this->count - pos) * sizeof(NodeRef));
         this->key[pos] = keyByte;
         this->child[pos] = child;
 
@@ -745,26 +714,21 @@ void Node4::lilCanInsertNode4ChangeFp(ART* tree, ArtNode** nodeRef,
 
         this->count++;
     } else {
-        // Grow to Node16
-        Node16* newNode = new Node16();
+        // Grow to Node8 or Node16
+        ArtNode* newNode = growNode(tree, this);
         *nodeRef = newNode;
-        newNode->count = 4;
-        copyPrefix(this, newNode);
-        for (unsigned i = 0; i < 4; i++)
-            newNode->key[i] = flipSign(this->key[i]);
-        memcpy(newNode->child, this->child, this->count * sizeof(uintptr_t));
 
         // Add the newNode to the fast path
         tree->fp_path[tree->fp_path_length - 1] = newNode;
 
-        delete this;
-        return newNode->lilCanInsertNode16ChangeFp(tree, nodeRef, keyByte,
-                                                  child);
+        freeNode(tree, this);
+        return lilCanInsertChildChangeFp(tree, nodeRef, newNode, keyByte,
+                                         child);
     }
 }
 
 // fp insert method for Node16 that changes fp_leaf
-void Node16::lilCanInsertNode16ChangeFp(ART* tree, ArtNode** nodeRef,
+void Node16::lilCanInsertNode16ChangeFp(ART* tree, NodeRef* nodeRef,
                                        uint8_t keyByte, ArtNode* child) {
     // Insert leaf into inner node
     if (this->count < 16) {
@@ -778,7 +742,7 @@ void Node16::lilCanInsertNode16ChangeFp(ART* tree, ArtNode** nodeRef,
         unsigned pos = bitfield ? ctz(bitfield) : this->count;
         memmove(this->key + pos + 1, this->key + pos, this->count - pos);
         memmove(this->child + pos + 1, this->child + pos,
-                (this->count - pos) * sizeof(uintptr_t));
+                (this->count - pos) * sizeof(NodeRef));
 
         this->key[pos] = keyByteFlipped;
         this->child[pos] = child;
@@ -790,26 +754,21 @@ void Node16::lilCanInsertNode16ChangeFp(ART* tree, ArtNode** nodeRef,
 
         this->count++;
     } else {
-        // Grow to Node48
-        Node48* newNode = new Node48();
+        // Grow to Node32 or Node48
+        ArtNode* newNode = growNode(tree, this);
         *nodeRef = newNode;
-        memcpy(newNode->child, this->child, this->count * sizeof(uintptr_t));
-        for (unsigned i = 0; i < this->count; i++)
-            newNode->childIndex[flipSign(this->key[i])] = i;
-        copyPrefix(this, newNode);
-        newNode->count = this->count;
 
         // Add the newNode to the fast path
         tree->fp_path[tree->fp_path_length - 1] = newNode;
 
-        delete this;
-        return newNode->lilCanInsertNode48ChangeFp(tree, nodeRef, keyByte,
-                                                  child);
+        freeNode(tree, this);
+        return lilCanInsertChildChangeFp(tree, nodeRef, newNode, keyByte,
+                                         child);
     }
 }
 
 // fp insert method for Node48 that changes fp_leaf
-void Node48::lilCanInsertNode48ChangeFp(ART* tree, ArtNode** nodeRef,
+void Node48::lilCanInsertNode48ChangeFp(ART* tree, NodeRef* nodeRef,
                                        uint8_t keyByte, ArtNode* child) {
     // Insert leaf into inner node
     if (this->count < 48) {
@@ -829,7 +788,7 @@ void Node48::lilCanInsertNode48ChangeFp(ART* tree, ArtNode** nodeRef,
 
     } else {
         // Grow to Node256
-        Node256* newNode = new Node256();
+        Node256* newNode = allocNode<Node256>(tree);
         for (unsigned i = 0; i < 256; i++)
             if (this->childIndex[i] != 48)
                 newNode->child[i] = this->child[this->childIndex[i]];
@@ -840,14 +799,14 @@ void Node48::lilCanInsertNode48ChangeFp(ART* tree, ArtNode** nodeRef,
         // Add the newNode to the fast path
         tree->fp_path[tree->fp_path_length - 1] = newNode;
 
-        delete this;
+        freeNode(tree, this);
         return newNode->lilCanInsertNode256ChangeFp(tree, nodeRef, keyByte,
                                                    child);
     }
 }
 
 // fp insert method for Node256 that changes fp_leaf
-void Node256::lilCanInsertNode256ChangeFp(ART* tree, ArtNode** nodeRef,
+void Node256::lilCanInsertNode256ChangeFp(ART* tree, NodeRef* nodeRef,
                                          uint8_t keyByte, ArtNode* child) {
     // Insert leaf into inner node
     this->count++;
@@ -859,10 +818,24 @@ void Node256::lilCanInsertNode256ChangeFp(ART* tree, ArtNode** nodeRef,
     tree->fp_ref = nodeRef;
 }
 
+// fp insert method for NodeBitmap that changes fp_leaf
+void NodeBitmap::lilCanInsertBitmapChangeFp(ART* tree, NodeRef* nodeRef,
+                                            uint8_t keyByte) {
+    // Insert leaf into inner node by setting its bit, a full node collapses
+    // into an interval in its place
+    ArtNode* child = this->leaf(keyByte);
+    this->insertBitmap(tree, nodeRef, keyByte);
+
+    // Update fp parameters
+    tree->fp_leaf = child;
+    tree->fp = *nodeRef;
+    tree->fp_ref = nodeRef;
+}
+
 // fp insert method for Node4 that correctly tracks fp_ref in a
 // very special case of prefix expansion
 void Node4::lilCanInsertNode4PreserveFpPrefixExpansion(ART* tree,
-                                                      ArtNode** nodeRef,
+                                                      NodeRef* nodeRef,
                                                       uint8_t keyByte,
                                                       ArtNode* child) {
     // Insert element
@@ -871,7 +844,7 @@ void Node4::lilCanInsertNode4PreserveFpPrefixExpansion(ART* tree,
         ;
     memmove(this->key + pos + 1, this->key + pos, this->count - pos);
     memmove(this->child + pos + 1, this->child + pos,
-            (this->count - pos) * sizeof(uintptr_t));
+            (this->count - pos) * sizeof(NodeRef));
     this->key[pos] = keyByte;
     this->child[pos] = child;
     this->count++;
@@ -884,7 +857,7 @@ void Node4::lilCanInsertNode4PreserveFpPrefixExpansion(ART* tree,
 }
 
 // fp insert method for Node4 that does not change fp_leaf
-void Node4::lilCanInsertNode4PreserveFp(ART* tree, ArtNode** nodeRef,
+void Node4::lilCanInsertNode4PreserveFp(ART* tree, NodeRef* nodeRef,
                                        uint8_t keyByte, ArtNode* child) {
     // Insert leaf into inner node
     if (this->count < 4) {
@@ -894,49 +867,24 @@ void Node4::lilCanInsertNode4PreserveFp(ART* tree, ArtNode** nodeRef,
             ;
         memmove(this->key + pos + 1, this->key + pos, this->count - pos);
         memmove(this->child + pos + 1, this->child + pos,
-                (this->count - pos) * sizeof(uintptr_t));
+                (this->count - pos) * sizeof(NodeRef));
         this->key[pos] = keyByte;
         this->child[pos] = child;
         this->count++;
+        preserveFpShifted(tree, this);
     } else {
-        // Grow to Node16
-        Node16* newNode = new Node16();
+        // Grow to Node8 or Node16
+        ArtNode* newNode = growNode(tree, this);
         *nodeRef = newNode;
-        newNode->count = 4;
-        copyPrefix(this, newNode);
-        for (unsigned i = 0; i < 4; i++)
-            newNode->key[i] = flipSign(this->key[i]);
-        memcpy(newNode->child, this->child, this->count * sizeof(uintptr_t));
-
-        // If the changing node is the fast path node
-        if (tree->fp == this) {
-            // Adjust fp information
-            tree->fp = newNode;
-            tree->fp_path[tree->fp_path_length - 1] = newNode;
-            tree->fp_ref = nodeRef;
-        }
-        // If the changing node hosts the cell fp_ref points to
-        else if (tree->fp_path_length >= 2 && tree->fp_path[tree->fp_path_length - 2] == this) {
-            tree->fp_path[tree->fp_path_length - 2] = newNode;
-            // Find the cell that points to the fast path node
-            // and update the fp_ref to point to the cell
-            for (size_t i = 0; i < newNode->count; i++) {
-                if (newNode->child[i] == tree->fp) {
-                    tree->fp_ref = &newNode->child[i];
-                    break;
-                }
-            }
-        }
-
-        delete this;
-
-        return newNode->lilCanInsertNode16PreserveFp(tree, nodeRef, keyByte,
-                                                    child);
+        preserveFpReplaceGrown(tree, nodeRef, this, newNode);
+        freeNode(tree, this);
+        return lilCanInsertChildPreserveFp(tree, nodeRef, newNode, keyByte,
+                                           child);
     }
 }
 
 // fp insert method for Node16 that does not change fp_leaf
-void Node16::lilCanInsertNode16PreserveFp(ART* tree, ArtNode** nodeRef,
+void Node16::lilCanInsertNode16PreserveFp(ART* tree, NodeRef* nodeRef,
                                          uint8_t keyByte, ArtNode* child) {
     // Insert leaf into inner node
     if (this->count < 16) {
@@ -950,48 +898,23 @@ void Node16::lilCanInsertNode16PreserveFp(ART* tree, ArtNode** nodeRef,
         unsigned pos = bitfield ? ctz(bitfield) : this->count;
         memmove(this->key + pos + 1, this->key + pos, this->count - pos);
         memmove(this->child + pos + 1, this->child + pos,
-                (this->count - pos) * sizeof(uintptr_t));
+                (this->count - pos) * sizeof(NodeRef));
         this->key[pos] = keyByteFlipped;
         this->child[pos] = child;
         this->count++;
+        preserveFpShifted(tree, this);
     } else {
-        // Grow to Node48
-        Node48* newNode = new Node48();
+        // Grow to Node32 or Node48
+        ArtNode* newNode = growNode(tree, this);
         *nodeRef = newNode;
-
-        memcpy(newNode->child, this->child, this->count * sizeof(uintptr_t));
-        for (unsigned i = 0; i < this->count; i++)
-            newNode->childIndex[flipSign(this->key[i])] = i;
-        copyPrefix(this, newNode);
-        newNode->count = this->count;
-
-        // If the changing node is the fast path node
-        if (tree->fp == this) {
-            tree->fp = newNode;
-            tree->fp_path[tree->fp_path_length - 1] = newNode;
-            tree->fp_ref = nodeRef;
-        }
-        // If the changing node hosts the cell fp_ref points to
-        else if (tree->fp_path_length >= 2 && tree->fp_path[tree->fp_path_length - 2] == this) {
-            tree->fp_path[tree->fp_path_length - 2] = newNode;
-            // Find the cell that points to the fast path node
-            // and update the fp_ref to point to the cell
-            for (size_t i = 0; i < newNode->count; i++) {
-                if (newNode->child[i] == tree->fp) {
-                    tree->fp_ref = &newNode->child[i];
-                    break;
-                }
-            }
-        }
-
-        delete this;
-
-        return newNode->lilCanInsertNode48PreserveFp(tree, nodeRef, keyByte,
-                                                    child);
+        preserveFpReplaceGrown(tree, nodeRef, this, newNode);
+        freeNode(tree, this);
+        return lilCanInsertChildPreserveFp(tree, nodeRef, newNode, keyByte,
+                                           child);
     }
 }
 
-void Node48::lilCanInsertNode48PreserveFp(ART* tree, ArtNode** nodeRef,
+void Node48::lilCanInsertNode48PreserveFp(ART* tree, NodeRef* nodeRef,
                                          uint8_t keyByte, ArtNode* child) {
     // Insert leaf into inner node
     if (this->count < 48) {
@@ -1005,7 +928,7 @@ void Node48::lilCanInsertNode48PreserveFp(ART* tree, ArtNode** nodeRef,
         this->count++;
     } else {
         // Grow to Node256
-        Node256* newNode = new Node256();
+        Node256* newNode = allocNode<Node256>(tree);
         for (unsigned i = 0; i < 256; i++)
             if (this->childIndex[i] != 48)
                 newNode->child[i] = this->child[this->childIndex[i]];
@@ -1032,7 +955,7 @@ void Node48::lilCanInsertNode48PreserveFp(ART* tree, ArtNode** nodeRef,
             }
         }
 
-        delete this;
+        freeNode(tree, this);
 
         // There is no need for a lilCanInsertNode256PreserveFp method
         // because Node256 can't expand further
@@ -1040,4 +963,480 @@ void Node48::lilCanInsertNode48PreserveFp(ART* tree, ArtNode** nodeRef,
     }
 }
 
+// Node8 and Node32 are steps of the growth ladder, see ladderNode8 and
+// ladderNode32
+// fp insert method for Node8
+void Node8::tailInsertNode8(ART* tree, NodeRef* nodeRef, uint8_t keyByte,
+                            ArtNode* child,
+                            std::array<ArtNode*, maxKeyWidth>& temp_fp_path,
+                            size_t& temp_fp_path_length, size_t depth_prev) {
+    // Insert leaf into inner node
+    if (this->count < 8) {
+        insertSorted(keyByte, child);
+        // The cells after keyByte moved, fp_ref follows
+        preserveFpShifted(tree, this);
+
+        // If what's being inserted is a leaf
+        if (isLeaf(child)) {
+            // If the new value is greater than or equal to the current fp_leaf,
+            // update the fp_leaf, fp and fp_path
+            if (getLeafValue(child) >= getLeafValue(tree->fp_leaf)) {
+                tree->fp_leaf = child;
+                tree->fp = temp_fp_path[temp_fp_path_length - 1];
+                tree->fp_path = temp_fp_path;
+                tree->fp_path_length = temp_fp_path_length;
+                tree->fp_depth = depth_prev;
+                tree->fp_ref = nodeRef;
+            }
+        }
+    } else {
+        // Grow to Node16
+        ArtNode* newNode = growNode(tree, this);
+        *nodeRef = newNode;
+        tailReplaceGrown(tree, this, newNode, child, temp_fp_path,
+                         temp_fp_path_length);
+        freeNode(tree, this);
+        return tailInsertChild(tree, nodeRef, newNode, keyByte, child,
+                               temp_fp_path, temp_fp_path_length, depth_prev);
+    }
+}
+
+void Node8::lilInsertNode8(ART* tree, NodeRef* nodeRef, uint8_t keyByte,
+                           ArtNode* child) {
+    // Insert leaf into inner node
+    if (this->count < 8) {
+        insertSorted(keyByte, child);
+    } else {
+        // Grow to Node16
+        ArtNode* newNode = growNode(tree, this);
+        *nodeRef = newNode;
+
+        // update fast path
+        tree->fp = newNode;
+        tree->fp_path[tree->fp_path_length - 1] = newNode;
+        tree->fp_path_ref[tree->fp_path_length - 1] = nodeRef;
+
+        freeNode(tree, this);
+        return lilInsertChild(tree, nodeRef, newNode, keyByte, child);
+    }
+}
+
+// fp insert method for Node8 that changes fp_leaf
+void Node8::stailInsertNode8ChangeFp(ART* tree, NodeRef* nodeRef,
+                                     uint8_t keyByte, ArtNode* child) {
+    // Insert leaf into inner node
+    if (this->count < 8) {
+        insertSorted(keyByte, child);
+
+        // Update fp parameters
+        tree->fp_leaf = child;
+        tree->fp = this;
+        tree->fp_ref = nodeRef;
+    } else {
+        // Grow to Node16
+        ArtNode* newNode = growNode(tree, this);
+        *nodeRef = newNode;
+
+        // Add the newNode to the fast path
+        tree->fp_path[tree->fp_path_length - 1] = newNode;
+
+        freeNode(tree, this);
+        return stailInsertChildChangeFp(tree, nodeRef, newNode, keyByte, child);
+    }
+}
+
+// fp insert method for Node8 that does not change fp_leaf
+void Node8::stailInsertNode8PreserveFp(ART* tree, NodeRef* nodeRef,
+                                       uint8_t keyByte, ArtNode* child) {
+    // Insert leaf into inner node
+    if (this->count < 8) {
+        insertSorted(keyByte, child);
+        preserveFpShifted(tree, this);
+    } else {
+        // Grow to Node16
+        ArtNode* newNode = growNode(tree, this);
+        *nodeRef = newNode;
+        preserveFpReplaceGrown(tree, nodeRef, this, newNode);
+        freeNode(tree, this);
+        return stailInsertChildPreserveFp(tree, nodeRef, newNode, keyByte,
+                                         child);
+    }
+}
+
+// fp insert method for Node8 that changes fp_leaf
+void Node8::lilCanInsertNode8ChangeFp(ART* tree, NodeRef* nodeRef,
+                                      uint8_t keyByte, ArtNode* child) {
+    // Insert leaf into inner node
+    if (this->count < 8) {
+        insertSorted(keyByte, child);
+
+        // Update fp parameters
+        tree->fp_leaf = child;
+        tree->fp = this;
+        tree->fp_ref = nodeRef;
+    } else {
+        // Grow to Node16
+        ArtNode* newNode = growNode(tree, this);
+        *nodeRef = newNode;
+
+        // Add the newNode to the fast path
+        tree->fp_path[tree->fp_path_length - 1] = newNode;
+
+        freeNode(tree, this);
+        return lilCanInsertChildChangeFp(tree, nodeRef, newNode, keyByte,
+                                         child);
+    }
+}
+
+// fp insert method for Node8 that does not change fp_leaf
+void Node8::lilCanInsertNode8PreserveFp(ART* tree, NodeRef* nodeRef,
+                                        uint8_t keyByte, ArtNode* child) {
+    // Insert leaf into inner node
+    if (this->count < 8) {
+        insertSorted(keyByte, child);
+        preserveFpShifted(tree, this);
+    } else {
+        // Grow to Node16
+        ArtNode* newNode = growNode(tree, this);
+        *nodeRef = newNode;
+        preserveFpReplaceGrown(tree, nodeRef, this, newNode);
+        freeNode(tree, this);
+        return lilCanInsertChildPreserveFp(tree, nodeRef, newNode, keyByte,
+                                         child);
+    }
+}
+
+// fp insert method for Node32
+void Node32::tailInsertNode32(
+    ART* tree, NodeRef* nodeRef, uint8_t keyByte, ArtNode* child,
+    std::array<ArtNode*, maxKeyWidth>& temp_fp_path,
+    size_t& temp_fp_path_length, size_t depth_prev) {
+    // Insert leaf into inner node
+    if (this->count < 32) {
+        insertSorted(keyByte, child);
+        // The cells after keyByte moved, fp_ref follows
+        preserveFpShifted(tree, this);
+
+        // If what's being inserted is a leaf
+        if (isLeaf(child)) {
+            // If the new value is greater than or equal to the current fp_leaf,
+            // update the fp_leaf, fp and fp_path
+            if (getLeafValue(child) >= getLeafValue(tree->fp_leaf)) {
+                tree->fp_leaf = child;
+                tree->fp = temp_fp_path[temp_fp_path_length - 1];
+                tree->fp_path = temp_fp_path;
+                tree->fp_path_length = temp_fp_path_length;
+                tree->fp_depth = depth_prev;
+                tree->fp_ref = nodeRef;
+            }
+        }
+    } else {
+        // Grow to Node48
+        ArtNode* newNode = growNode(tree, this);
+        *nodeRef = newNode;
+        tailReplaceGrown(tree, this, newNode, child, temp_fp_path,
+                         temp_fp_path_length);
+        freeNode(tree, this);
+        return tailInsertChild(tree, nodeRef, newNode, keyByte, child,
+                               temp_fp_path, temp_fp_path_length, depth_prev);
+    }
+}
+
+void Node32::lilInsertNode32(ART* tree, NodeRef* nodeRef, uint8_t keyByte,
+                             ArtNode* child) {
+    // Insert leaf into inner node
+    if (this->count < 32) {
+        insertSorted(keyByte, child);
+    } else {
+        // Grow to Node48
+        ArtNode* newNode = growNode(tree, this);
+        *nodeRef = newNode;
+
+        // update fast path
+        tree->fp = newNode;
+        tree->fp_path[tree->fp_path_length - 1] = newNode;
+        tree->fp_path_ref[tree->fp_path_length - 1] = nodeRef;
+
+        freeNode(tree, this);
+        return lilInsertChild(tree, nodeRef, newNode, keyByte, child);
+    }
+}
+
+// fp insert method for Node32 that changes fp_leaf
+void Node32::stailInsertNode32ChangeFp(ART* tree, NodeRef* nodeRef,
+                                       uint8_t keyByte, ArtNode* child) {
+    // Insert leaf into inner node
+    if (this->count < 32) {
+        insertSorted(keyByte, child);
+
+        // Update fp parameters
+        tree->fp_leaf = child;
+        tree->fp = this;
+        tree->fp_ref = nodeRef;
+    } else {
+        // Grow to Node48
+        ArtNode* newNode = growNode(tree, this);
+        *nodeRef = newNode;
+
+        // Add the newNode to the fast path
+        tree->fp_path[tree->fp_path_length - 1] = newNode;
+
+        freeNode(tree, this);
+        return stailInsertChildChangeFp(tree, nodeRef, newNode, keyByte, child);
+    }
+}
+
+// fp insert method for Node32 that does not change fp_leaf
+void Node32::stailInsertNode32PreserveFp(ART* tree, NodeRef* nodeRef,
+                                         uint8_t keyByte, ArtNode* child) {
+    // Insert leaf into inner node
+    if (this->count < 32) {
+        insertSorted(keyByte, child);
+        preserveFpShifted(tree, this);
+    } else {
+        // Grow to Node48
+        ArtNode* newNode = growNode(tree, this);
+        *nodeRef = newNode;
+        preserveFpReplaceGrown(tree, nodeRef, this, newNode);
+        freeNode(tree, this);
+        return stailInsertChildPreserveFp(tree, nodeRef, newNode, keyByte,
+                                         child);
+    }
+}
+
+// fp insert method for Node32 that changes fp_leaf
+void Node32::lilCanInsertNode32ChangeFp(ART* tree, NodeRef* nodeRef,
+                                        uint8_t keyByte, ArtNode* child) {
+    // Insert leaf into inner node
+    if (this->count < 32) {
+        insertSorted(keyByte, child);
+
+        // Update fp parameters
+        tree->fp_leaf = child;
+        tree->fp = this;
+        tree->fp_ref = nodeRef;
+    } else {
+        // Grow to Node48
+        ArtNode* newNode = growNode(tree, this);
+        *nodeRef = newNode;
+
+        // Add the newNode to the fast path
+        tree->fp_path[tree->fp_path_length - 1] = newNode;
+
+        freeNode(tree, this);
+        return lilCanInsertChildChangeFp(tree, nodeRef, newNode, keyByte,
+                                         child);
+    }
+}
+
+// fp insert method for Node32 that does not change fp_leaf
+void Node32::lilCanInsertNode32PreserveFp(ART* tree, NodeRef* nodeRef,
+                                          uint8_t keyByte, ArtNode* child) {
+    // Insert leaf into inner node
+    if (this->count < 32) {
+        insertSorted(keyByte, child);
+        preserveFpShifted(tree, this);
+    } else {
+        // Grow to Node48
+        ArtNode* newNode = growNode(tree, this);
+        *nodeRef = newNode;
+        preserveFpReplaceGrown(tree, nodeRef, this, newNode);
+        freeNode(tree, this);
+        return lilCanInsertChildPreserveFp(tree, nodeRef, newNode, keyByte,
+                                         child);
+    }
+}
+
+// Dispatch an insert into an inner node of any type on the growth ladder,
+// used once a node grew into the next type
+void tailInsertChild(ART* tree, NodeRef* nodeRef, ArtNode* node,
+                     uint8_t keyByte, ArtNode* child,
+                     std::array<ArtNode*, maxKeyWidth>& temp_fp_path,
+                     size_t& temp_fp_path_length, size_t depth_prev) {
+    switch (node->type) {
+        case NodeType4:
+            static_cast<Node4*>(node)->tailInsertNode4(
+                tree, nodeRef, keyByte, child, temp_fp_path,
+                temp_fp_path_length, depth_prev);
+            break;
+        case NodeType8:
+            static_cast<Node8*>(node)->tailInsertNode8(
+                tree, nodeRef, keyByte, child, temp_fp_path,
+                temp_fp_path_length, depth_prev);
+            break;
+        case NodeType16:
+            static_cast<Node16*>(node)->tailInsertNode16(
+                tree, nodeRef, keyByte, child, temp_fp_path,
+                temp_fp_path_length, depth_prev);
+            break;
+        case NodeType32:
+            static_cast<Node32*>(node)->tailInsertNode32(
+                tree, nodeRef, keyByte, child, temp_fp_path,
+                temp_fp_path_length, depth_prev);
+            break;
+        case NodeType48:
+            static_cast<Node48*>(node)->tailInsertNode48(
+                tree, nodeRef, keyByte, child, temp_fp_path,
+                temp_fp_path_length, depth_prev);
+            break;
+        case NodeType256:
+            static_cast<Node256*>(node)->tailInsertNode256(
+                tree, nodeRef, keyByte, child, temp_fp_path,
+                temp_fp_path_length, depth_prev);
+            break;
+    }
+}
+
+void lilInsertChild(ART* tree, NodeRef* nodeRef, ArtNode* node,
+                    uint8_t keyByte, ArtNode* child) {
+    switch (node->type) {
+        case NodeType4:
+            static_cast<Node4*>(node)->lilInsertNode4(tree, nodeRef, keyByte,
+                                                      child);
+            break;
+        case NodeType8:
+            static_cast<Node8*>(node)->lilInsertNode8(tree, nodeRef, keyByte,
+                                                      child);
+            break;
+        case NodeType16:
+            static_cast<Node16*>(node)->lilInsertNode16(tree, nodeRef,
+                                                        keyByte, child);
+            break;
+        case NodeType32:
+            static_cast<Node32*>(node)->lilInsertNode32(tree, nodeRef,
+                                                        keyByte, child);
+            break;
+        case NodeType48:
+            static_cast<Node48*>(node)->lilInsertNode48(tree, nodeRef,
+                                                        keyByte, child);
+            break;
+        case NodeType256:
+            static_cast<Node256*>(node)->lilInsertNode256(tree, nodeRef,
+                                                          keyByte, child);
+            break;
+    }
+}
+
+void stailInsertChildChangeFp(ART* tree, NodeRef* nodeRef, ArtNode* node,
+                              uint8_t keyByte, ArtNode* child) {
+    switch (node->type) {
+        case NodeType4:
+            static_cast<Node4*>(node)->stailInsertNode4ChangeFp(
+                tree, nodeRef, keyByte, child);
+            break;
+        case NodeType8:
+            static_cast<Node8*>(node)->stailInsertNode8ChangeFp(
+                tree, nodeRef, keyByte, child);
+            break;
+        case NodeType16:
+            static_cast<Node16*>(node)->stailInsertNode16ChangeFp(
+                tree, nodeRef, keyByte, child);
+            break;
+        case NodeType32:
+            static_cast<Node32*>(node)->stailInsertNode32ChangeFp(
+                tree, nodeRef, keyByte, child);
+            break;
+        case NodeType48:
+            static_cast<Node48*>(node)->stailInsertNode48ChangeFp(
+                tree, nodeRef, keyByte, child);
+            break;
+        case NodeType256:
+            static_cast<Node256*>(node)->stailInsertNode256ChangeFp(
+                tree, nodeRef, keyByte, child);
+            break;
+    }
+}
+
+void stailInsertChildPreserveFp(ART* tree, NodeRef* nodeRef, ArtNode* node,
+                                uint8_t keyByte, ArtNode* child) {
+    switch (node->type) {
+        case NodeType4:
+            static_cast<Node4*>(node)->stailInsertNode4PreserveFp(
+                tree, nodeRef, keyByte, child);
+            break;
+        case NodeType8:
+            static_cast<Node8*>(node)->stailInsertNode8PreserveFp(
+                tree, nodeRef, keyByte, child);
+            break;
+        case NodeType16:
+            static_cast<Node16*>(node)->stailInsertNode16PreserveFp(
+                tree, nodeRef, keyByte, child);
+            break;
+        case NodeType32:
+            static_cast<Node32*>(node)->stailInsertNode32PreserveFp(
+                tree, nodeRef, keyByte, child);
+            break;
+        case NodeType48:
+            static_cast<Node48*>(node)->stailInsertNode48PreserveFp(
+                tree, nodeRef, keyByte, child);
+            break;
+        case NodeType256:
+            // Node256 can't expand further, the fast path is unaffected
+            static_cast<Node256*>(node)->insertNode256(
+                tree, nodeRef, keyByte, child);
+            break;
+    }
+}
+
+void lilCanInsertChildChangeFp(ART* tree, NodeRef* nodeRef, ArtNode* node,
+                               uint8_t keyByte, ArtNode* child) {
+    switch (node->type) {
+        case NodeType4:
+            static_cast<Node4*>(node)->lilCanInsertNode4ChangeFp(
+                tree, nodeRef, keyByte, child);
+            break;
+        case NodeType8:
+            static_cast<Node8*>(node)->lilCanInsertNode8ChangeFp(
+                tree, nodeRef, keyByte, child);
+            break;
+        case NodeType16:
+            static_cast<Node16*>(node)->lilCanInsertNode16ChangeFp(
+                tree, nodeRef, keyByte, child);
+            break;
+        case NodeType32:
+            static_cast<Node32*>(node)->lilCanInsertNode32ChangeFp(
+                tree, nodeRef, keyByte, child);
+            break;
+        case NodeType48:
+            static_cast<Node48*>(node)->lilCanInsertNode48ChangeFp(
+                tree, nodeRef, keyByte, child);
+            break;
+        case NodeType256:
+            static_cast<Node256*>(node)->lilCanInsertNode256ChangeFp(
+                tree, nodeRef, keyByte, child);
+            break;
+    }
+}
+
+void lilCanInsertChildPreserveFp(ART* tree, NodeRef* nodeRef, ArtNode* node,
+                                 uint8_t keyByte, ArtNode* child) {
+    switch (node->type) {
+        case NodeType4:
+            static_cast<Node4*>(node)->lilCanInsertNode4PreserveFp(
+                tree, nodeRef, keyByte, child);
+            break;
+        case NodeType8:
+            static_cast<Node8*>(node)->lilCanInsertNode8PreserveFp(
+                tree, nodeRef, keyByte, child);
+            break;
+        case NodeType16:
+            static_cast<Node16*>(node)->lilCanInsertNode16PreserveFp(
+                tree, nodeRef, keyByte, child);
+            break;
+        case NodeType32:
+            static_cast<Node32*>(node)->lilCanInsertNode32PreserveFp(
+                tree, nodeRef, keyByte, child);
+            break;
+        case NodeType48:
+            static_cast<Node48*>(node)->lilCanInsertNode48PreserveFp(
+                tree, nodeRef, keyByte, child);
+            break;
+        case NodeType256:
+            // Node256 can't expand further, the fast path is unaffected
+            static_cast<Node256*>(node)->insertNode256(
+                tree, nodeRef, keyByte, child);
+            break;
+    }
+}
+
 }  // namespace ART
\ No newline at end of file
@@ -32,12 +32,76 @@ uint8_t flipSign(uint8_t keyByte) {
     return keyByte ^ 128;
 }
 
-void loadKey(uint32_t tid, uint8_t key[]) {
-    // Store the key of the tuple into the key vector
-    // Implementation is database specific
-    reinterpret_cast<uint32_t*>(key)[0] = __builtin_bswap32(tid);
+void loadKey(uint64_t tid, uint8_t key[], unsigned keyLength = 4) {
+    // Store the key of the tuple into the key vector, keyLength is 4 or 8
+    // bytes. Implementation is database specific
+    if (keyLength == 8) {
+        uint64_t word = __builtin_bswap64(tid);
+        memcpy(key, &word, sizeof(word));
+    } else {
+        uint32_t word = __builtin_bswap32(tid);
+        memcpy(key, &word, sizeof(word));
+    }
+}
+
+uint64_t keyValue(const uint8_t key[], unsigned keyLength = 4) {
+    // Inverse of loadKey, the tuple id a key was built from. Read byte-wise:
+    // the key may be an unaligned array of only keyLength bytes
+    uint64_t value = 0;
+    for (unsigned i = 0; i < keyLength; i++) value = (value << 8) | key[i];
+    return value;
 }
 
+unsigned terminateKey(const uint8_t key[], unsigned length, uint8_t out[]) {
+    // Store a variable-length key the way the tree keeps it: bytes 0 and 1
+    // are escaped as 1 1 and 1 2 and a 0 byte ends the key. No key is then a
+    // prefix of another and keys keep their byte order. Returns the bytes
+    // written, at most 2 * length + 1
+    unsigned size = 0;
+    for (unsigned i = 0; i < length; i++) {
+        if (key[i] <= 1) {
+            out[size++] = 1;
+            out[size++] = key[i] + 1;
+        } else {
+            out[size++] = key[i];
+        }
+    }
+    out[size++] = 0;
+    return size;
+}
+
+unsigned unterminateKey(const uint8_t bytes[], uint8_t key[]) {
+    // Inverse of terminateKey, returns the length of the key
+    unsigned length = 0;
+    for (unsigned i = 0; bytes[i] != 0; i++)
+        key[length++] = bytes[i] == 1 ? bytes[++i] - 1 : bytes[i];
+    return length;
+}
+
+// A variable-length key as terminateKey() stores it, on the stack unless it
+// is long
+class TerminatedKey {
+   public:
+    TerminatedKey(const uint8_t key[], unsigned length) {
+        bytes = local;
+        if (2 * length + 1 > sizeof(local)) {
+            heap.resize(2 * length + 1);
+            bytes = heap.data();
+        }
+        size = terminateKey(key, length, bytes);
+    }
+
+    TerminatedKey(const TerminatedKey&) = delete;
+    TerminatedKey& operator=(const TerminatedKey&) = delete;
+
+    uint8_t* bytes;
+    unsigned size;
+
+   private:
+    uint8_t local[128];
+    std::vector<uint8_t> heap;
+};
+
 static inline unsigned ctz(uint16_t x) {
     // Count trailing zeros, only defined for x>0
 #ifdef __GNUC__
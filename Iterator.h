@@ -0,0 +1,213 @@
+/*
+ * Iterator.h
+ *
+ * Cursor over the keys of a tree in key order. It keeps the path from the
+ * root to its leaf as the node and the child slot of every level, so a step
+ * allocates nothing and only climbs as far as the next subtree. The path has
+ * at most one node per key byte and is kept in the cursor itself. Any insert
+ * or erase into the tree invalidates the cursors over it.
+ */
+
+#pragma once
+
+#include <stdint.h>  // integer types
+
+#include <algorithm>
+#include <array>
+#include <stdexcept>
+
+#include "ART.h"  // ART
+
+namespace ART {
+
+class Iterator {
+   public:
+    // A cursor over tree that is not on a key yet, see seek()
+    explicit Iterator(ART& tree) : tree(tree), height(0), leaf_(nullptr) {
+        if (tree.keyLength == variableKeyLength)
+            throw std::invalid_argument("iterators need fixed-length keys");
+    }
+
+    // Is the cursor on a key, false once it moved past either end
+    bool valid() const { return leaf_ != nullptr; }
+
+    // The key the cursor is on and its payload, the smallest payload of a key
+    // with several; ART::forEachPayload(leaf(), visit) visits them all
+    uint64_t key() const { return key_; }
+    uint64_t value() const { return getLeafPayload(leaf_); }
+    ArtNode* leaf() const { return leaf_; }
+
+    // Move to the smallest or the largest key, false if the tree is empty
+    bool seekFirst() {
+        height = 0;
+        descend(tree.root, true);
+        return skipExpired(true);
+    }
+    bool seekLast() {
+        height = 0;
+        descend(tree.root, false);
+        return skipExpired(false);
+    }
+
+    // Move to the smallest key that is not below key, false if there is none
+    bool seek(uint64_t key) {
+        height = 0;
+        leaf_ = nullptr;
+        unsigned keyLength = tree.keyLength;
+        if (keyLength < 8 && key >> (8 * keyLength)) return false;
+        uint8_t bytes[maxKeyWidth];
+        loadKey(key, bytes, keyLength);
+        ArtNode* node = tree.root;
+        unsigned depth = 0;
+        while (node != NULL) {
+            if (isLeaf(node)) {
+                if (getLeafValue(node) < key) break;
+                setLeaf(node);
+                return skipExpired(true);
+            }
+            if (node->type == NodeTypeBucket) {
+                NodeBucket* bucket = static_cast<NodeBucket*>(node);
+                unsigned pos = bucket->lowerBound(key);
+                if (pos == bucket->count) break;
+                path[height++] = {node, int(pos)};
+                setLeaf(bucket->child[pos]);
+                return skipExpired(true);
+            }
+            if (node->type == NodeTypeInterval) {
+                NodeInterval* interval = static_cast<NodeInterval*>(node);
+                if (key > interval->hi) break;
+                path[height++] = {node, 0};
+                setLeaf(makeLeaf(std::max<uintptr_t>(key, interval->lo)));
+                return skipExpired(true);
+            }
+            unsigned pos = prefixMismatch(node, bytes, depth, keyLength);
+            if (pos != node->prefixLength) {
+                // All keys below node are on the same side of key
+                uint8_t buffer[maxKeyWidth];
+                uint8_t prefixByte =
+                    pos < maxPrefixLength
+                        ? node->prefix[pos]
+                        : leafKey(minimum(node), buffer,
+                                  keyLength)[depth + pos];
+                if (prefixByte < bytes[depth + pos]) break;
+                descend(node, true);
+                return skipExpired(true);
+            }
+            depth += node->prefixLength;
+            int slot = lowerSlot(node, bytes[depth]);
+            if (slot < 0) break;
+            path[height++] = {node, slot};
+            uint8_t keyByte = slotKey(node, slot);
+            node = slotChild(node, slot);
+            if (keyByte != bytes[depth]) {
+                descend(node, true);
+                return skipExpired(true);
+            }
+            depth++;
+        }
+        // The keys below the node the descent stopped at are smaller than
+        // key, the next one follows them
+        step(true);
+        return skipExpired(true);
+    }
+    bool seek(const uint8_t key[]) {
+        return seek(uint64_t(keyValue(key, tree.keyLength)));
+    }
+
+    // Move to the next larger or smaller key, false if there is none
+    bool next() {
+        if (!valid()) return false;
+        step(true);
+        return skipExpired(true);
+    }
+    bool prev() {
+        if (!valid()) return false;
+        step(false);
+        return skipExpired(false);
+    }
+
+   private:
+    // A node on the path and the slot of the child the path continues in.
+    // An interval has no slots, its position is the key of the cursor
+    struct Frame {
+        ArtNode* node;
+        int slot;
+    };
+
+    ART& tree;
+    std::array<Frame, maxKeyWidth> path;
+    unsigned height;  // nodes on the path
+    ArtNode* leaf_;   // leaf of the key, NULL if the cursor is not on one
+    uint64_t key_;
+
+    void setLeaf(ArtNode* leaf) {
+        leaf_ = leaf;
+        key_ = getLeafValue(leaf);
+    }
+
+    // Follow the smallest or the largest child from node down to a leaf
+    void descend(ArtNode* node, bool forward) {
+        if (node == NULL) {
+            leaf_ = nullptr;
+            return;
+        }
+        while (!isLeaf(node)) {
+            if (node->type == NodeTypeInterval) {
+                NodeInterval* interval = static_cast<NodeInterval*>(node);
+                path[height++] = {node, 0};
+                setLeaf(makeLeaf(forward ? interval->lo : interval->hi));
+                return;
+            }
+            int slot = forward ? nextSlot(node, -1) : prevSlot(node, 256);
+            path[height++] = {node, slot};
+            prefetchSibling(node, slot, forward);
+            node = slotChild(node, slot);
+        }
+        setLeaf(node);
+    }
+
+    // Move to the adjacent leaf, climbing until a node has a next child
+    void step(bool forward) {
+        while (height > 0) {
+            Frame& frame = path[height - 1];
+            ArtNode* node = frame.node;
+            if (node->type == NodeTypeInterval) {
+                NodeInterval* interval = static_cast<NodeInterval*>(node);
+                if (forward ? key_ < interval->hi : key_ > interval->lo) {
+                    setLeaf(makeLeaf(forward ? key_ + 1 : key_ - 1));
+                    return;
+                }
+            } else {
+                int slot = forward ? nextSlot(node, frame.slot)
+                                   : prevSlot(node, frame.slot);
+                if (slot >= 0) {
+                    frame.slot = slot;
+                    prefetchSibling(node, slot, forward);
+                    descend(slotChild(node, slot), forward);
+                    return;
+                }
+            }
+            height--;
+        }
+        leaf_ = nullptr;
+    }
+
+    // Keys of an expiring tree that expired are absent, step over them
+    bool skipExpired(bool forward) {
+        while (tree.expiring && leaf_ != nullptr && tree.isExpired(leaf_))
+            step(forward);
+        return valid();
+    }
+
+    // The subtree after the one the cursor enters is read next, fetch its
+    // node while the cursor walks this one. Leaves need no search
+    static void prefetchSibling(ArtNode* node, int slot, bool forward) {
+        if (isLeaf(slotChild(node, slot))) return;
+        int sibling = forward ? nextSlot(node, slot) : prevSlot(node, slot);
+        if (sibling < 0) return;
+        ArtNode* child = slotChild(node, sibling);
+        if (!isLeaf(child)) __builtin_prefetch(child);
+    }
+};
+
+}  // namespace ART
@@ -0,0 +1,182 @@
+/*
+ * KeyEncoding.h
+ *
+ * Order-preserving encodings of typed keys. The tree compares keys byte by
+ * byte, most significant first, which orders unsigned integers only. The
+ * encoders map signed integers, floating-point numbers, descending columns
+ * and tuples of columns to unsigned integers, or byte strings, that compare
+ * the same way as the values they come from. Encoded integers are turned into
+ * keys with loadKey() and are the values that insert() takes, decoders map
+ * them back.
+ */
+
+#pragma once
+
+#include <stdint.h>  // integer types
+#include <string.h>  // memcpy
+
+#include <vector>
+
+#include "Helper.h"  // loadKey, terminateKey
+
+namespace ART {
+
+// Sort order of a column of a composite key
+enum class SortOrder { Ascending, Descending };
+
+constexpr uint32_t encodeInt32(int32_t value) {
+    // Flip the sign bit, negative values then sort below positive ones
+    return uint32_t(value) ^ 0x80000000u;
+}
+
+constexpr int32_t decodeInt32(uint32_t bits) {
+    return int32_t(bits ^ 0x80000000u);
+}
+
+constexpr uint64_t encodeInt64(int64_t value) {
+    return uint64_t(value) ^ 0x8000000000000000ull;
+}
+
+constexpr int64_t decodeInt64(uint64_t bits) {
+    return int64_t(bits ^ 0x8000000000000000ull);
+}
+
+inline uint32_t encodeFloat(float value) {
+    // IEEE-754: set the sign bit of positive numbers, invert all bits of
+    // negative ones, which reverses their order. -0.0 sorts just below 0.0
+    // and NaNs sort at the ends. Branch-free, so batches vectorize
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    return bits ^ (uint32_t(int32_t(bits) >> 31) | 0x80000000u);
+}
+
+inline float decodeFloat(uint32_t bits) {
+    bits ^= ((bits >> 31) - 1) | 0x80000000u;
+    float value;
+    memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+inline uint64_t encodeDouble(double value) {
+    uint64_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    return bits ^ (uint64_t(int64_t(bits) >> 63) | 0x8000000000000000ull);
+}
+
+inline double decodeDouble(uint64_t bits) {
+    bits ^= ((bits >> 63) - 1) | 0x8000000000000000ull;
+    double value;
+    memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+// Reverse the order of an encoded column, its own inverse
+constexpr uint32_t descending(uint32_t bits) { return ~bits; }
+constexpr uint64_t descending(uint64_t bits) { return ~bits; }
+
+constexpr uint64_t encodeTuple(uint32_t high, uint32_t low) {
+    // Two 32-bit columns as one 8-byte key, ordered by high, then by low
+    return uint64_t(high) << 32 | low;
+}
+
+constexpr uint32_t tupleHigh(uint64_t bits) { return uint32_t(bits >> 32); }
+constexpr uint32_t tupleLow(uint64_t bits) { return uint32_t(bits); }
+
+// Batch versions for bulk loads, plain loops the compiler vectorizes
+inline void encodeKeys(const int32_t values[], size_t count, uint32_t out[]) {
+    for (size_t i = 0; i < count; i++) out[i] = encodeInt32(values[i]);
+}
+
+inline void encodeKeys(const int64_t values[], size_t count, uint64_t out[]) {
+    for (size_t i = 0; i < count; i++) out[i] = encodeInt64(values[i]);
+}
+
+inline void encodeKeys(const float values[], size_t count, uint32_t out[]) {
+    for (size_t i = 0; i < count; i++) out[i] = encodeFloat(values[i]);
+}
+
+inline void encodeKeys(const double values[], size_t count, uint64_t out[]) {
+    for (size_t i = 0; i < count; i++) out[i] = encodeDouble(values[i]);
+}
+
+inline void decodeKeys(const uint32_t bits[], size_t count, int32_t out[]) {
+    for (size_t i = 0; i < count; i++) out[i] = decodeInt32(bits[i]);
+}
+
+inline void decodeKeys(const uint64_t bits[], size_t count, int64_t out[]) {
+    for (size_t i = 0; i < count; i++) out[i] = decodeInt64(bits[i]);
+}
+
+inline void decodeKeys(const uint32_t bits[], size_t count, float out[]) {
+    for (size_t i = 0; i < count; i++) out[i] = decodeFloat(bits[i]);
+}
+
+inline void decodeKeys(const uint64_t bits[], size_t count, double out[]) {
+    for (size_t i = 0; i < count; i++) out[i] = decodeDouble(bits[i]);
+}
+
+template <typename Value>
+void loadKeys(const Value values[], size_t count, uint8_t keys[],
+              unsigned keyLength) {
+    // loadKey() of every value, the keys are stored one after the other
+    for (size_t i = 0; i < count; i++)
+        loadKey(values[i], keys + i * keyLength, keyLength);
+}
+
+// Composite key built column by column. Fixed-width columns are stored
+// big-endian and byte-string columns terminated as by terminateKey(), so the
+// bytes compare like the tuples they hold. Of 4 or 8 bytes it is a key of a
+// fixed-length tree, of any length one of a variable-length tree
+class KeyBuilder {
+   public:
+    KeyBuilder& add(uint32_t bits, SortOrder order = SortOrder::Ascending) {
+        return append(bits, 4, order);
+    }
+    KeyBuilder& add(uint64_t bits, SortOrder order = SortOrder::Ascending) {
+        return append(bits, 8, order);
+    }
+    KeyBuilder& add(int32_t value, SortOrder order = SortOrder::Ascending) {
+        return append(encodeInt32(value), 4, order);
+    }
+    KeyBuilder& add(int64_t value, SortOrder order = SortOrder::Ascending) {
+        return append(encodeInt64(value), 8, order);
+    }
+    KeyBuilder& add(float value, SortOrder order = SortOrder::Ascending) {
+        return append(encodeFloat(value), 4, order);
+    }
+    KeyBuilder& add(double value, SortOrder order = SortOrder::Ascending) {
+        return append(encodeDouble(value), 8, order);
+    }
+
+    KeyBuilder& add(const uint8_t string[], unsigned length,
+                    SortOrder order = SortOrder::Ascending) {
+        // The terminator keeps a string below its extensions, so the columns
+        // after it do not mix into its order
+        size_t start = bytes.size();
+        bytes.resize(start + 2 * length + 1);
+        bytes.resize(start + terminateKey(string, length, &bytes[start]));
+        if (order == SortOrder::Descending)
+            for (size_t i = start; i < bytes.size(); i++) bytes[i] = ~bytes[i];
+        return *this;
+    }
+
+    uint8_t* data() { return bytes.data(); }
+    unsigned size() const { return bytes.size(); }
+    void clear() { bytes.clear(); }
+
+    // The value of a key of 4 or 8 bytes, as insert() takes it
+    uint64_t value() const { return keyValue(bytes.data(), bytes.size()); }
+
+   private:
+    KeyBuilder& append(uint64_t bits, unsigned width, SortOrder order) {
+        if (order == SortOrder::Descending) bits = ~bits;
+        alignas(8) uint8_t column[8];
+        loadKey(bits, column, width);
+        bytes.insert(bytes.end(), column, column + width);
+        return *this;
+    }
+
+    std::vector<uint8_t> bytes;
+};
+
+}  // namespace ART
@@ -0,0 +1,345 @@
+/*
+ * NodeAllocator.h
+ *
+ * Size-class slab allocator for inner nodes. Every tree owns one allocator
+ * and all grow/shrink paths allocate and free their nodes through it, so the
+ * whole tree can be released in one step. Slabs may be backed by 2 MB huge
+ * pages to cut the dTLB misses of lookups in large trees.
+ */
+
+#pragma once
+
+#include <assert.h>
+#include <stdint.h>    // integer types
+#include <stdio.h>     // fopen, fgets
+#include <stdlib.h>    // aligned_alloc, free
+#include <string.h>    // strncmp
+#include <sys/mman.h>  // mmap, madvise
+
+#include <algorithm>
+#include <new>
+#include <utility>
+#include <vector>
+
+namespace ART {
+
+// Pages that back the slabs of an allocator
+enum class PageMode {
+    Regular,      // 4 KB pages from the C allocator
+    Transparent,  // 2 MB aligned slabs advised with MADV_HUGEPAGE
+    HugeTlb,      // slabs mapped from the hugetlbfs pool, falls back to
+                  // Transparent if the pool is empty
+};
+
+// Size of a huge page, the slab size of allocators that use them
+static const size_t hugePageSize = size_t(1) << 21;
+
+// How much of an allocator is on huge pages
+struct PageStats {
+    size_t slabBytes = 0;        // bytes in all slabs
+    size_t hugeTlbBytes = 0;     // bytes mapped from the hugetlbfs pool
+    size_t advisedBytes = 0;     // bytes advised for transparent huge pages
+    size_t transparentBytes = 0; // advised bytes the kernel backs with them
+    size_t fallbacks = 0;        // slabs that got weaker pages than asked
+};
+
+#ifdef ART_COMPRESSED_CHILDREN
+// With compressed children every slab is carved from one process-wide
+// virtual address range, so that a child can be stored as a 32-bit offset
+// from its base. Offsets are kept in 8-byte units, which bounds the arena to
+// 32 GB of inner nodes.
+static const size_t nodeArenaCapacity = size_t(1) << 35;
+// The first page is never handed out, offset 0 is the null reference
+static const size_t nodeArenaPage = 4096;
+
+char* reserveNodeArena() {
+    // Reserve the address range, pages are only committed when touched
+    void* base = mmap(nullptr, nodeArenaCapacity, PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (base == MAP_FAILED) throw std::bad_alloc();
+    return static_cast<char*>(base);
+}
+
+char* nodeArenaBase = reserveNodeArena();
+char* nodeArenaTop = nodeArenaBase + nodeArenaPage;
+// Ranges given back by released allocators, reused first fit
+std::vector<std::pair<char*, size_t>> nodeArenaFreeRanges;
+
+char* nodeArenaAllocate(size_t size, size_t alignment = nodeArenaPage) {
+    // Take a range from the arena, aligned to a page or a huge page
+    size = (size + nodeArenaPage - 1) & ~(nodeArenaPage - 1);
+    for (size_t i = 0; i < nodeArenaFreeRanges.size(); i++) {
+        auto& range = nodeArenaFreeRanges[i];
+        bool aligned =
+            (reinterpret_cast<uintptr_t>(range.first) & (alignment - 1)) == 0;
+        if (aligned && range.second >= size) {
+            char* memory = range.first;
+            range.first += size;
+            range.second -= size;
+            if (range.second == 0)
+                nodeArenaFreeRanges.erase(nodeArenaFreeRanges.begin() + i);
+            return memory;
+        }
+    }
+    // The gap skipped to align the top stays free for smaller alignments
+    char* memory = reinterpret_cast<char*>(
+        (reinterpret_cast<uintptr_t>(nodeArenaTop) + alignment - 1) &
+        ~uintptr_t(alignment - 1));
+    if (memory > nodeArenaBase + nodeArenaCapacity ||
+        static_cast<size_t>(nodeArenaBase + nodeArenaCapacity - memory) < size)
+        throw std::bad_alloc();
+    if (memory != nodeArenaTop)
+        nodeArenaFreeRanges.emplace_back(nodeArenaTop, memory - nodeArenaTop);
+    nodeArenaTop = memory + size;
+    return memory;
+}
+
+void nodeArenaFree(char* memory, size_t size) {
+    // Drop the physical pages and keep the range for reuse
+    size = (size + nodeArenaPage - 1) & ~(nodeArenaPage - 1);
+    madvise(memory, size, MADV_DONTNEED);
+    nodeArenaFreeRanges.emplace_back(memory, size);
+}
+#endif
+
+class NodeAllocator {
+   public:
+    // Smallest node alignment, node sizes are rounded up to a multiple of it
+    static constexpr size_t minAlignment = 16;
+    // Nodes are laid out so that lookups touch as few cache lines as possible
+    static constexpr size_t cacheLineSize = 64;
+    // Size of a regular slab that nodes are carved from
+    static constexpr size_t slabSize = 1 << 16;
+
+    explicit NodeAllocator(PageMode pageMode = PageMode::Regular)
+        : pageMode(pageMode), current(nullptr), currentEnd(nullptr) {}
+    ~NodeAllocator() { release(); }
+
+    NodeAllocator(const NodeAllocator&) = delete;
+    NodeAllocator& operator=(const NodeAllocator&) = delete;
+
+    static size_t alignmentFor(size_t size) {
+        // Nodes up to a cache line are aligned to the next power of two so
+        // they never straddle two lines, larger nodes start on a line
+        size_t alignment = minAlignment;
+        while (alignment < size && alignment < cacheLineSize) alignment <<= 1;
+        return alignment;
+    }
+
+    static size_t allocationSize(size_t size) {
+        // Bytes actually taken by a node of the given size
+        size_t alignment = alignmentFor(size);
+        return (size + alignment - 1) & ~(alignment - 1);
+    }
+
+    void* allocate(size_t size) {
+        // Reuse a freed node of the same size class if there is one,
+        // otherwise bump allocate from the current slab
+        size_t alignment = alignmentFor(size);
+        size = allocationSize(size);
+        size_t sizeClass = size / minAlignment;
+        if (sizeClass < freeLists.size() && freeLists[sizeClass] != nullptr) {
+            FreeSlot* slot = freeLists[sizeClass];
+            freeLists[sizeClass] = slot->next;
+            return slot;
+        }
+        char* node = alignUp(current, alignment);
+        if (node == nullptr || node + size > currentEnd) {
+            addSlab(size);
+            node = current;
+        }
+        current = node + size;
+        return node;
+    }
+
+    void deallocate(void* node, size_t size) {
+        // Push the node on the free list of its size class
+        size_t sizeClass = allocationSize(size) / minAlignment;
+        if (sizeClass >= freeLists.size())
+            freeLists.resize(sizeClass + 1, nullptr);
+        FreeSlot* slot = static_cast<FreeSlot*>(node);
+        slot->next = freeLists[sizeClass];
+        freeLists[sizeClass] = slot;
+    }
+
+    void reserve(size_t bytes) {
+        // Make sure the next bytes worth of allocations need no new slab
+        if (static_cast<size_t>(currentEnd - current) < bytes) addSlab(bytes);
+    }
+
+    void release() {
+        // Free every slab at once, all nodes handed out become invalid
+        for (auto& slab : slabs) {
+#ifdef ART_COMPRESSED_CHILDREN
+            nodeArenaFree(slab.memory, slab.size);
+#else
+            if (pageMode == PageMode::Regular)
+                free(slab.memory);
+            else
+                munmap(slab.memory, slab.size);
+#endif
+        }
+        slabs.clear();
+        freeLists.clear();
+        current = currentEnd = nullptr;
+    }
+
+    void swap(NodeAllocator& other) {
+        // Exchange all slabs and free nodes with an allocator that uses the
+        // same pages
+        assert(pageMode == other.pageMode);
+        std::swap(current, other.current);
+        std::swap(currentEnd, other.currentEnd);
+        slabs.swap(other.slabs);
+        freeLists.swap(other.freeLists);
+    }
+
+    PageStats pageStats() const {
+        // Sum up the slabs by the pages they got, and ask the kernel how
+        // much of the advised ones it currently backs with huge pages
+        PageStats stats;
+        for (auto& slab : slabs) {
+            stats.slabBytes += slab.size;
+            if (slab.pages == PageMode::HugeTlb)
+                stats.hugeTlbBytes += slab.size;
+            else if (slab.pages == PageMode::Transparent)
+                stats.advisedBytes += slab.size;
+            if (slab.pages < pageMode) stats.fallbacks++;
+        }
+        if (stats.advisedBytes != 0)
+            stats.transparentBytes = transparentHugeBytes();
+        return stats;
+    }
+
+    const PageMode pageMode;  // pages asked for new slabs
+
+   private:
+    // Freed nodes are linked through their first bytes
+    struct FreeSlot {
+        FreeSlot* next;
+    };
+
+    struct Slab {
+        char* memory;
+        size_t size;
+        PageMode pages;  // pages the slab actually got
+    };
+
+    static char* alignUp(char* pointer, size_t alignment) {
+        uintptr_t bits = reinterpret_cast<uintptr_t>(pointer);
+        return reinterpret_cast<char*>((bits + alignment - 1) &
+                                       ~(alignment - 1));
+    }
+
+    void addSlab(size_t minSize) {
+        // The unused tail of the previous slab is abandoned, it is smaller
+        // than the node that did not fit. Slabs start on a cache line.
+        // Slabs on huge pages are whole huge pages.
+        size_t unit = pageMode == PageMode::Regular ? cacheLineSize
+                                                    : hugePageSize;
+        size_t size = std::max(minSize, slabSize);
+        size = (size + unit - 1) & ~(unit - 1);
+        PageMode pages = pageMode;
+#ifdef ART_COMPRESSED_CHILDREN
+        // The shared arena is one regular mapping, its ranges can only be
+        // advised
+        char* slab = nodeArenaAllocate(size, unit);
+        if (pages != PageMode::Regular)
+            pages = adviseHuge(slab, size) ? PageMode::Transparent
+                                           : PageMode::Regular;
+#else
+        char* slab;
+        if (pages == PageMode::Regular) {
+            slab = static_cast<char*>(aligned_alloc(cacheLineSize, size));
+            if (slab == nullptr) throw std::bad_alloc();
+        } else {
+            slab = mapHuge(size, pages);
+        }
+#endif
+        slabs.push_back({slab, size, pages});
+        current = slab;
+        currentEnd = slab + size;
+    }
+
+#ifndef ART_COMPRESSED_CHILDREN
+    static char* mapHuge(size_t size, PageMode& pages) {
+        // Map a slab from the hugetlbfs pool if asked, otherwise or if the
+        // pool is empty map a huge page aligned range and advise it
+#ifdef MAP_HUGETLB
+        if (pages == PageMode::HugeTlb) {
+            void* memory =
+                mmap(nullptr, size, PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+            if (memory != MAP_FAILED) return static_cast<char*>(memory);
+        }
+#endif
+        // Over-map by a huge page and trim both ends to align the range
+        void* mapped =
+            mmap(nullptr, size + hugePageSize, PROT_READ | PROT_WRITE,
+                 MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (mapped == MAP_FAILED) throw std::bad_alloc();
+        char* begin = static_cast<char*>(mapped);
+        char* memory = alignUp(begin, hugePageSize);
+        if (memory != begin) munmap(begin, memory - begin);
+        munmap(memory + size, begin + hugePageSize - memory);
+        pages = adviseHuge(memory, size) ? PageMode::Transparent
+                                         : PageMode::Regular;
+        return memory;
+    }
+#endif
+
+    static bool adviseHuge(char* memory, size_t size) {
+        // Ask for transparent huge pages, fails if the kernel has none
+#ifdef MADV_HUGEPAGE
+        return madvise(memory, size, MADV_HUGEPAGE) == 0;
+#else
+        (void)memory;
+        (void)size;
+        return false;
+#endif
+    }
+
+    size_t transparentHugeBytes() const {
+        // Add up the AnonHugePages of every mapping in /proc/self/smaps,
+        // capped by how much of it the advised slabs cover
+        FILE* smaps = fopen("/proc/self/smaps", "r");
+        if (smaps == nullptr) return 0;
+        char line[256];
+        uintptr_t start = 0, end = 0;
+        size_t bytes = 0;
+        while (fgets(line, sizeof(line), smaps) != nullptr) {
+            unsigned long first, last;
+            size_t kilobytes;
+            if (strncmp(line, "AnonHugePages:", 14) == 0) {
+                if (sscanf(line + 14, "%zu", &kilobytes) == 1 && kilobytes)
+                    bytes += std::min(kilobytes << 10,
+                                      advisedOverlap(start, end));
+            } else if (sscanf(line, "%lx-%lx ", &first, &last) == 2) {
+                start = first;
+                end = last;
+            }
+        }
+        fclose(smaps);
+        return bytes;
+    }
+
+    size_t advisedOverlap(uintptr_t start, uintptr_t end) const {
+        // Bytes of the advised slabs inside [start, end)
+        size_t bytes = 0;
+        for (auto& slab : slabs) {
+            if (slab.pages != PageMode::Transparent) continue;
+            uintptr_t first = reinterpret_cast<uintptr_t>(slab.memory);
+            uintptr_t last = first + slab.size;
+            if (first < end && start < last)
+                bytes += std::min(last, end) - std::max(first, start);
+        }
+        return bytes;
+    }
+
+    char* current;     // bump pointer into the newest slab
+    char* currentEnd;  // end of the newest slab
+    std::vector<Slab> slabs;           // every slab owned by the allocator
+    std::vector<FreeSlot*> freeLists;  // free nodes, indexed by size class
+};
+
+}  // namespace ART
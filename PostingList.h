@@ -0,0 +1,191 @@
+/*
+ * PostingList.h
+ *
+ * Sorted list of the payloads of a key that has more than one, for trees
+ * used as multimaps such as secondary indexes over non-unique attributes.
+ * Short lists are plain arrays. Long ones are cut into blocks whose payloads
+ * are stored as varint-encoded differences to their predecessor, a byte or
+ * two per payload for the dense row ids of an index. A block is decoded and
+ * encoded again as a whole when it changes.
+ */
+
+#pragma once
+
+#include <stdint.h>  // integer types
+
+#include <algorithm>
+#include <vector>
+
+namespace ART {
+
+class PostingList {
+   public:
+    // Payloads kept as a plain array before the list is delta-encoded, a
+    // list that shrinks to half of it is decoded again
+    static constexpr size_t packThreshold = 64;
+    // Most payloads of a block, a fuller one is split in two
+    static constexpr size_t blockCapacity = 128;
+
+    PostingList(uint64_t first, uint64_t second)
+        : plain{std::min(first, second), std::max(first, second)}, count(2) {}
+
+    size_t size() const { return count; }
+
+    // Smallest payload
+    uint64_t front() const {
+        return blocks.empty() ? plain.front() : blocks.front().first;
+    }
+
+    // Add a payload, a payload that is in the list already is added again
+    void insert(uint64_t payload) {
+        count++;
+        if (blocks.empty()) {
+            plain.insert(std::upper_bound(plain.begin(), plain.end(), payload),
+                         payload);
+            if (plain.size() > packThreshold) pack();
+            return;
+        }
+        size_t i = blockOf(payload);
+        std::vector<uint64_t> values;
+        decode(blocks[i], values);
+        values.insert(std::upper_bound(values.begin(), values.end(), payload),
+                      payload);
+        if (values.size() <= blockCapacity) {
+            encode(values.begin(), values.end(), blocks[i]);
+            return;
+        }
+        auto middle = values.begin() + values.size() / 2;
+        blocks.insert(blocks.begin() + i + 1, Block());
+        encode(values.begin(), middle, blocks[i]);
+        encode(middle, values.end(), blocks[i + 1]);
+    }
+
+    // Remove one occurrence of a payload, false if it is not in the list
+    bool erase(uint64_t payload) {
+        if (blocks.empty()) {
+            auto it = std::lower_bound(plain.begin(), plain.end(), payload);
+            if (it == plain.end() || *it != payload) return false;
+            plain.erase(it);
+            count--;
+            return true;
+        }
+        size_t i = blockOf(payload);
+        std::vector<uint64_t> values;
+        decode(blocks[i], values);
+        auto it = std::lower_bound(values.begin(), values.end(), payload);
+        if (it == values.end() || *it != payload) return false;
+        values.erase(it);
+        count--;
+        if (values.empty())
+            blocks.erase(blocks.begin() + i);
+        else
+            encode(values.begin(), values.end(), blocks[i]);
+        if (count <= packThreshold / 2) unpack();
+        return true;
+    }
+
+    // Call visit with every payload in ascending order
+    template <typename Visit>
+    void forEach(Visit& visit) const {
+        if (blocks.empty()) {
+            for (uint64_t payload : plain) visit(payload);
+            return;
+        }
+        for (const Block& block : blocks) {
+            uint64_t payload = block.first;
+            visit(payload);
+            const uint8_t* delta = block.deltas.data();
+            for (uint32_t i = 1; i < block.count; i++) {
+                payload += readVarint(delta);
+                visit(payload);
+            }
+        }
+    }
+
+    // Bytes the list takes on the heap
+    size_t bytes() const {
+        size_t total = sizeof(PostingList) +
+                       plain.capacity() * sizeof(uint64_t) +
+                       blocks.capacity() * sizeof(Block);
+        for (const Block& block : blocks) total += block.deltas.capacity();
+        return total;
+    }
+
+   private:
+    // Payloads from first on, each following one as its difference to the
+    // one before it
+    struct Block {
+        uint64_t first = 0;
+        uint32_t count = 0;
+        std::vector<uint8_t> deltas;
+    };
+
+    std::vector<uint64_t> plain;  // the payloads while the list is short
+    std::vector<Block> blocks;    // the payloads once it is delta-encoded
+    size_t count;
+
+    // The block a payload belongs in, the last one that starts at or below it
+    size_t blockOf(uint64_t payload) const {
+        auto it = std::upper_bound(
+            blocks.begin(), blocks.end(), payload,
+            [](uint64_t p, const Block& block) { return p < block.first; });
+        return it == blocks.begin() ? 0 : it - blocks.begin() - 1;
+    }
+
+    void pack() {
+        // Half full blocks, inserts fill them before they split
+        size_t step = blockCapacity / 2;
+        for (size_t i = 0; i < plain.size(); i += step) {
+            size_t end = std::min(plain.size(), i + step);
+            blocks.emplace_back();
+            encode(plain.begin() + i, plain.begin() + end, blocks.back());
+        }
+        std::vector<uint64_t>().swap(plain);
+    }
+
+    void unpack() {
+        std::vector<uint64_t> values;
+        for (const Block& block : blocks) decode(block, values);
+        std::vector<Block>().swap(blocks);
+        plain.swap(values);
+    }
+
+    template <typename Iterator>
+    static void encode(Iterator begin, Iterator end, Block& block) {
+        block.first = *begin;
+        block.count = uint32_t(end - begin);
+        block.deltas.clear();
+        for (Iterator it = begin + 1; it < end; it++) {
+            uint64_t delta = *it - *(it - 1);
+            while (delta >= 0x80) {
+                block.deltas.push_back(uint8_t(delta) | 0x80);
+                delta >>= 7;
+            }
+            block.deltas.push_back(uint8_t(delta));
+        }
+        block.deltas.shrink_to_fit();
+    }
+
+    // Append the payloads of a block to values
+    static void decode(const Block& block, std::vector<uint64_t>& values) {
+        uint64_t payload = block.first;
+        values.push_back(payload);
+        const uint8_t* delta = block.deltas.data();
+        for (uint32_t i = 1; i < block.count; i++) {
+            payload += readVarint(delta);
+            values.push_back(payload);
+        }
+    }
+
+    static uint64_t readVarint(const uint8_t*& p) {
+        // 7 bits per byte, least significant first, the high bit continues
+        uint64_t value = 0;
+        for (unsigned shift = 0;; shift += 7) {
+            uint8_t byte = *p++;
+            value |= uint64_t(byte & 0x7f) << shift;
+            if (!(byte & 0x80)) return value;
+        }
+    }
+};
+
+}  // namespace ART
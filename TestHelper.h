@@ -0,0 +1,33 @@
+/*
+ * TestHelper.h
+ *
+ * Checks shared by the test_*.cpp programs that ctest runs. A failed check
+ * prints its file, line and condition and the test goes on; testResult()
+ * is the exit status of the program.
+ */
+
+#pragma once
+
+#include <iostream>
+
+namespace ART {
+
+inline int testFailures = 0;
+
+#define EXPECT(condition)                                              \
+    do {                                                               \
+        if (!(condition)) {                                            \
+            std::cerr << __FILE__ << ":" << __LINE__ << ": " #condition \
+                      << std::endl;                                    \
+            ART::testFailures++;                                       \
+        }                                                              \
+    } while (0)
+
+// Print the number of failed checks, 0 if all passed, 1 otherwise
+inline int testResult() {
+    if (testFailures)
+        std::cerr << testFailures << " checks failed" << std::endl;
+    return testFailures != 0;
+}
+
+}  // namespace ART
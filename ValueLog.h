@@ -0,0 +1,331 @@
+/*
+ * ValueLog.h
+ *
+ * Key-value separation for values larger than a payload. Values are appended
+ * to a log of fixed-size segments, mapped from a file or from anonymous
+ * memory, and the tree only stores the 64-bit handle of a value as the
+ * payload of its key. Segments that are mostly dead are garbage collected:
+ * their live values are moved to the head of the log and the leaves of their
+ * keys are pointed at the new copies.
+ */
+
+#pragma once
+
+#include <fcntl.h>     // open, fallocate
+#include <stdint.h>    // integer types
+#include <string.h>    // memcpy, memcmp
+#include <sys/mman.h>  // mmap, munmap
+#include <unistd.h>    // ftruncate, close
+
+#include <stdexcept>
+#include <vector>
+
+#include "ART.h"  // ART, InsertResult
+
+namespace ART {
+
+// A value as stored in the log, valid until its segment is collected
+struct ValueRef {
+    const uint8_t* data;
+    uint32_t size;
+};
+
+class ValueLog {
+   public:
+    // Size of a segment, the largest value with its header must fit in one
+    static const size_t defaultSegmentSize = size_t(1) << 26;
+
+    // A log in anonymous memory, or in the file at path if one is given.
+    // The file is created or truncated
+    explicit ValueLog(const char* path = nullptr,
+                      size_t segmentSize = defaultSegmentSize)
+        : segmentSize(segmentSize), file(-1) {
+        if (segmentSize < 4096 || segmentSize > (size_t(1) << 32) ||
+            segmentSize % 4096 != 0)
+            throw std::invalid_argument(
+                "the segment size must be a multiple of 4 KB up to 4 GB");
+        if (path != nullptr) {
+            file = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+            if (file < 0)
+                throw std::runtime_error("cannot open the value log file");
+        }
+    }
+
+    ~ValueLog() {
+        for (size_t i = 0; i < segments.size(); i++) dropSegment(i);
+        if (file >= 0) close(file);
+    }
+
+    ValueLog(const ValueLog&) = delete;
+    ValueLog& operator=(const ValueLog&) = delete;
+
+    // Append a value of a fixed-length key, returns its handle
+    uint64_t append(uint64_t key, const void* value, uint32_t size) {
+        return append(key, nullptr, 0, value, size);
+    }
+
+    // Append a value of a variable-length key, which is stored with it
+    uint64_t append(const uint8_t key[], unsigned length, const void* value,
+                    uint32_t size) {
+        return append(0, key, length, value, size);
+    }
+
+    // Append the values of fixed-length keys one after the other, with one
+    // capacity check for all that fit the head segment
+    void appendBatch(const uint64_t keys[], const void* const values[],
+                     const uint32_t sizes[], size_t count,
+                     uint64_t handles[]) {
+        size_t i = 0;
+        while (i < count) {
+            size_t bytes = entrySize(0, sizes[i]);
+            size_t end = i + 1;
+            while (end < count && bytes + entrySize(0, sizes[end]) <=
+                                      segmentSize - headUsed())
+                bytes += entrySize(0, sizes[end++]);
+            reserve(bytes);
+            for (; i < end; i++)
+                handles[i] = write(keys[i], nullptr, 0, values[i], sizes[i]);
+        }
+    }
+
+    // The value of a handle
+    ValueRef read(uint64_t handle) const {
+        const Entry* entry = entryOf(handle);
+        const uint8_t* data = reinterpret_cast<const uint8_t*>(entry + 1);
+        return {data + entry->keyLength, entry->size};
+    }
+
+    // The value of a handle is no longer referenced, its bytes are garbage.
+    // A handle into a collected segment was released with it
+    void release(uint64_t handle) {
+        if (segments[handle >> 32].memory == nullptr) return;
+        segments[handle >> 32].deadBytes +=
+            entrySize(entryOf(handle)->keyLength, entryOf(handle)->size);
+    }
+
+    // Store a value for a fixed-length key: append it and point the leaf of
+    // the key at it. A value the key had before becomes garbage, expired or
+    // not
+    void put(ART& tree, uint64_t key, const void* value, uint32_t size) {
+        uint64_t handle = append(key, value, size);
+        releaseReplaced(tree.insert_or_assign(key, handle));
+    }
+
+    void put(ART& tree, const uint8_t key[], unsigned length,
+             const void* value, uint32_t size) {
+        uint64_t handle = append(key, length, value, size);
+        releaseReplaced(tree.insert_or_assign(key, length, handle));
+    }
+
+    // The batch version, the values are appended before the tree is touched
+    void putBatch(ART& tree, const uint64_t keys[], const void* const values[],
+                  const uint32_t sizes[], size_t count) {
+        std::vector<uint64_t> handles(count);
+        appendBatch(keys, values, sizes, count, handles.data());
+        for (size_t i = 0; i < count; i++)
+            releaseReplaced(tree.insert_or_assign(keys[i], handles[i]));
+    }
+
+    // Erase a key from the tree, its value becomes garbage. False if the key
+    // was not in the tree
+    bool erase(ART& tree, uint64_t key) {
+        uint64_t handle;
+        if (!tree.extract(key, handle)) return false;
+        release(handle);
+        return true;
+    }
+
+    bool erase(ART& tree, const uint8_t key[], unsigned length) {
+        ArtNode* leaf = tree.lookup(key, length);
+        if (leaf == nullptr) return false;
+        uint64_t handle = getLeafPayload(leaf);
+        tree.erase(key, length);
+        release(handle);
+        return true;
+    }
+
+    // Erase the expired keys among the next batch keys of an expiring tree,
+    // as ART::reapExpired() does, their values become garbage
+    size_t reapExpired(ART& tree, size_t batch) {
+        return tree.reapExpired(batch,
+                                [this](uint64_t handle) { release(handle); });
+    }
+
+    // The value of a key, a null data pointer if the key is not in the tree
+    ValueRef get(ART& tree, uint64_t key) const {
+        ArtNode* leaf = tree.lookup(key);
+        if (leaf == nullptr) return {nullptr, 0};
+        return read(getLeafPayload(leaf));
+    }
+
+    ValueRef get(ART& tree, const uint8_t key[], unsigned length) const {
+        ArtNode* leaf = tree.lookup(key, length);
+        if (leaf == nullptr) return {nullptr, 0};
+        return read(getLeafPayload(leaf));
+    }
+
+    // Collect every sealed segment with at least minDeadRatio of garbage.
+    // Each entry is looked up by its key; if the leaf still holds its
+    // handle, the value is appended to the head and the leaf gets the new
+    // handle. Keys that expired but are not reaped keep their values, the
+    // reaper releases them. Returns the bytes given back. Handles and
+    // ValueRefs into collected segments become invalid
+    size_t collect(ART& tree, double minDeadRatio = 0.5) {
+        size_t freed = 0;
+        // Segments opened while relocating are not collected in this pass,
+        // and relocating may move the vector of segments
+        size_t sealed = segments.empty() ? 0 : segments.size() - 1;
+        for (size_t i = 0; i < sealed; i++) {
+            char* memory = segments[i].memory;
+            size_t used = segments[i].used;
+            if (memory == nullptr ||
+                segments[i].deadBytes < minDeadRatio * used)
+                continue;
+            for (size_t offset = 0; offset < used;) {
+                const Entry* entry =
+                    reinterpret_cast<const Entry*>(memory + offset);
+                uint64_t handle = uint64_t(i) << 32 | offset;
+                relocate(tree, entry, handle);
+                offset += entrySize(entry->keyLength, entry->size);
+            }
+            freed += segmentSize;
+            dropSegment(i);
+        }
+        return freed;
+    }
+
+    // Bytes of all segments, and the part of them that is garbage
+    size_t bytes() const { return liveSegments * segmentSize; }
+    size_t deadBytes() const {
+        size_t bytes = 0;
+        for (auto& segment : segments)
+            if (segment.memory != nullptr) bytes += segment.deadBytes;
+        return bytes;
+    }
+
+    const size_t segmentSize;
+
+   private:
+    // Header of a value, followed by the bytes of a variable-length key and
+    // those of the value. Entries start on 8 bytes
+    struct Entry {
+        uint64_t key;        // a fixed-length key
+        uint32_t keyLength;  // bytes of a variable-length key, 0 if fixed
+        uint32_t size;       // bytes of the value
+    };
+
+    struct Segment {
+        char* memory;      // null once collected
+        size_t used;       // bytes appended
+        size_t deadBytes;  // bytes of released entries
+    };
+
+    static size_t entrySize(unsigned keyLength, uint32_t size) {
+        return (sizeof(Entry) + keyLength + size + 7) & ~size_t(7);
+    }
+
+    const Entry* entryOf(uint64_t handle) const {
+        return reinterpret_cast<const Entry*>(
+            segments[handle >> 32].memory + uint32_t(handle));
+    }
+
+    size_t headUsed() const {
+        return segments.empty() ? segmentSize : segments.back().used;
+    }
+
+    uint64_t append(uint64_t key, const uint8_t keyBytes[], unsigned length,
+                    const void* value, uint32_t size) {
+        reserve(entrySize(length, size));
+        return write(key, keyBytes, length, value, size);
+    }
+
+    void reserve(size_t bytes) {
+        // Seal the head segment if the bytes do not fit it anymore
+        if (bytes > segmentSize)
+            throw std::invalid_argument("the value is larger than a segment");
+        if (segmentSize - headUsed() < bytes) addSegment();
+    }
+
+    uint64_t write(uint64_t key, const uint8_t keyBytes[], unsigned length,
+                   const void* value, uint32_t size) {
+        Segment& head = segments.back();
+        uint64_t handle = uint64_t(segments.size() - 1) << 32 | head.used;
+        Entry* entry = reinterpret_cast<Entry*>(head.memory + head.used);
+        entry->key = key;
+        entry->keyLength = length;
+        entry->size = size;
+        uint8_t* data = reinterpret_cast<uint8_t*>(entry + 1);
+        if (length) memcpy(data, keyBytes, length);
+        memcpy(data + length, value, size);
+        head.used += entrySize(length, size);
+        return handle;
+    }
+
+    // The value an insert replaced is garbage, that of an expired key too
+    void releaseReplaced(InsertResult result) {
+        if (result.status == InsertStatus::Updated ||
+            result.status == InsertStatus::Replaced)
+            release(result.oldPayload);
+    }
+
+    void relocate(ART& tree, const Entry* entry, uint64_t handle) {
+        // Move the value if the leaf of its key still points at it
+        const uint8_t* data = reinterpret_cast<const uint8_t*>(entry + 1);
+        ArtNode* leaf = entry->keyLength
+                            ? tree.lookup(data, entry->keyLength)
+                            : tree.lookupStored(entry->key);
+        if (leaf == nullptr || getLeafPayload(leaf) != handle) return;
+        uint64_t moved = append(entry->key, data, entry->keyLength,
+                                data + entry->keyLength, entry->size);
+        if (isRecordLeaf(leaf)) {
+            // The lookup found the record, no second descent
+            leafRecord(leaf)->payload = moved;
+        } else if (entry->keyLength) {
+            tree.insert_or_assign(data, entry->keyLength, moved);
+        } else {
+            // A pseudo-leaf, its handle equalled its key
+            tree.insert_or_assign(entry->key, moved);
+        }
+    }
+
+    void addSegment() {
+        // Segments of a file are mapped at their place in it, segment i at
+        // i * segmentSize
+        if (segments.size() >= (size_t(1) << 32))
+            throw std::bad_alloc();
+        void* memory;
+        if (file >= 0) {
+            off_t end = off_t(segments.size() + 1) * segmentSize;
+            if (ftruncate(file, end) != 0)
+                throw std::runtime_error("cannot grow the value log file");
+            memory = mmap(nullptr, segmentSize, PROT_READ | PROT_WRITE,
+                          MAP_SHARED, file, end - off_t(segmentSize));
+        } else {
+            memory = mmap(nullptr, segmentSize, PROT_READ | PROT_WRITE,
+                          MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        }
+        if (memory == MAP_FAILED) throw std::bad_alloc();
+        segments.push_back({static_cast<char*>(memory), 0, 0});
+        liveSegments++;
+    }
+
+    void dropSegment(size_t i) {
+        // Unmap a segment and give its blocks in the file back
+        Segment& segment = segments[i];
+        if (segment.memory == nullptr) return;
+        munmap(segment.memory, segmentSize);
+        segment.memory = nullptr;
+        liveSegments--;
+#ifdef FALLOC_FL_PUNCH_HOLE
+        if (file >= 0)
+            fallocate(file, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE,
+                      off_t(i) * segmentSize, segmentSize);
+#endif
+    }
+
+    int file;  // descriptor of the log file, -1 for anonymous memory
+    size_t liveSegments = 0;        // segments that are mapped
+    std::vector<Segment> segments;  // indexed by the upper half of a handle
+};
+
+}  // namespace ART
@@ -27,16 +27,115 @@ std::vector<key_type> read_bin(const char* filename) {
     return data;
 }
 
+// Print the live nodes per type and the bytes per key of the tree
+void print_memory_stats(const ART::ART* tree) {
+    static const char* names[ART::numNodeTypes] = {
+        "Node4", "Node16", "Node48", "Node256", "NodeBitmap",
+        "NodeInterval", "NodeBucket", "Node8", "Node32"};
+    ART::MemoryStats stats = tree->memoryStats();
+    for (int type = 0; type < ART::numNodeTypes; type++) {
+        if (stats.nodes[type] == 0) continue;
+        cout << names[type] << ": " << stats.nodes[type] << " nodes, "
+             << stats.bytes[type] << " bytes" << endl;
+    }
+    cout << "Leaves: " << stats.leaves << endl;
+    if (stats.records)
+        cout << "Leaf records: " << stats.records << ", " << stats.recordBytes
+             << " bytes" << endl;
+    cout << "Bytes per key: " << stats.bytesPerKey() << endl;
+}
+
+// Print how much of the tree's inner nodes are on huge pages
+void print_page_stats(const ART::ART* tree) {
+    ART::PageStats stats = tree->allocator.pageStats();
+    cout << "Slab bytes: " << stats.slabBytes << endl;
+    cout << "Hugetlbfs bytes: " << stats.hugeTlbBytes << endl;
+    cout << "THP advised bytes: " << stats.advisedBytes << endl;
+    cout << "THP backed bytes: " << stats.transparentBytes << endl;
+    cout << "Huge page fallbacks: " << stats.fallbacks << endl;
+}
+
+// Time the same random lookups through the unrolled descent of lookup() and
+// through the generic one it replaces. Rounds alternate which of both runs
+// first, so neither gets the caches warmed by the other
+void compare_lookup_paths(ART::ART* tree, const vector<uint64_t>& keys,
+                          uint64_t queries, uint64_t minval, uint64_t maxval) {
+    const int rounds = 10;
+    vector<uint64_t> sample(queries);
+    for (uint64_t& key : sample)
+        key = keys[rand() % (maxval - minval + 1) + minval];
+    size_t found = 0;
+    long long unrolled_time = 0, generic_time = 0;
+    for (int round = 0; round < rounds; round++) {
+        for (int pass = 0; pass < 2; pass++) {
+            bool generic = (round + pass) % 2;
+            auto start = chrono::high_resolution_clock::now();
+            for (uint64_t key : sample)
+                found += (generic ? tree->lookupGeneric(key)
+                                  : tree->lookup(key)) != NULL;
+            auto stop = chrono::high_resolution_clock::now();
+            (generic ? generic_time : unrolled_time) +=
+                chrono::duration_cast<chrono::nanoseconds>(stop - start)
+                    .count();
+        }
+    }
+    cout << "Unrolled lookup time: " << unrolled_time / rounds << " ns"
+         << endl;
+    cout << "Generic lookup time: " << generic_time / rounds << " ns"
+         << endl;
+    if (found != 2 * rounds * queries) cerr << "Lookups missed keys" << endl;
+}
+
+// Time rank(), select() and count() on random keys of the tree, and count()
+// against a scan that visits the same ranges. Needs ART_ORDER_STATISTICS
+void time_order_statistics(ART::ART* tree, const vector<uint64_t>& keys,
+                           uint64_t queries, uint64_t minval,
+                           uint64_t maxval) {
+#ifdef ART_ORDER_STATISTICS
+    vector<uint64_t> sample(queries);
+    for (uint64_t& key : sample)
+        key = keys[rand() % (maxval - minval + 1) + minval];
+    uint64_t size = tree->memoryStats().leaves;
+    uint64_t checksum = 0, scanned = 0;
+    auto start = chrono::high_resolution_clock::now();
+    for (uint64_t key : sample) checksum += tree->rank(key);
+    auto ranked = chrono::high_resolution_clock::now();
+    for (uint64_t key : sample)
+        checksum += ART::getLeafValue(tree->select(key % size));
+    auto selected = chrono::high_resolution_clock::now();
+    for (uint64_t key : sample) checksum += tree->count(key, key + 0xFFFF);
+    auto counted = chrono::high_resolution_clock::now();
+    for (uint64_t key : sample)
+        scanned += tree->scan(key, key + 0xFFFF, [](ART::ArtNode*) {});
+    auto stop = chrono::high_resolution_clock::now();
+    auto ns = [](auto from, auto to) {
+        return chrono::duration_cast<chrono::nanoseconds>(to - from).count();
+    };
+    cout << "Rank time: " << ns(start, ranked) << " ns" << endl;
+    cout << "Select time: " << ns(ranked, selected) << " ns" << endl;
+    cout << "Count time: " << ns(selected, counted) << " ns" << endl;
+    cout << "Scan count time: " << ns(counted, stop) << " ns" << endl;
+    cout << "Keys per count: " << scanned / queries << endl;
+    if (checksum == 0) cerr << "Empty tree" << endl;
+#else
+    (void)tree, (void)keys, (void)queries, (void)minval, (void)maxval;
+    cerr << "Order statistics need a build with ART_ORDER_STATISTICS" << endl;
+#endif
+}
+
 int main(int argc, char** argv) {
     bool verbose = false;      // optional argument
     int N = 500000000;         // optional argument
     string input_file;         // required argument
     string tree_type = "ART";  // default tree type
+    bool print_layouts = false;  // optional argument
+    ART::TreeOptions options;    // optional arguments
+    bool compact = false;        // optional argument
+    bool payloads = false;       // optional argument
+    bool generic = false;        // optional argument
+    bool ranks = false;          // optional argument
+    ART::LayoutOrder layout = ART::LayoutOrder::DepthFirst;
 
-    
-    // Query 1% of entries
-    uint64_t minval = 0;
-    uint64_t maxval = N-1;
 
     // Parse arguments; make sure to increment i by 2 if you consume an argument
     for (int i = 1; i < argc;) {
@@ -52,22 +151,78 @@ int main(int argc, char** argv) {
         } else if (string(argv[i]) == "-t") {
             tree_type = argv[i + 1];
             i += 2;
+        } else if (string(argv[i]) == "-l") {
+            print_layouts = true;
+            i++;
+        } else if (string(argv[i]) == "-s") {
+            options.selfKeyed = true;
+            i++;
+        } else if (string(argv[i]) == "-b") {
+            options.bucketSize = atoi(argv[i + 1]);
+            i += 2;
+        } else if (string(argv[i]) == "-k") {
+            options.keyLength = atoi(argv[i + 1]);
+            i += 2;
+        } else if (string(argv[i]) == "-p") {
+            payloads = true;
+            i++;
+        } else if (string(argv[i]) == "-g") {
+            generic = true;
+            i++;
+        } else if (string(argv[i]) == "-r") {
+            ranks = true;
+            i++;
+        } else if (string(argv[i]) == "-c") {
+            string order = argv[i + 1];
+            compact = true;
+            if (order == "veb") {
+                layout = ART::LayoutOrder::VanEmdeBoas;
+            } else if (order != "dfs") {
+                cerr << "Unknown layout order: " << order << endl;
+                return 1;
+            }
+            i += 2;
+        } else if (string(argv[i]) == "-H") {
+            string pages = argv[i + 1];
+            if (pages == "thp") {
+                options.pageMode = ART::PageMode::Transparent;
+            } else if (pages == "hugetlb") {
+                options.pageMode = ART::PageMode::HugeTlb;
+            } else if (pages != "none") {
+                cerr << "Unknown page mode: " << pages << endl;
+                return 1;
+            }
+            i += 2;
         } else {
             i++;
         }
     }
 
-    // read data
-    auto keys = read_bin<uint32_t>(input_file.c_str());
+    // Query 1% of entries, drawn from the N inserted ones
+    uint64_t minval = 0;
+    uint64_t maxval = N - 1;
+
+    // Print the node layout report instead of running a workload
+    if (print_layouts) {
+        ART::printNodeLayouts();
+        return 0;
+    }
+
+    // read data, 32-bit keys are widened
+    vector<uint64_t> keys;
+    if (options.keyLength == 8) {
+        keys = read_bin<uint64_t>(input_file.c_str());
+    } else {
+        vector<uint32_t> narrow = read_bin<uint32_t>(input_file.c_str());
+        keys.assign(narrow.begin(), narrow.end());
+    }
 
     if (tree_type == "ART") {
-        ART::ART* tree = new ART::ART();
+        ART::ART* tree = new ART::ART(options);
         long long insertion_time = 0;
         for (uint64_t i = 0; i < N; i++) {
-            uint8_t key[4];
-            ART::loadKey(keys[i], key);
             auto start = chrono::high_resolution_clock::now();
-            tree->insert(key, keys[i]);
+            tree->insert(keys[i], payloads ? i : keys[i]);
             auto stop = chrono::high_resolution_clock::now();
             auto duration =
                 chrono::duration_cast<chrono::nanoseconds>(stop - start);
@@ -77,17 +232,19 @@ int main(int argc, char** argv) {
         if (verbose) {
             cout << "Tree type: " << tree_type << endl;
             cout << "Insertion time: " << insertion_time << " ns" << endl;
+            print_memory_stats(tree);
         }
 
+        // Lay the tree out again before it is queried
+        if (compact) tree->compact(layout);
+
         srand(time(0));
 
         long long query_time = 0;
         for (uint64_t i = 0; i < (N / 100); i++) {
             int random = rand() % (maxval - minval + 1) + minval;
-            uint8_t key[4];
-            ART::loadKey(keys[random], key);
             auto start = chrono::high_resolution_clock::now();
-            ART::ArtNode* leaf = tree->lookup(key);
+            ART::ArtNode* leaf = tree->lookup(keys[random]);
             auto stop = chrono::high_resolution_clock::now();
             auto duration =
                 chrono::duration_cast<chrono::nanoseconds>(stop - start);
@@ -98,18 +255,20 @@ int main(int argc, char** argv) {
 
         if (verbose) {
             cout << "Query time: " << query_time << " ns" << endl;
+            print_page_stats(tree);
         }
+        if (generic) compare_lookup_paths(tree, keys, N / 100, minval, maxval);
+        if (ranks) time_order_statistics(tree, keys, N / 100, minval, maxval);
 
         // Output the times in csv format, including tree type
         cout << insertion_time << "," << query_time << endl;
+        delete tree;
     } else if (tree_type == "QuART_tail") {
-        ART::QuART_tail* tree = new ART::QuART_tail();
+        ART::QuART_tail* tree = new ART::QuART_tail(options);
         long long insertion_time = 0;
         for (uint64_t i = 0; i < N; i++) {
-            uint8_t key[4];
-            ART::loadKey(keys[i], key);
             auto start = chrono::high_resolution_clock::now();
-            tree->insert(key, keys[i]);
+            tree->insert(keys[i], payloads ? i : keys[i]);
             auto stop = chrono::high_resolution_clock::now();
             auto duration =
                 chrono::duration_cast<chrono::nanoseconds>(stop - start);
@@ -119,17 +278,19 @@ int main(int argc, char** argv) {
         if (verbose) {
             cout << "Tree type: " << tree_type << endl;
             cout << "Insertion time: " << insertion_time << " ns" << endl;
+            print_memory_stats(tree);
         }
 
+        // Lay the tree out again before it is queried
+        if (compact) tree->compact(layout);
+
         srand(time(0));
 
         long long query_time = 0;
         for (uint64_t i = 0; i < (N / 100); i++) {
             int random = rand() % (maxval - minval + 1) + minval;
-            uint8_t key[4];
-            ART::loadKey(keys[random], key);
             auto start = chrono::high_resolution_clock::now();
-            ART::ArtNode* leaf = tree->lookup(key);
+            ART::ArtNode* leaf = tree->lookup(keys[random]);
             auto stop = chrono::high_resolution_clock::now();
             auto duration =
                 chrono::duration_cast<chrono::nanoseconds>(stop - start);
@@ -140,18 +301,20 @@ int main(int argc, char** argv) {
 
         if (verbose) {
             cout << "Query time: " << query_time << " ns" << endl;
+            print_page_stats(tree);
         }
+        if (generic) compare_lookup_paths(tree, keys, N / 100, minval, maxval);
+        if (ranks) time_order_statistics(tree, keys, N / 100, minval, maxval);
 
         // Output the times in csv format, including tree type
         cout << insertion_time << "," << query_time << endl;
+        delete tree;
     } else if (tree_type == "QuART_lil") {
-        ART::QuART_lil* tree = new ART::QuART_lil();
+        ART::QuART_lil* tree = new ART::QuART_lil(options);
         long long insertion_time = 0;
         for (uint64_t i = 0; i < N; i++) {
-            uint8_t key[4];
-            ART::loadKey(keys[i], key);
             auto start = chrono::high_resolution_clock::now();
-            tree->insert(key, keys[i]);
+            tree->insert(keys[i], payloads ? i : keys[i]);
             auto stop = chrono::high_resolution_clock::now();
             auto duration =
                 chrono::duration_cast<chrono::nanoseconds>(stop - start);
@@ -161,17 +324,19 @@ int main(int argc, char** argv) {
         if (verbose) {
             cout << "Tree type: " << tree_type << endl;
             cout << "Insertion time: " << insertion_time << " ns" << endl;
+            print_memory_stats(tree);
         }
 
+        // Lay the tree out again before it is queried
+        if (compact) tree->compact(layout);
+
         srand(time(0));
 
         long long query_time = 0;
         for (uint64_t i = 0; i < (N / 100); i++) {
             int random = rand() % (maxval - minval + 1) + minval;
-            uint8_t key[4];
-            ART::loadKey(keys[random], key);
             auto start = chrono::high_resolution_clock::now();
-            ART::ArtNode* leaf = tree->lookup(key);
+            ART::ArtNode* leaf = tree->lookup(keys[random]);
             auto stop = chrono::high_resolution_clock::now();
             auto duration =
                 chrono::duration_cast<chrono::nanoseconds>(stop - start);
@@ -182,18 +347,20 @@ int main(int argc, char** argv) {
 
         if (verbose) {
             cout << "Query time: " << query_time << " ns" << endl;
+            print_page_stats(tree);
         }
+        if (generic) compare_lookup_paths(tree, keys, N / 100, minval, maxval);
+        if (ranks) time_order_statistics(tree, keys, N / 100, minval, maxval);
 
         // Output the times in csv format, including tree type
         cout << insertion_time << "," << query_time << endl;
+        delete tree;
     } else if (tree_type == "QuART_stail") {
-        ART::QuART_stail* tree = new ART::QuART_stail();
+        ART::QuART_stail* tree = new ART::QuART_stail(options);
         long long insertion_time = 0;
         for (uint64_t i = 0; i < N; i++) {
-            uint8_t key[4];
-            ART::loadKey(keys[i], key);
             auto start = chrono::high_resolution_clock::now();
-            tree->insert(key, keys[i]);
+            tree->insert(keys[i], payloads ? i : keys[i]);
             auto stop = chrono::high_resolution_clock::now();
             auto duration =
                 chrono::duration_cast<chrono::nanoseconds>(stop - start);
@@ -203,17 +370,19 @@ int main(int argc, char** argv) {
         if (verbose) {
             cout << "Tree type: " << tree_type << endl;
             cout << "Insertion time: " << insertion_time << " ns" << endl;
+            print_memory_stats(tree);
         }
 
+        // Lay the tree out again before it is queried
+        if (compact) tree->compact(layout);
+
         srand(time(0));
 
         long long query_time = 0;
         for (uint64_t i = 0; i < (N / 100); i++) {
             int random = rand() % (maxval - minval + 1) + minval;
-            uint8_t key[4];
-            ART::loadKey(keys[random], key);
             auto start = chrono::high_resolution_clock::now();
-            ART::ArtNode* leaf = tree->lookup(key);
+            ART::ArtNode* leaf = tree->lookup(keys[random]);
             auto stop = chrono::high_resolution_clock::now();
             auto duration =
                 chrono::duration_cast<chrono::nanoseconds>(stop - start);
@@ -224,18 +393,20 @@ int main(int argc, char** argv) {
 
         if (verbose) {
             cout << "Query time: " << query_time << " ns" << endl;
+            print_page_stats(tree);
         }
+        if (generic) compare_lookup_paths(tree, keys, N / 100, minval, maxval);
+        if (ranks) time_order_statistics(tree, keys, N / 100, minval, maxval);
 
         // Output the times in csv format, including tree type
         cout << insertion_time << "," << query_time << endl;
+        delete tree;
     } else if (tree_type == "QuART_lil_can") {
-        ART::QuART_lil_can* tree = new ART::QuART_lil_can();
+        ART::QuART_lil_can* tree = new ART::QuART_lil_can(options);
         long long insertion_time = 0;
         for (uint64_t i = 0; i < N; i++) {
-            uint8_t key[4];
-            ART::loadKey(keys[i], key);
             auto start = chrono::high_resolution_clock::now();
-            tree->insert(key, keys[i]);
+            tree->insert(keys[i], payloads ? i : keys[i]);
             auto stop = chrono::high_resolution_clock::now();
             auto duration =
                 chrono::duration_cast<chrono::nanoseconds>(stop - start);
@@ -245,17 +416,19 @@ int main(int argc, char** argv) {
         if (verbose) {
             cout << "Tree type: " << tree_type << endl;
             cout << "Insertion time: " << insertion_time << " ns" << endl;
+            print_memory_stats(tree);
         }
 
+        // Lay the tree out again before it is queried
+        if (compact) tree->compact(layout);
+
         srand(time(0));
 
         long long query_time = 0;
         for (uint64_t i = 0; i < (N / 100); i++) {
             int random = rand() % (maxval - minval + 1) + minval;
-            uint8_t key[4];
-            ART::loadKey(keys[random], key);
             auto start = chrono::high_resolution_clock::now();
-            ART::ArtNode* leaf = tree->lookup(key);
+            ART::ArtNode* leaf = tree->lookup(keys[random]);
             auto stop = chrono::high_resolution_clock::now();
             auto duration =
                 chrono::duration_cast<chrono::nanoseconds>(stop - start);
@@ -266,18 +439,20 @@ int main(int argc, char** argv) {
 
         if (verbose) {
             cout << "Query time: " << query_time << " ns" << endl;
+            print_page_stats(tree);
         }
+        if (generic) compare_lookup_paths(tree, keys, N / 100, minval, maxval);
+        if (ranks) time_order_statistics(tree, keys, N / 100, minval, maxval);
 
         // Output the times in csv format, including tree type
         cout << insertion_time << "," << query_time << endl;
+        delete tree;
     } else if (tree_type == "QuART_stail_reset") {
-        ART::QuART_stail_reset* tree = new ART::QuART_stail_reset();
+        ART::QuART_stail_reset* tree = new ART::QuART_stail_reset(options);
         long long insertion_time = 0;
         for (uint64_t i = 0; i < N; i++) {
-            uint8_t key[4];
-            ART::loadKey(keys[i], key);
             auto start = chrono::high_resolution_clock::now();
-            tree->insert(key, keys[i]);
+            tree->insert(keys[i], payloads ? i : keys[i]);
             auto stop = chrono::high_resolution_clock::now();
             auto duration =
                 chrono::duration_cast<chrono::nanoseconds>(stop - start);
@@ -287,17 +462,19 @@ int main(int argc, char** argv) {
         if (verbose) {
             cout << "Tree type: " << tree_type << endl;
             cout << "Insertion time: " << insertion_time << " ns" << endl;
+            print_memory_stats(tree);
         }
 
+        // Lay the tree out again before it is queried
+        if (compact) tree->compact(layout);
+
         srand(time(0));
 
         long long query_time = 0;
         for (uint64_t i = 0; i < (N / 100); i++) {
             int random = rand() % (maxval - minval + 1) + minval;
-            uint8_t key[4];
-            ART::loadKey(keys[random], key);
             auto start = chrono::high_resolution_clock::now();
-            ART::ArtNode* leaf = tree->lookup(key);
+            ART::ArtNode* leaf = tree->lookup(keys[random]);
             auto stop = chrono::high_resolution_clock::now();
             auto duration =
                 chrono::duration_cast<chrono::nanoseconds>(stop - start);
@@ -308,10 +485,14 @@ int main(int argc, char** argv) {
 
         if (verbose) {
             cout << "Query time: " << query_time << " ns" << endl;
+            print_page_stats(tree);
         }
+        if (generic) compare_lookup_paths(tree, keys, N / 100, minval, maxval);
+        if (ranks) time_order_statistics(tree, keys, N / 100, minval, maxval);
 
         // Output the times in csv format, including tree type
         cout << insertion_time << "," << query_time << endl;
+        delete tree;
     }
     else {
         cerr << "Unknown tree type: " << tree_type << endl;
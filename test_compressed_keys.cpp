@@ -0,0 +1,56 @@
+// Keys at the edge of the 31-bit leaf handles of ART_COMPRESSED_CHILDREN:
+// keys below 2^31 are stored and found, wider ones are refused up front
+// instead of being truncated by the handle
+
+#include <stdint.h>
+
+#include <iostream>
+#include <stdexcept>
+
+#include "ART.h"
+#include "ArtNode.h"
+#include "TestHelper.h"
+#include "trees/QuART_lil.h"
+
+using namespace std;
+
+template <typename Tree>
+void testBoundary(bool selfKeyed) {
+    ART::TreeOptions options;
+    options.selfKeyed = selfKeyed;
+    Tree tree(options);
+    const uint64_t limit = uint64_t(1) << 31;
+
+    // The largest keys a handle holds, dense enough for intervals and
+    // bitmaps in a self-keyed tree
+    for (uint64_t key = limit - 600; key < limit; key++) tree.insert(key);
+    for (uint64_t key = limit - 600; key < limit; key++) {
+        ART::ArtNode* leaf = tree.lookup(key);
+        EXPECT(leaf != NULL && ART::getLeafValue(leaf) == key);
+    }
+    size_t leaves = tree.memoryStats().leaves;
+    EXPECT(leaves == 600);
+
+    const uint64_t widest = UINT32_MAX;
+    for (uint64_t key : {limit, limit + 1, limit + 600, widest - 1, widest}) {
+        bool refused = false;
+        try {
+            tree.insert(key);
+        } catch (const invalid_argument&) {
+            refused = true;
+        }
+        EXPECT(refused);
+        EXPECT(tree.lookup(key) == NULL);
+        EXPECT(!tree.erase(key));
+    }
+    EXPECT(tree.memoryStats().leaves == leaves);
+    EXPECT(tree.lookup(limit - 1) != NULL);
+}
+
+int main() {
+    testBoundary<ART::ART>(false);
+    testBoundary<ART::ART>(true);
+    testBoundary<ART::QuART_lil>(false);
+    testBoundary<ART::QuART_lil>(true);
+    return ART::testResult();
+}
@@ -0,0 +1,148 @@
+// Keys of expiring trees on ART and every QuART variant: expired keys read
+// as absent, an insert that takes one over returns the payload it had, and
+// an erase removes it but reports it absent, iterators and scans skip it,
+// and the reaper erases it
+
+#include <stdint.h>
+
+#include <vector>
+
+#include "ART.h"
+#include "ArtNode.h"
+#include "Iterator.h"
+#include "TestHelper.h"
+#include "trees/QuART_lil.h"
+#include "trees/QuART_lil_can.h"
+#include "trees/QuART_stail.h"
+#include "trees/QuART_stail_reset.h"
+#include "trees/QuART_tail.h"
+
+using namespace std;
+
+static const uint64_t numKeys = 3000;
+
+// Even keys expire at 10, odd ones at 1000
+static uint64_t expiryOf(uint64_t key) { return key % 2 ? 1000 : 10; }
+static uint64_t payloadOf(uint64_t key) { return key * 3 + 1; }
+
+template <typename Tree>
+void fill(Tree& tree, uint64_t stride) {
+    for (uint64_t i = 0; i < numKeys; i++) {
+        uint64_t key = i * stride;
+        ART::InsertResult result =
+            tree.try_insert(key, payloadOf(key), expiryOf(key));
+        EXPECT(result.status == ART::InsertStatus::Inserted);
+    }
+    tree.setClock(10);
+}
+
+// Inserts over expired and live keys
+template <typename Tree>
+void testInsert(unsigned bucketSize, uint64_t stride) {
+    ART::TreeOptions options;
+    options.keyLength = 8;
+    options.bucketSize = bucketSize;
+    options.expiring = true;
+    Tree tree(options);
+    fill(tree, stride);
+    for (uint64_t i = 0; i < numKeys; i++) {
+        uint64_t key = i * stride;
+        ART::ArtNode* leaf = tree.lookup(key);
+        if (key % 2) {
+            EXPECT(leaf != NULL && ART::getLeafPayload(leaf) == payloadOf(key));
+            ART::InsertResult result = tree.try_insert(key, 7, 2000);
+            EXPECT(result.status == ART::InsertStatus::Exists);
+            EXPECT(result.oldPayload == payloadOf(key));
+        } else {
+            EXPECT(leaf == NULL);
+            ART::InsertResult result = tree.insert_or_assign(key, 7, 2000);
+            EXPECT(result.status == ART::InsertStatus::Replaced);
+            EXPECT(result.oldPayload == payloadOf(key));
+            leaf = tree.lookup(key);
+            EXPECT(leaf != NULL && ART::getLeafPayload(leaf) == 7);
+            EXPECT(tree.getExpiry(leaf) == 2000);
+        }
+    }
+    EXPECT(tree.memoryStats().leaves == numKeys);
+}
+
+// Erases of expired and live keys, each removes its key
+template <typename Tree>
+void testErase(unsigned bucketSize, uint64_t stride) {
+    ART::TreeOptions options;
+    options.keyLength = 8;
+    options.bucketSize = bucketSize;
+    options.expiring = true;
+    Tree tree(options);
+    fill(tree, stride);
+    for (uint64_t i = 0; i < numKeys; i++) {
+        uint64_t key = i * stride;
+        if (i % 4 < 2) {
+            EXPECT(tree.erase(key) == (key % 2 == 1));
+        } else {
+            uint64_t payload = 0;
+            EXPECT(tree.extract(key, payload));
+            EXPECT(payload == payloadOf(key));
+        }
+        EXPECT(!tree.erase(key));
+        EXPECT(tree.memoryStats().leaves == numKeys - 1 - i);
+    }
+    EXPECT(tree.root == NULL);
+}
+
+// Ordered access skips the expired keys, the reaper erases them in batches
+// and hands each payload to its callback once
+template <typename Tree>
+void testReap(unsigned bucketSize, uint64_t stride) {
+    ART::TreeOptions options;
+    options.keyLength = 8;
+    options.bucketSize = bucketSize;
+    options.expiring = true;
+    Tree tree(options);
+    fill(tree, stride);
+    ART::Iterator it(tree);
+    uint64_t live = 0;
+    for (bool on = it.seekFirst(); on; on = it.next(), live++)
+        EXPECT(it.key() % 2 == 1 && it.value() == payloadOf(it.key()));
+    EXPECT(live == numKeys / 2);
+    EXPECT(it.seek(uint64_t(0)) && it.key() == stride);
+    size_t scanned = tree.scan(0, ~uint64_t(0), [](ART::ArtNode* leaf) {
+        EXPECT(ART::getLeafValue(leaf) % 2 == 1);
+    });
+    EXPECT(scanned == numKeys / 2);
+
+    vector<uint64_t> reaped;
+    size_t erased = 0;
+    for (int round = 0; round < 100 && erased < numKeys / 2; round++)
+        erased += tree.reapExpired(
+            97, [&reaped](uint64_t payload) { reaped.push_back(payload); });
+    EXPECT(erased == numKeys / 2 && reaped.size() == numKeys / 2);
+    for (size_t i = 0; i < reaped.size(); i++)
+        EXPECT(reaped[i] == payloadOf(i * 2 * stride));
+    EXPECT(tree.reapExpired(numKeys) == 0);
+    EXPECT(tree.memoryStats().leaves == numKeys / 2);
+    for (uint64_t i = 0; i < numKeys; i++) {
+        ART::ArtNode* leaf = tree.lookupStored(i * stride);
+        EXPECT((leaf != NULL) == (i % 2 == 1));
+    }
+}
+
+template <typename Tree>
+void testAll() {
+    for (unsigned bucketSize : {0u, 16u})
+        for (uint64_t stride : {uint64_t(1), uint64_t(0x10001)}) {
+            testInsert<Tree>(bucketSize, stride);
+            testErase<Tree>(bucketSize, stride);
+            testReap<Tree>(bucketSize, stride);
+        }
+}
+
+int main() {
+    testAll<ART::ART>();
+    testAll<ART::QuART_tail>();
+    testAll<ART::QuART_lil>();
+    testAll<ART::QuART_stail>();
+    testAll<ART::QuART_lil_can>();
+    testAll<ART::QuART_stail_reset>();
+    return ART::testResult();
+}
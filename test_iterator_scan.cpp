@@ -0,0 +1,158 @@
+// Ordered access on ART and every QuART variant against a sorted map of the
+// same keys: the iterator in both directions and from seek(), range scans
+// and paged scans that continue across inserts, before and after compact()
+
+#include <stdint.h>
+
+#include <map>
+#include <random>
+#include <vector>
+
+#include "ART.h"
+#include "ArtNode.h"
+#include "Iterator.h"
+#include "TestHelper.h"
+#include "trees/QuART_lil.h"
+#include "trees/QuART_lil_can.h"
+#include "trees/QuART_stail.h"
+#include "trees/QuART_stail_reset.h"
+#include "trees/QuART_tail.h"
+
+using namespace std;
+
+enum Distribution { Clustered, Random, Sequential };
+
+static const int numKeys = 4000;
+
+// A key of a 4-byte tree. Sequential keys are dense enough for intervals
+// and bitmaps
+static uint64_t nextKey(Distribution distribution, mt19937_64& random,
+                        uint64_t& last) {
+    switch (distribution) {
+        case Clustered:
+            return (random() % 256) << 24 | (random() % 3) << 16 |
+                   (random() % 3) << 8 | random() % 16;
+        case Random:
+            return random() & 0xFFFFFFFF;
+        default:
+            last += 1 + (random() % 8 == 0);
+            return last;
+    }
+}
+
+// Self-keyed trees keep the key as its payload
+template <typename Tree>
+uint64_t payloadFor(Tree& tree, uint64_t key) {
+    return tree.selfKeyed ? key : key * 3 + 1;
+}
+
+template <typename Tree>
+void checkIterator(Tree& tree, const map<uint64_t, uint64_t>& keys,
+                   mt19937_64& random) {
+    ART::Iterator it(tree);
+    auto expected = keys.begin();
+    for (bool on = it.seekFirst(); on; on = it.next(), ++expected) {
+        EXPECT(expected != keys.end() && it.key() == expected->first);
+        if (expected == keys.end()) return;
+        EXPECT(it.value() == expected->second);
+    }
+    EXPECT(expected == keys.end());
+
+    auto reverse = keys.rbegin();
+    for (bool on = it.seekLast(); on; on = it.prev(), ++reverse) {
+        EXPECT(reverse != keys.rend() && it.key() == reverse->first);
+        if (reverse == keys.rend()) return;
+    }
+    EXPECT(reverse == keys.rend());
+
+    for (int i = 0; i < 500; i++) {
+        uint64_t key = random() & 0xFFFFFFFF;
+        auto lower = keys.lower_bound(key);
+        EXPECT(it.seek(key) == (lower != keys.end()));
+        if (lower != keys.end()) EXPECT(it.key() == lower->first);
+    }
+}
+
+template <typename Tree>
+void checkScan(Tree& tree, map<uint64_t, uint64_t>& keys,
+               mt19937_64& random) {
+    for (int i = 0; i < 200; i++) {
+        uint64_t lo = random() & 0xFFFFFFFF;
+        uint64_t hi = lo + random() % (uint64_t(1) << (random() % 32));
+        vector<uint64_t> found;
+        tree.scan(lo, hi, [&found](ART::ArtNode* leaf) {
+            found.push_back(ART::getLeafValue(leaf));
+        });
+        vector<uint64_t> expected;
+        for (auto it = keys.lower_bound(lo);
+             it != keys.end() && it->first <= hi; ++it)
+            expected.push_back(it->first);
+        EXPECT(found == expected);
+    }
+
+    // Pages of the whole key space, a key inserted past the last page
+    // between two pages is in a later one
+    vector<uint64_t> found;
+    auto collect = [&found](ART::ArtNode* leaf) {
+        found.push_back(ART::getLeafValue(leaf));
+    };
+    ART::ScanToken token = tree.scan(0, 0xFFFFFFFF, 37, collect);
+    while (!token.done) {
+        uint64_t key = token.next + random() % 1000;
+        if (key <= 0xFFFFFFFF && !keys.count(key)) {
+            tree.insert(key, payloadFor(tree, key));
+            keys[key] = payloadFor(tree, key);
+        }
+        token = tree.scan(token, 37, collect);
+    }
+    vector<uint64_t> expected;
+    for (auto& entry : keys) expected.push_back(entry.first);
+    EXPECT(found == expected);
+}
+
+template <typename Tree>
+void testTree(Distribution distribution, bool selfKeyed, bool buckets) {
+    ART::TreeOptions options;
+    options.keyLength = 4;
+    options.selfKeyed = selfKeyed;
+    if (buckets) options.bucketSize = 16;
+    Tree tree(options);
+    map<uint64_t, uint64_t> keys;
+    mt19937_64 random(distribution * 4 + selfKeyed * 2 + buckets);
+    uint64_t last = 1000;
+    for (int i = 0; i < numKeys; i++) {
+        uint64_t key = nextKey(distribution, random, last);
+        tree.insert(key, payloadFor(tree, key));
+        keys.emplace(key, payloadFor(tree, key));
+        if (random() % 5 == 0) {
+            auto victim = keys.lower_bound(random() & 0xFFFFFFFF);
+            if (victim == keys.end()) victim = keys.begin();
+            EXPECT(tree.erase(victim->first));
+            keys.erase(victim);
+        }
+    }
+    checkIterator(tree, keys, random);
+    checkScan(tree, keys, random);
+    tree.compact(ART::LayoutOrder::VanEmdeBoas);
+    checkIterator(tree, keys, random);
+    checkScan(tree, keys, random);
+}
+
+template <typename Tree>
+void testAll() {
+    for (Distribution distribution : {Clustered, Random, Sequential})
+        for (bool selfKeyed : {false, true})
+            for (bool buckets : {false, true})
+                if (!(selfKeyed && buckets))
+                    testTree<Tree>(distribution, selfKeyed, buckets);
+}
+
+int main() {
+    testAll<ART::ART>();
+    testAll<ART::QuART_tail>();
+    testAll<ART::QuART_lil>();
+    testAll<ART::QuART_stail>();
+    testAll<ART::QuART_lil_can>();
+    testAll<ART::QuART_stail_reset>();
+    return ART::testResult();
+}
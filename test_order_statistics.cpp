@@ -0,0 +1,105 @@
+// Order statistics of ART_ORDER_STATISTICS against a sorted set of the same
+// keys: rank, select and count after inserts and erases of clustered,
+// random and sequential keys, on ART and every QuART variant
+
+#include <stdint.h>
+
+#include <algorithm>
+#include <iterator>
+#include <random>
+#include <set>
+
+#include "ART.h"
+#include "ArtNode.h"
+#include "TestHelper.h"
+#include "trees/QuART_lil.h"
+#include "trees/QuART_lil_can.h"
+#include "trees/QuART_stail.h"
+#include "trees/QuART_stail_reset.h"
+#include "trees/QuART_tail.h"
+
+using namespace std;
+
+enum Distribution { Clustered, Random, Sequential };
+
+static const int numKeys = 4000;
+
+// A key of a 4-byte tree. Clustered keys fall in a few groups below each
+// top byte, so inserts keep splitting the prefixes of small subtrees
+static uint64_t nextKey(Distribution distribution, mt19937_64& random,
+                        uint64_t& last) {
+    switch (distribution) {
+        case Clustered:
+            return (random() % 256) << 24 | (random() % 3) << 16 |
+                   (random() % 3) << 8 | random() % 16;
+        case Random:
+            return random() & 0xFFFFFFFF;
+        default:
+            last += 1 + random() % 3;
+            return last;
+    }
+}
+
+// Every key has its rank, select of it is the key, and ranges count the
+// keys of the set between their bounds
+template <typename Tree>
+void check(Tree& tree, const set<uint64_t>& keys, mt19937_64& random) {
+    uint64_t rank = 0;
+    for (uint64_t key : keys) {
+        EXPECT(tree.rank(key) == rank);
+        ART::ArtNode* leaf = tree.select(tree.rank(key));
+        EXPECT(leaf != NULL && ART::getLeafValue(leaf) == key);
+        rank++;
+    }
+    EXPECT(tree.select(keys.size()) == NULL);
+    for (int i = 0; i < 500; i++) {
+        uint64_t lo = random() & 0xFFFFFFFF;
+        uint64_t hi = lo + random() % (uint64_t(1) << (random() % 32));
+        uint64_t want = distance(keys.lower_bound(lo), keys.upper_bound(hi));
+        EXPECT(tree.count(lo, hi) == want);
+    }
+}
+
+template <typename Tree>
+void testTree(Distribution distribution, bool selfKeyed, bool buckets) {
+    ART::TreeOptions options;
+    options.keyLength = 4;
+    options.selfKeyed = selfKeyed;
+    if (buckets) options.bucketSize = 16;
+    Tree tree(options);
+    set<uint64_t> keys;
+    mt19937_64 random(distribution * 4 + selfKeyed * 2 + buckets);
+    uint64_t last = 1000;
+    for (int i = 0; i < numKeys; i++) {
+        uint64_t key = nextKey(distribution, random, last);
+        tree.insert(key);
+        keys.insert(key);
+        // Erase now and then, the fast path is repaired in between
+        if (random() % 5 == 0) {
+            auto victim = keys.lower_bound(random() & 0xFFFFFFFF);
+            if (victim == keys.end()) victim = keys.begin();
+            EXPECT(tree.erase(*victim));
+            keys.erase(victim);
+        }
+    }
+    check(tree, keys, random);
+}
+
+template <typename Tree>
+void testAll() {
+    for (Distribution distribution : {Clustered, Random, Sequential})
+        for (bool selfKeyed : {false, true})
+            for (bool buckets : {false, true})
+                if (!(selfKeyed && buckets))
+                    testTree<Tree>(distribution, selfKeyed, buckets);
+}
+
+int main() {
+    testAll<ART::ART>();
+    testAll<ART::QuART_tail>();
+    testAll<ART::QuART_lil>();
+    testAll<ART::QuART_stail>();
+    testAll<ART::QuART_lil_can>();
+    testAll<ART::QuART_stail_reset>();
+    return ART::testResult();
+}
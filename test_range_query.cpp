@@ -45,11 +45,13 @@ int main(int argc, char** argv) {
 
     // Build tree
 
-    ART::ART* tree = new ART::ART();
+    ART::TreeOptions options;
+    options.keyLength = 8;
+    ART::ART* tree = new ART::ART(options);
     long long insertion_time = 0;
     for (uint64_t i = 0; i < N; i++) {
         uint8_t key[8];
-        ART::loadKey(keys[i], key);
+        ART::loadKey(keys[i], key, 8);
         auto start = chrono::high_resolution_clock::now();
         tree->insert(key, keys[i]);
         auto stop = chrono::high_resolution_clock::now();
@@ -68,8 +70,8 @@ int main(int argc, char** argv) {
     // Range Queries
     for (uint64_t i = 4; i < N / 10; i++) {
         uint8_t key[8], key2[8];
-        ART::loadKey(keys[i], key);
-        ART::loadKey(std::min((uint64_t)N - 1, keys[i] + 133), key2);
+        ART::loadKey(keys[i], key, 8);
+        ART::loadKey(std::min((uint64_t)N - 1, keys[i] + 133), key2, 8);
         auto start = chrono::high_resolution_clock::now();
         ART::Chain* ch = tree->rangelookup(key, 8, key2, 8, 8);
 
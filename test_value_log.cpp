@@ -0,0 +1,129 @@
+// Values of erased, reaped and overwritten keys become garbage of the value
+// log, and a segment that holds enough of them is collected. Values of keys
+// that expired but were not reaped move with the live ones
+
+#include <stdint.h>
+#include <string.h>
+
+#include <iostream>
+#include <vector>
+
+#include "ART.h"
+#include "TestHelper.h"
+#include "ValueLog.h"
+#include "trees/QuART_lil.h"
+
+using namespace std;
+
+static const uint32_t valueSize = 200;
+static const uint64_t numKeys = 200;
+
+// The value of a key, its bytes derived from the key
+static vector<uint8_t> valueOf(uint64_t key) {
+    vector<uint8_t> value(valueSize);
+    for (uint32_t i = 0; i < valueSize; i++) value[i] = uint8_t(key * 7 + i);
+    return value;
+}
+
+static bool holds(ART::ValueRef ref, uint64_t key) {
+    vector<uint8_t> value = valueOf(key);
+    return ref.data != nullptr && ref.size == valueSize &&
+           memcmp(ref.data, value.data(), valueSize) == 0;
+}
+
+// Erase the keys of the first half of the log, whose segments then hold
+// nothing but garbage
+template <typename Tree>
+void testErase() {
+    ART::TreeOptions options;
+    options.keyLength = 8;
+    Tree tree(options);
+    ART::ValueLog log(nullptr, 4096);
+    for (uint64_t key = 0; key < numKeys; key++)
+        log.put(tree, key, valueOf(key).data(), valueSize);
+    size_t before = log.bytes();
+    EXPECT(log.deadBytes() == 0);
+
+    for (uint64_t key = 0; key < numKeys / 2; key++)
+        EXPECT(log.erase(tree, key));
+    EXPECT(!log.erase(tree, 0));
+    EXPECT(log.get(tree, 0).data == nullptr);
+    EXPECT(log.deadBytes() > 0);
+
+    size_t freed = log.collect(tree);
+    EXPECT(freed > 0);
+    EXPECT(log.bytes() < before);
+    for (uint64_t key = numKeys / 2; key < numKeys; key++)
+        EXPECT(holds(log.get(tree, key), key));
+}
+
+// Let the first half of the keys expire and reap them
+void testReap() {
+    ART::TreeOptions options;
+    options.keyLength = 8;
+    options.expiring = true;
+    ART::ART tree(options);
+    ART::ValueLog log(nullptr, 4096);
+    for (uint64_t key = 0; key < numKeys; key++) {
+        uint64_t handle = log.append(key, valueOf(key).data(), valueSize);
+        tree.try_insert(key, handle, key < numKeys / 2 ? 10 : 1000);
+    }
+    size_t before = log.bytes();
+    tree.setClock(10);
+    EXPECT(log.reapExpired(tree, numKeys) == numKeys / 2);
+    EXPECT(log.deadBytes() > 0);
+
+    size_t freed = log.collect(tree);
+    EXPECT(freed > 0);
+    EXPECT(log.bytes() < before);
+    EXPECT(tree.memoryStats().leaves == numKeys / 2);
+    for (uint64_t key = numKeys / 2; key < numKeys; key++)
+        EXPECT(holds(log.get(tree, key), key));
+}
+
+// Collect the segments of expired keys that are not reaped yet, then
+// overwrite, erase and reap those keys
+template <typename Tree>
+void testExpiredCollect() {
+    ART::TreeOptions options;
+    options.keyLength = 8;
+    options.expiring = true;
+    Tree tree(options);
+    ART::ValueLog log(nullptr, 4096);
+    for (uint64_t key = 0; key < numKeys; key++) {
+        uint64_t handle = log.append(key, valueOf(key).data(), valueSize);
+        tree.try_insert(key, handle, key % 2 ? 1000 : 10);
+    }
+    // The segments of the first half are half garbage then
+    for (uint64_t key = 1; key < numKeys / 2; key += 2)
+        EXPECT(log.erase(tree, key));
+    tree.setClock(10);
+    EXPECT(log.collect(tree, 0.4) > 0);
+
+    // The values of the expired keys were moved with the live ones
+    size_t dead = log.deadBytes();
+    log.put(tree, 0, valueOf(numKeys).data(), valueSize);
+    EXPECT(log.deadBytes() > dead);
+    EXPECT(holds(log.get(tree, 0), numKeys));
+    dead = log.deadBytes();
+    EXPECT(log.erase(tree, 2));
+    EXPECT(log.deadBytes() > dead);
+    dead = log.deadBytes();
+    EXPECT(log.reapExpired(tree, numKeys) == numKeys / 2 - 2);
+    EXPECT(log.deadBytes() > dead);
+
+    EXPECT(log.collect(tree) > 0);
+    EXPECT(holds(log.get(tree, 0), numKeys));
+    for (uint64_t key = numKeys / 2 + 1; key < numKeys; key += 2)
+        EXPECT(holds(log.get(tree, key), key));
+    EXPECT(tree.memoryStats().leaves == numKeys / 4 + 1);
+}
+
+int main() {
+    testErase<ART::ART>();
+    testErase<ART::QuART_lil>();
+    testReap();
+    testExpiredCollect<ART::ART>();
+    testExpiredCollect<ART::QuART_lil>();
+    return ART::testResult();
+}
@@ -37,47 +37,66 @@ namespace ART {
 class QuART_lil : public ART {
    public:
     // constructor
-    QuART_lil() : ART() {}
+    explicit QuART_lil(const TreeOptions& options = TreeOptions())
+        : ART(options) {}
 
     // function to determine if a given key fits on the current fast path
-    bool canLilInsert(uint8_t key[]) {
+    bool canLilInsert(uintptr_t value) {
         // if root is null or root is a leaf, we cannot lil insert
         if (this->root == NULL || isLeaf(this->root)) {
             return false;
         }
-        int fpLeafValue = getLeafValue(this->fp_leaf);
-        // convert int value in fp leaf into byte array
-        std::array<uint8_t, maxPrefixLength> leafArr = intToArr(fpLeafValue);
-        // use memcmp for fast comparison
-        return memcmp(key, leafArr.data(), maxPrefixLength - 1) == 0;
+        // compare every byte but the last with the fp leaf at once
+        return onFastPath(value);
     }
 
-    void insert(uint8_t key[], uintptr_t value) {
+    ArtNode* lookup(uint8_t key[]) { return ART::lookup(key); }
+
+    ArtNode* lookup(uint64_t key) { return ART::lookup(key); }
+
+   private:
+    void insertValue(uint8_t key[], uintptr_t value) override {
         // Check if the fast path exists and if the new key fits on the fast
-        // path.
-        if (fp != NULL) {
-            bool onFastPath = canLilInsert(key);
+        // path. After an erase the fast path may end in a root leaf
+        if (fp != NULL && !isLeaf(fp)) {
+            bool onFastPath = canLilInsert(value);
             bool isFull;
             switch (fp->type) {
                 case NodeType4:
                     isFull = fp->count == 4;
                     break;
+                case NodeType8:
+                    isFull = fp->count == 8;
+                    break;
                 case NodeType16:
                     isFull = fp->count == 16;
                     break;
+                case NodeType32:
+                    isFull = fp->count == 32;
+                    break;
                 case NodeType48:
                     isFull = fp->count == 48;
                     break;
                 case NodeType256:
                     isFull = fp->count == 256;
                     break;
+                case NodeTypeBitmap:
+                case NodeTypeInterval:
+                case NodeTypeBucket:
+                    // These hold every key byte or burst on their own
+                    isFull = false;
+                    break;
             };
             // Ff the new key fits on the fast path and the fast path node is
             // not full, insert to the fast path
             if (onFastPath && !isFull) {
-                // Insert from the end of the fast path.
+                // Insert from the end of the fast path. The nodes above fp
+                // are counted after the insert below it
+                NodeRef* ref = fp_ref;
+                size_t above = fp_path_length - 1;
                 insertRecursive(this, fp, fp_ref, key, fp_depth, value,
-                                maxPrefixLength, true);
+                                keyLength, true);
+                countInsert(ref, above);
                 return;
             }
         }
@@ -92,23 +111,13 @@ class QuART_lil : public ART {
         fp_path[0] = root;
         fp_path_ref[0] = &root;
         fp_leaf = NULL;
-        insertRecursive(this, root, &root, key, 0, value, maxPrefixLength,
+        insertRecursive(this, root, &root, key, 0, value, keyLength,
                         true);
+        countInsert(&root);
     }
 
-    ArtNode* lookup(uint8_t key[]) {
-        return lookup(root, key, maxPrefixLength, 0, maxPrefixLength);
-    }
-
-    Chain* rangelookup(uint8_t l_key[], unsigned l_keyLength, uint8_t h_key[],
-                       uint8_t h_keyLength, unsigned maxKeyLength) {
-        return rangelookup(root, l_key, l_keyLength, h_key, h_keyLength,
-                           maxKeyLength);
-    }
-
-   private:
     // Void insert function
-    void insertRecursive(QuART_lil* tree, ArtNode* node, ArtNode** nodeRef,
+    void insertRecursive(QuART_lil* tree, ArtNode* node, NodeRef* nodeRef,
                          uint8_t key[], unsigned depth, uintptr_t value,
                          unsigned maxKeyLength, bool firstCall) {
         // Insert the leaf value into the tree
@@ -117,23 +126,60 @@ class QuART_lil : public ART {
         // Do not alter fp values aside from fp_leaf; fp should only refer to
         // internal nodes, not leaf nodes.
         if (node == NULL) {
-            ArtNode* newLeaf = makeLeaf(value);
+            ArtNode* newLeaf = addLeaf(value);
             *nodeRef = newLeaf;
             fp_leaf = newLeaf;
             return;
         }
 
+        // The key is already in the tree. Leaves below the root are found
+        // before the recursion reaches them, this one is the root and the
+        // fast path stays empty as for a single key
+        if (isLeaf(node) && isFoundLeaf(nodeRef, value)) {
+            fp = NULL;
+            fp_leaf = node;
+            return;
+        }
+
+        if (isLeaf(node) && bucketLevel(depth)) {
+            // Gather the colliding leaves in a bucket instead
+            node = newBucket(nodeRef, node, depth);
+        }
+
         if (isLeaf(node)) {
             // If the current node is a leaf, make a new Node4 and store both
             // the current leaf and the one made for the new entry in it.
             uint8_t existingKey[maxKeyLength];
-            loadKey(getLeafValue(node), existingKey);
+            loadKey(getLeafValue(node), existingKey, maxKeyLength);
             unsigned newPrefixLength = 0;
             while (existingKey[depth + newPrefixLength] ==
                    key[depth + newPrefixLength])
                 newPrefixLength++;
 
-            Node4* newNode = new Node4();
+            if (bitmapLevel(depth + newPrefixLength)) {
+                // Store both leaves as bits of a bitmap node instead
+                NodeBitmap* newNode =
+                    newBitmapNode(nodeRef, node, key, depth, newPrefixLength);
+                newNode->insertBitmap(this, nodeRef,
+                                      existingKey[depth + newPrefixLength]);
+                newNode->insertBitmap(this, nodeRef,
+                                      key[depth + newPrefixLength]);
+
+                // update the fast path to include the new bitmap node.
+                fp = newNode;
+                fp_ref = nodeRef;
+                // A root leaf that was expanded leaves the new node alone on it
+                unsigned index = nodeRef == &root ? 0 : fp_path_length;
+                fp_path[index] = newNode;
+                fp_path_ref[index] = nodeRef;
+                fp_path_length = index + 1;
+                fp_leaf.setKey(value);
+                fp_depth = depth;
+
+                return;
+            }
+
+            Node4* newNode = allocNode<Node4>(this);
             newNode->prefixLength = newPrefixLength;
             memcpy(newNode->prefix, key + depth,
                    min(newPrefixLength, maxPrefixLength));
@@ -141,23 +187,41 @@ class QuART_lil : public ART {
 
             newNode->lilInsertNode4(this, nodeRef,
                                     existingKey[depth + newPrefixLength], node);
-            ArtNode* newLeaf = makeLeaf(value);
+            ArtNode* newLeaf = addLeaf(value);
             newNode->lilInsertNode4(this, nodeRef, key[depth + newPrefixLength],
                                     newLeaf);
 
             // update the fast path to include the new node4.
             fp = newNode;
             fp_ref = nodeRef;
-            unsigned index = isLeaf(root) ? 0 : fp_path_length;
+            // A root leaf that was expanded leaves the new node alone on it
+            unsigned index = nodeRef == &root ? 0 : fp_path_length;
             fp_path[index] = newNode;
             fp_path_ref[index] = nodeRef;
-            fp_path_length++;
+            fp_path_length = index + 1;
             fp_leaf = newLeaf;
             fp_depth = depth;
 
             return;
         }
 
+        if (isTerminal(node)) {
+            // Add to the interval or bucket in place, or split it and insert
+            // below. A bucket may have moved to a larger node
+            if (insertIntoTerminal(nodeRef, node, value)) {
+                if (!firstCall) {
+                    fp = *nodeRef;
+                    fp_ref = nodeRef;
+                    fp_path[fp_path_length] = *nodeRef;
+                    fp_path_ref[fp_path_length] = nodeRef;
+                    fp_path_length++;
+                }
+                fp_leaf.setKey(value);
+                return;
+            }
+            node = *nodeRef;
+        }
+
         // Handle prefix of inner node
         if (node->prefixLength) {
             unsigned mismatchPos =
@@ -167,7 +231,7 @@ class QuART_lil : public ART {
                 // the key, a split must be created.
                 // Create a new internal node to hold the current node and the
                 // new leaf
-                Node4* newNode = new Node4();
+                Node4* newNode = allocNode<Node4>(this);
                 *nodeRef = newNode;
                 newNode->prefixLength = mismatchPos;
                 memcpy(newNode->prefix, node->prefix,
@@ -183,22 +247,26 @@ class QuART_lil : public ART {
                 } else {
                     node->prefixLength -= (mismatchPos + 1);
                     uint8_t minKey[maxKeyLength];
-                    loadKey(getLeafValue(minimum(node)), minKey);
+                    loadKey(getLeafValue(minimum(node)), minKey, maxKeyLength);
                     newNode->lilInsertNode4(this, nodeRef,
                                             minKey[depth + mismatchPos], node);
                     memmove(node->prefix, minKey + depth + mismatchPos + 1,
                             min(node->prefixLength, maxPrefixLength));
                 }
 
-                ArtNode* newLeaf = makeLeaf(value);
+                ArtNode* newLeaf = addLeaf(value);
                 newNode->lilInsertNode4(this, nodeRef, key[depth + mismatchPos],
                                         newLeaf);
 
-                // Update the fast path to include the new node4.
+                // Update the fast path to include the new node4. It takes the
+                // place of the fast-path node it split on the first call;
+                // below it the node was not on the path yet
+                unsigned index =
+                    firstCall ? fp_path_length - 1 : fp_path_length++;
                 fp = newNode;
                 fp_ref = nodeRef;
-                fp_path[fp_path_length - 1] = newNode;
-                fp_path_ref[fp_path_length - 1] = nodeRef;
+                fp_path[index] = newNode;
+                fp_path_ref[index] = nodeRef;
                 fp_leaf = newLeaf;
 
                 return;
@@ -217,36 +285,34 @@ class QuART_lil : public ART {
         }
 
         // Recurse
-        ArtNode** child = findChild(node, key[depth]);
+        NodeRef* child = findChild(node, key[depth]);
         if (*child) {
+            // The key is already in the tree, its leaf becomes the fp leaf
+            if (isLeaf(*child) && isFoundLeaf(child, value)) {
+                fp_leaf = *child;
+                return;
+            }
             // Only update fp_depth with the prefix of the second-to-last node
             // of the fast path; the prefix of the last node does not factor in
             fp_depth += node->prefixLength + 1;
             insertRecursive(tree, *child, child, key, depth + 1, value,
                             maxKeyLength, false);
+            countInsert(child);
             return;
         }
 
         // Insert leaf into inner node
-        ArtNode* newLeaf = makeLeaf(value);
-        fp_leaf = newLeaf;
+        fp_leaf.setKey(value);
 
         switch (node->type) {
-            case NodeType4:
-                static_cast<Node4*>(node)->lilInsertNode4(this, nodeRef,
-                                                          key[depth], newLeaf);
-                break;
-            case NodeType16:
-                static_cast<Node16*>(node)->lilInsertNode16(
-                    this, nodeRef, key[depth], newLeaf);
-                break;
-            case NodeType48:
-                static_cast<Node48*>(node)->lilInsertNode48(
-                    this, nodeRef, key[depth], newLeaf);
+            case NodeTypeBitmap:
+                static_cast<NodeBitmap*>(node)->insertBitmap(this, nodeRef,
+                                                             key[depth]);
                 break;
-            case NodeType256:
-                static_cast<Node256*>(node)->lilInsertNode256(
-                    this, nodeRef, key[depth], newLeaf);
+            default:
+                // Inner nodes of every type on the growth ladder
+                lilInsertChild(this, nodeRef, node, key[depth],
+                               addLeaf(value));
                 break;
         }
     }
@@ -264,23 +330,30 @@ class QuART_lil : public ART {
                 if (!skippedPrefix && depth == keyLength)  // No check required
                     return node;
 
-                if (depth != keyLength) {
-                    // Check leaf
-                    uint8_t leafKey[maxKeyLength];
-                    loadKey(getLeafValue(node), leafKey);
-                    for (unsigned i = (skippedPrefix ? 0 : depth);
-                         i < keyLength; i++)
-                        if (leafKey[i] != key[i]) return NULL;
-                }
-                return node;
+                // Check leaf, all of it if some prefix was skipped
+                if (leafMatches(node, key, keyLength,
+                                skippedPrefix ? 0 : depth, maxKeyLength))
+                    return node;
+                return NULL;
+            }
+
+            if (isTerminal(node)) {
+                // Full keys are compared, no skipped prefix needs checking
+                return lookupTerminal(node, key, keyLength);
             }
 
             if (node->prefixLength) {
                 if (node->prefixLength < maxPrefixLength) {
                     for (unsigned pos = 0; pos < node->prefixLength; pos++)
                         if (key[depth + pos] != node->prefix[pos]) return NULL;
-                } else
+                } else {
+                    // Compare the bytes kept in the node and skip the rest,
+                    // the leaf is checked instead
+                    if (depth + node->prefixLength >= keyLength) return NULL;
+                    for (unsigned pos = 0; pos < maxPrefixLength; pos++)
+                        if (key[depth + pos] != node->prefix[pos]) return NULL;
                     skippedPrefix = true;
+                }
                 depth += node->prefixLength;
             }
 
@@ -291,134 +364,6 @@ class QuART_lil : public ART {
         return NULL;
     }
 
-    // Erase function, deletes a leaf from the tree
-    void erase(ArtNode* node, ArtNode** nodeRef, uint8_t key[],
-               unsigned keyLength, unsigned depth, unsigned maxKeyLength) {
-        // Delete a leaf from a tree
-
-        if (!node) return;
-
-        if (isLeaf(node)) {
-            // Make sure we have the right leaf
-            if (leafMatches(node, key, keyLength, depth, maxKeyLength))
-                *nodeRef = NULL;
-            return;
-        }
-
-        // Handle prefix
-        if (node->prefixLength) {
-            if (prefixMismatch(node, key, depth, maxKeyLength) !=
-                node->prefixLength)
-                return;
-            depth += node->prefixLength;
-        }
-
-        ArtNode** child = findChild(node, key[depth]);
-        if (isLeaf(*child) &&
-            leafMatches(*child, key, keyLength, depth, maxKeyLength)) {
-            // Leaf found, delete it in inner node
-            switch (node->type) {
-                case NodeType4:
-                    static_cast<Node4*>(node)->eraseNode4(this, nodeRef, child);
-                    break;
-                case NodeType16:
-                    static_cast<Node16*>(node)->eraseNode16(this, nodeRef,
-                                                            child);
-                    break;
-                case NodeType48:
-                    static_cast<Node48*>(node)->eraseNode48(this, nodeRef,
-                                                            key[depth]);
-                    break;
-                case NodeType256:
-                    static_cast<Node256*>(node)->eraseNode256(this, nodeRef,
-                                                              key[depth]);
-                    break;
-            }
-        } else {
-            // Recurse
-            erase(*child, child, key, keyLength, depth + 1, maxKeyLength);
-        }
-    }
-
-    // Range lookup function, returns a Chain of ArtNode
-    Chain* rangelookup(ArtNode* node, uint8_t l_key[], unsigned l_keyLength,
-                       uint8_t h_key[], uint8_t h_keyLength,
-                       unsigned maxKeyLength) {
-        // Find the node with a matching key, optimistic version
-        Chain* queue =
-            new Chain((ChainItem*)new ChainItemWithDepth(node, 0, true, true));
-        Chain* result = new Chain();
-
-        while (!queue->isEmpty()) {
-            ChainItemWithDepth* item = (ChainItemWithDepth*)queue->pop_front();
-            node = item->nodeptr();
-
-            int depth = item->depth_;
-            bool lequ = item->lequ_, hequ = item->hequ_;
-            bool continue_flag =
-                0;  // true means the range vialates the key range
-            unsigned pos;
-            auto compare_and_set = [&](unsigned pos,
-                                       uint8_t compared_byte) -> void {
-                uint8_t lkey = pos >= l_keyLength ? 0 : l_key[pos];
-                uint8_t hkey = pos >= h_keyLength ? 0 : l_key[pos];
-
-                if (lkey < compared_byte)
-                    lequ = 0;
-                else if (lkey > compared_byte)
-                    continue_flag = 1;
-
-                if (hkey < compared_byte)
-                    continue_flag = 1;
-                else if (hkey > compared_byte)
-                    hequ = 0;
-            };
-            if (isLeaf(node)) {
-                uint8_t leafKey[maxKeyLength];
-                loadKey(getLeafValue(node), leafKey);
-                for (unsigned i = depth;
-                     i < maxKeyLength && !continue_flag && (lequ || hequ); i++)
-                    compare_and_set(i, leafKey[i]);
-                if (!continue_flag) {
-                    result->extend_item(new ChainItem(node));
-                }
-                continue;
-            }
-
-            if (node->prefixLength > maxPrefixLength) {
-                for (pos = 0;
-                     pos < maxPrefixLength && !continue_flag && (lequ || hequ);
-                     pos++) {
-                    compare_and_set(depth + pos, node->prefix[pos]);
-                }
-                uint8_t minKey[maxKeyLength];
-                loadKey(getLeafValue(minimum(node)), minKey);
-                for (; pos < node->prefixLength && !continue_flag &&
-                       (lequ || hequ);
-                     pos++) {
-                    compare_and_set(depth + pos, minKey[depth + pos]);
-                }
-            } else {
-                for (pos = 0; pos < node->prefixLength && !continue_flag &&
-                              (lequ || hequ);
-                     pos++) {
-                    compare_and_set(depth + pos, node->prefix[pos]);
-                }
-            }
-            if (continue_flag) continue;
-            depth += node->prefixLength;
-
-            std::unique_ptr<Chain> newly_added = std::make_unique<Chain>();
-            newly_added =
-                std::move(std::unique_ptr<Chain>(newly_added->findChildbyRange(
-                    item->nodeptr(), lequ ? l_key[depth] : 0,
-                    hequ ? h_key[depth] : 255, depth, lequ, hequ)));
-            queue->extend(std::move(newly_added));
-        }
-        delete queue;
-        return result;
-    }
-
    public:
     void printTree() { printTree(this->root, 0); }
 
@@ -442,6 +387,14 @@ class QuART_lil : public ART {
                 }
                 break;
             }
+            case NodeType8: {
+                Node8* n = static_cast<Node8*>(node);
+                printf("Node8 [%p]\n", static_cast<void*>(n));
+                for (unsigned i = 0; i < n->count; i++) {
+                    printTree(n->child[i], depth + 1);
+                }
+                break;
+            }
             case NodeType16: {
                 Node16* n = static_cast<Node16*>(node);
                 printf("Node16 [%p]\n", static_cast<void*>(n));
@@ -450,6 +403,14 @@ class QuART_lil : public ART {
                 }
                 break;
             }
+            case NodeType32: {
+                Node32* n = static_cast<Node32*>(node);
+                printf("Node32 [%p]\n", static_cast<void*>(n));
+                for (unsigned i = 0; i < n->count; i++) {
+                    printTree(n->child[i], depth + 1);
+                }
+                break;
+            }
             case NodeType48: {
                 Node48* n = static_cast<Node48*>(node);
                 printf("Node48 [%p]\n", static_cast<void*>(n));
@@ -470,6 +431,26 @@ class QuART_lil : public ART {
                 }
                 break;
             }
+            case NodeTypeBitmap: {
+                NodeBitmap* n = static_cast<NodeBitmap*>(node);
+                printf("NodeBitmap [%p]\n", static_cast<void*>(n));
+                for (unsigned i = n->nextSet(0); i < 256; i = n->nextSet(i + 1))
+                    printTree(n->leaf(i), depth + 1);
+                break;
+            }
+            case NodeTypeInterval: {
+                NodeInterval* n = static_cast<NodeInterval*>(node);
+                printf("NodeInterval [%p] [%lu, %lu]\n", static_cast<void*>(n),
+                       n->lo, n->hi);
+                break;
+            }
+            case NodeTypeBucket: {
+                NodeBucket* n = static_cast<NodeBucket*>(node);
+                printf("NodeBucket [%p]\n", static_cast<void*>(n));
+                for (unsigned i = 0; i < n->count; i++)
+                    printTree(n->child[i], depth + 1);
+                break;
+            }
         }
     }
 };
@@ -7,39 +7,22 @@ namespace ART {
 
 class QuART_lil_can : public ART {
    public:
-    QuART_lil_can() : ART() {}
-
-    void insert(uint8_t key[], uintptr_t value) {
-        // Check if we can lil insert
+    explicit QuART_lil_can(const TreeOptions& options = TreeOptions())
+        : ART(options) {}
+
+   private:
+    void insertValue(uint8_t key[], uintptr_t value) override {
+        // We can lil insert if the root is not null, is not a leaf and the
+        // key matches the fp leaf in every byte but the last. Otherwise we
+        // lil insert from root
         ArtNode* root = this->root;
-        // Check if the root is not null and is not a leaf
-        if (root != nullptr && !isLeaf(root)) {
-            int leafValue = getLeafValue(this->fp_leaf);
-            // For each byte in the key excluding the last byte,
-            // check if it matches the corresponding byte in the leaf value
-            // If any byte does not match, set can_lil_insert to false
-            for (size_t i = 0; i < maxPrefixLength - 1; ++i) {
-                uint8_t leafByte =
-                    (leafValue >> (8 * (maxPrefixLength - 1 - i))) & 0xFF;
-                if (leafByte != key[i]) {
-                    //counter2++; 
-                    // If the key differs from leafByte earlier, we lil insert
-                    // from root
-                    this->fp_path = {this->root};
-                    this->fp_path_length = 1;
-                    QuART_lil_can::insert_recursive_change_fp(
-                        this->root, &this->root, key, 0, value,
-                        maxPrefixLength);
-                    return;
-                }
-            }
-        } else {
+        if (root == nullptr || isLeaf(root) || !onFastPath(value)) {
             //counter2++;
-            // If the root is null or is a leaf, we cannot lil insert
-            fp_path = {this->root};
-            fp_path_length = 1;
+            this->fp_path = {this->root};
+            this->fp_path_length = 1;
             QuART_lil_can::insert_recursive_change_fp(
-                this->root, &this->root, key, 0, value, maxPrefixLength);
+                this->root, &this->root, key, 0, value, keyLength);
+            countInsert(&this->root);
             return;
         }
 
@@ -53,44 +36,54 @@ class QuART_lil_can : public ART {
 
         //counter1++;
 
-        if (this->fp_depth == maxPrefixLength - 1) {
+        // The nodes above fp are counted after the insert below it
+        NodeRef* ref = this->fp_ref;
+        size_t above = this->fp_path_length - 1;
+        if (this->fp_depth == keyLength - 1) {
             // Insert leaf into fp
-            ArtNode* newNode = makeLeaf(value);
             switch (this->fp->type) {
-                case NodeType4:
-                    static_cast<Node4*>(this->fp)->lilCanInsertNode4PreserveFp(
-                        this, this->fp_ref, key[fp_depth], newNode);
-                    break;
-                case NodeType16:
-                    static_cast<Node16*>(this->fp)->lilCanInsertNode16PreserveFp(
-                        this, this->fp_ref, key[fp_depth], newNode);
+                case NodeTypeBitmap:
+                    // A single bit is set, no leaf is stored
+                    static_cast<NodeBitmap*>(this->fp)->insertBitmap(
+                        this, this->fp_ref, key[fp_depth]);
                     break;
-                case NodeType48:
-                    static_cast<Node48*>(this->fp)->lilCanInsertNode48PreserveFp(
-                        this, this->fp_ref, key[fp_depth], newNode);
+                case NodeTypeInterval:
+                case NodeTypeBucket:
+                    QuART_lil_can::insert_recursive_change_fp(
+                        this->fp, this->fp_ref, key, fp_depth, value,
+                        keyLength);
                     break;
-                case NodeType256:
-                    static_cast<Node256*>(this->fp)->insertNode256(
-                        this, this->fp_ref, key[fp_depth], newNode);
+                default: {
+                    // Inner nodes of every type on the growth ladder. The
+                    // child of a key that is already in the tree is its leaf
+                    NodeRef* child = findChild(this->fp, key[fp_depth]);
+                    if (*child) {
+                        isFoundLeaf(child, value);
+                        break;
+                    }
+                    lilCanInsertChildPreserveFp(this, this->fp_ref, this->fp,
+                                                key[fp_depth], addLeaf(value));
                     break;
+                }
             }
+            countInsert(ref, above);
             return;
         } else {
             QuART_lil_can::insert_recursive_change_fp(
                 this->fp, this->fp_ref, key, fp_depth, value,
-                maxPrefixLength);
+                keyLength);
+            countInsert(ref, above);
             return;
         }
     }
 
-   private: 
     /* Recursive insert function that changes fp_leaf value */
-    void insert_recursive_change_fp(ArtNode* node, ArtNode** nodeRef,
+    void insert_recursive_change_fp(ArtNode* node, NodeRef* nodeRef,
                                     uint8_t key[], unsigned depth,
                                     uintptr_t value, unsigned maxKeyLength) {
         // Insert the leaf
         if (node == NULL) {
-            *nodeRef = makeLeaf(value);
+            *nodeRef = addLeaf(value);
             // Adjust fp parameters
             this->fp_leaf = *nodeRef;
             this->fp = *nodeRef;
@@ -99,17 +92,41 @@ class QuART_lil_can : public ART {
             return;
         }
 
+        // The key is already in the tree. Leaves below the root are found
+        // before the recursion reaches them, the root leaf is the fp already
+        if (isLeaf(node) && isFoundLeaf(nodeRef, value)) return;
+
+        if (isLeaf(node) && bucketLevel(depth)) {
+            // Gather the colliding leaves in a bucket instead
+            node = newBucket(nodeRef, node, depth);
+        }
+
         // If leaf expansion is needed
         if (isLeaf(node)) {
             // Replace leaf with Node4 and store both leaves in it
             uint8_t existingKey[maxKeyLength];
-            loadKey(getLeafValue(node), existingKey);
+            loadKey(getLeafValue(node), existingKey, maxKeyLength);
             unsigned newPrefixLength = 0;
             while (existingKey[depth + newPrefixLength] ==
                    key[depth + newPrefixLength])
                 newPrefixLength++;
 
-            Node4* newNode = new Node4();
+            if (bitmapLevel(depth + newPrefixLength)) {
+                // Store both leaves as bits of a bitmap node instead
+                NodeBitmap* newNode =
+                    newBitmapNode(nodeRef, node, key, depth, newPrefixLength);
+                // Adjust fp parameters
+                this->fp_path[this->fp_path_length - 1] = newNode;
+                this->fp_depth = depth;
+
+                newNode->insertBitmap(this, nodeRef,
+                                      existingKey[depth + newPrefixLength]);
+                newNode->lilCanInsertBitmapChangeFp(
+                    this, nodeRef, key[depth + newPrefixLength]);
+                return;
+            }
+
+            Node4* newNode = allocNode<Node4>(this);
             newNode->prefixLength = newPrefixLength;
             memcpy(newNode->prefix, key + depth,
                    min(newPrefixLength, maxPrefixLength));
@@ -117,22 +134,36 @@ class QuART_lil_can : public ART {
 
             // Adjust fp parameters
             this->fp_path[this->fp_path_length - 1] = newNode;
-            this->fp_depth = depth + newPrefixLength;
+            this->fp_depth = depth;
 
             newNode->insertNode4(this, nodeRef,
                                  existingKey[depth + newPrefixLength], node);
             newNode->lilCanInsertNode4ChangeFp(
-                this, nodeRef, key[depth + newPrefixLength], makeLeaf(value));
+                this, nodeRef, key[depth + newPrefixLength], addLeaf(value));
             return;
         }
 
+        if (isTerminal(node)) {
+            // Add to the interval or bucket in place, or split it and insert
+            // below. A bucket may have moved to a larger node
+            if (insertIntoTerminal(nodeRef, node, value)) {
+                // Adjust fp parameters
+                this->fp_leaf.setKey(value);
+                this->fp = *nodeRef;
+                this->fp_ref = nodeRef;
+                this->fp_depth = depth;
+                return;
+            }
+            node = *nodeRef;
+        }
+
         // Handle prefix of inner node
         if (node->prefixLength) {
             unsigned mismatchPos =
                 prefixMismatch(node, key, depth, maxKeyLength);
             if (mismatchPos != node->prefixLength) {
                 // Prefix differs, create new node
-                Node4* newNode = new Node4();
+                Node4* newNode = allocNode<Node4>(this);
                 *nodeRef = newNode;
                 newNode->prefixLength = mismatchPos;
                 memcpy(newNode->prefix, node->prefix,
@@ -149,7 +180,7 @@ class QuART_lil_can : public ART {
                 } else {
                     node->prefixLength -= (mismatchPos + 1);
                     uint8_t minKey[maxKeyLength];
-                    loadKey(getLeafValue(minimum(node)), minKey);
+                    loadKey(getLeafValue(minimum(node)), minKey, maxKeyLength);
                     // In all cases, newNode should be added to fp_path
                     fp_path[fp_path_length - 1] = newNode;
                     newNode->insertNode4(this, nodeRef,
@@ -160,42 +191,44 @@ class QuART_lil_can : public ART {
                 // Adjust fp_depth
                 this->fp_depth = depth;
                 newNode->lilCanInsertNode4ChangeFp(
-                    this, nodeRef, key[depth + mismatchPos], makeLeaf(value));
+                    this, nodeRef, key[depth + mismatchPos], addLeaf(value));
                 return;
             }
             depth += node->prefixLength;
         }
 
         // Recurse
-        ArtNode** child = findChild(node, key[depth]);
+        NodeRef* child = findChild(node, key[depth]);
         if (*child) {
+            if (isLeaf(*child) && isFoundLeaf(child, value)) {
+                // The key is already in the tree, the fp moves to its leaf
+                // as if it was inserted here
+                this->fp_depth = depth - node->prefixLength;
+                this->fp_leaf = *child;
+                this->fp = node;
+                this->fp_ref = nodeRef;
+                return;
+            }
             fp_path[fp_path_length] =
                 *child;        // add the node to the array before recursion
             fp_path_length++;  // increase the size of the array
             insert_recursive_change_fp(*child, child, key, depth + 1, value,
                                        maxKeyLength);
+            countInsert(child);
             return;
         }
 
         // Insert leaf into inner node
-        ArtNode* newNode = makeLeaf(value);
         this->fp_depth = depth - node->prefixLength;
         switch (node->type) {
-            case NodeType4:
-                static_cast<Node4*>(node)->lilCanInsertNode4ChangeFp(
-                    this, nodeRef, key[depth], newNode);
-                break;
-            case NodeType16:
-                static_cast<Node16*>(node)->lilCanInsertNode16ChangeFp(
-                    this, nodeRef, key[depth], newNode);
-                break;
-            case NodeType48:
-                static_cast<Node48*>(node)->lilCanInsertNode48ChangeFp(
-                    this, nodeRef, key[depth], newNode);
+            case NodeTypeBitmap:
+                static_cast<NodeBitmap*>(node)->lilCanInsertBitmapChangeFp(
+                    this, nodeRef, key[depth]);
                 break;
-            case NodeType256:
-                static_cast<Node256*>(node)->lilCanInsertNode256ChangeFp(
-                    this, nodeRef, key[depth], newNode);
+            default:
+                // Inner nodes of every type on the growth ladder
+                lilCanInsertChildChangeFp(this, nodeRef, node, key[depth],
+                                          addLeaf(value));
                 break;
         }
     }
@@ -7,9 +7,11 @@ namespace ART {
 
 class QuART_stail : public ART {
    public:
-    QuART_stail() : ART() {}
+    explicit QuART_stail(const TreeOptions& options = TreeOptions())
+        : ART(options) {}
 
-    void insert(uint8_t key[], uintptr_t value) {
+   protected:
+    void insertValue(uint8_t key[], uintptr_t value) override {
         /* Check if we can tail insert */
 
         ArtNode* root = this->root;
@@ -18,126 +20,83 @@ class QuART_stail : public ART {
         // keys[0] = 1 in all cases
         if (root == nullptr) {
             QuART_stail::insert_recursive_change_fp(
-                this->root, &this->root, key, 0, value, maxPrefixLength);
+                this->root, &this->root, key, 0, value, keyLength);
+            countInsert(&this->root);
             return;
         }
 
-        // Store leafValue, it will be used a lot
-        int leafValue = getLeafValue(this->fp_leaf);
-
-        // For each byte in the key excluding the last byte,
-        // check if it matches the corresponding byte in the leaf value
-        for (size_t i = 0; i < maxPrefixLength - 1; i++) {
-            // Find the byte of leaf in the i'th position (i = [0, 1, 2])
-            uint8_t leafByte =
-                (leafValue >> (8 * (maxPrefixLength - 1 - i))) & 0xFF;
-
-            // If the bytes match, continue to next byte
-            if (key[i] == leafByte) {
-                continue;
-            }
-            // If the key byte is less than the leaf value, we do insert without
-            // tracking the path, as this will never be the new fp path. We
-            // only update the current fp information if it changes.
-            else if (key[i] < leafByte) {
-                QuART_stail::insert_recursive_preserve_fp(
-                    this->root, &this->root, key, 0, value, maxPrefixLength);
+        // A dense interval on the fast path absorbs the next key in place,
+        // no leaf is materialized
+        if (this->fp != nullptr && !isLeaf(this->fp) &&
+            this->fp->type == NodeTypeInterval) {
+            NodeInterval* interval = static_cast<NodeInterval*>(this->fp);
+            if (interval->extendsTo(value)) {
+                interval->extend(value);
+                leafCount.add(1);
+                if (value > getLeafValue(this->fp_leaf))
+                    this->fp_leaf.setKey(value);
+                countInsert(this->fp_ref, this->fp_path_length - 1);
                 return;
             }
-            // Key byte is greater than leaf byte
-            else {
-                // If we are at the first byte
-                if (i == 0) {
-                    // If the key is a bridge value, change fp
-                    if ((key[0] == leafByte + 1) && (key[1] == 0) &&
-                        (key[2] == 0) && ((leafValue >> 8 * 2) & 0xFF) == 255 &&
-                        ((leafValue >> 8) & 0xFF) == 255) {
-                        this->fp_path = {this->root};
-                        this->fp_path_length = 1;
-                        QuART_stail::insert_recursive_change_fp(
-                            this->root, &this->root, key, 0, value,
-                            maxPrefixLength);
-                        return;
-                    }
-                    // If it is not a bridge value, insert without changing
-                    else {
-                        QuART_stail::insert_recursive_preserve_fp(
-                            this->root, &this->root, key, 0, value,
-                            maxPrefixLength);
-                        return;
-                    }
-                }
-                // If we are at the second byte
-                else if (i == 1) {
-                    // If the key is a bridge value, change fp
-                    if ((key[1] == leafByte + 1) && (key[2] == 0) &&
-                        (key[0] == ((leafValue >> 8 * 3) & 0xFF)) &&
-                        ((leafValue >> 8) & 0xFF) == 255) {
-                        this->fp_path = {this->root};
-                        this->fp_path_length = 1;
-                        QuART_stail::insert_recursive_change_fp(
-                            this->root, &this->root, key, 0, value,
-                            maxPrefixLength);
-                        return;
-                    }
-                    // If it is not a bridge value, insert without changing
-                    else {
-                        QuART_stail::insert_recursive_preserve_fp(
-                            this->root, &this->root, key, 0, value,
-                            maxPrefixLength);
-                        return;
-                    }
-                }
-                // If we are at the third byte
-                else {
-                    // If the key is a bridge value, change fp
-                    if ((key[2] == leafByte + 1) &&
-                        (key[0] == ((leafValue >> 8 * 3) & 0xFF)) &&
-                        (key[1] == ((leafValue >> 8 * 2) & 0xFF))) {
-                        this->fp_path = {this->root};
-                        this->fp_path_length = 1;
-                        QuART_stail::insert_recursive_change_fp(
-                            this->root, &this->root, key, 0, value,
-                            maxPrefixLength);
-                        return;
-                    }
-                    // If it is not a bridge value, insert without changing
-                    else {
-                        QuART_stail::insert_recursive_preserve_fp(
-                            this->root, &this->root, key, 0, value,
-                            maxPrefixLength);
-                        return;
-                    }
-                }
+        }
+
+        // Compare every byte but the last with the fp leaf at once
+        if (!onFastPath(value)) {
+            // If the key is a bridge value, change fp. Otherwise we insert
+            // without tracking the path, as a smaller key will never be the
+            // new fp path. We only update the current fp information if it
+            // changes.
+            if (isBridge(value, getLeafValue(this->fp_leaf))) {
+                this->fp_path = {this->root};
+                this->fp_path_length = 1;
+                QuART_stail::insert_recursive_change_fp(
+                    this->root, &this->root, key, 0, value, keyLength);
+                countInsert(&this->root);
+                return;
             }
+            QuART_stail::insert_recursive_preserve_fp(
+                this->root, &this->root, key, 0, value, keyLength);
+            countInsert(&this->root);
+            return;
         }
 
         /* If the algorithm reaches here, it means that fp insert will happen */
 
-        // If depth is at maxPrefixLength - 1, we do not need to worry about
+        // The nodes above fp are counted after the insert below it
+        NodeRef* ref = this->fp_ref;
+        size_t above = this->fp_path_length - 1;
+
+        // If depth is at keyLength - 1, we do not need to worry about
         // leaf expansion of prefix mismatch, we can directly insert the new
         // leaf into fp node
-        if (this->fp_depth == maxPrefixLength - 1) {
+        if (this->fp_depth == keyLength - 1) {
             // Insert leaf into fp
-            ArtNode* newNode = makeLeaf(value);
             switch (this->fp->type) {
-                case NodeType4:
-                    static_cast<Node4*>(this->fp)->stailInsertNode4PreserveFp(
-                        this, this->fp_ref, key[fp_depth], newNode);
+                case NodeTypeBitmap:
+                    // A single bit is set, no leaf is stored
+                    static_cast<NodeBitmap*>(this->fp)->insertBitmap(
+                        this, this->fp_ref, key[fp_depth]);
                     break;
-                case NodeType16:
-                    static_cast<Node16*>(this->fp)->stailInsertNode16PreserveFp(
-                        this, this->fp_ref, key[fp_depth], newNode);
+                case NodeTypeInterval:
+                case NodeTypeBucket:
+                    QuART_stail::insert_recursive_preserve_fp(
+                        this->fp, this->fp_ref, key, fp_depth, value,
+                        keyLength);
                     break;
-                case NodeType48:
-                    static_cast<Node48*>(this->fp)->stailInsertNode48PreserveFp(
-                        this, this->fp_ref, key[fp_depth], newNode);
-                    break;
-                case NodeType256:
-                    static_cast<Node256*>(this->fp)->insertNode256(
-                        this, this->fp_ref, key[fp_depth], newNode);
+                default: {
+                    // Inner nodes of every type on the growth ladder. The
+                    // child of a key that is already in the tree is its leaf
+                    NodeRef* child = findChild(this->fp, key[fp_depth]);
+                    if (*child) {
+                        isFoundLeaf(child, value);
+                        break;
+                    }
+                    stailInsertChildPreserveFp(this, this->fp_ref, this->fp,
+                                               key[fp_depth], addLeaf(value));
                     break;
+                }
             }
+            countInsert(ref, above);
             return;
         }
         // Else, we call the recursive function and let it handle leaf expansion
@@ -145,27 +104,81 @@ class QuART_stail : public ART {
         // into the fp
         else {
             QuART_stail::insert_recursive_preserve_fp(
-                this->fp, this->fp_ref, key, fp_depth, value, maxPrefixLength);
+                this->fp, this->fp_ref, key, fp_depth, value, keyLength);
+            countInsert(ref, above);
             return;
         }
     }
 
    protected:
+    // Is the key a bridge value, the first key past the subtree of the fp
+    // leaf at some byte: that byte is one larger and every byte after it but
+    // the last rolls over from 255 to 0. Bytes before it are equal, so the
+    // key without its last byte is one past that of the leaf
+    bool isBridge(uintptr_t value, uintptr_t leafValue) const {
+        return (value >> 8) == (leafValue >> 8) + 1;
+    }
+
     /* Recursive insert function that does NOT change fp_leaf value */
-    void insert_recursive_preserve_fp(ArtNode* node, ArtNode** nodeRef,
+    void insert_recursive_preserve_fp(ArtNode* node, NodeRef* nodeRef,
                                       uint8_t key[], unsigned depth,
                                       uintptr_t value, unsigned maxKeyLength) {
+        // The key is already in the tree
+        if (isLeaf(node) && isFoundLeaf(nodeRef, value)) return;
+
+        if (isLeaf(node) && bucketLevel(depth)) {
+            // Gather the colliding leaves in a bucket instead
+            NodeBucket* bucket = newBucket(nodeRef, node, depth);
+            // If the changing node was the fp leaf, the fp moves down to it
+            if (this->fp_leaf == node && this->fp != bucket) {
+                // A root leaf that was the fp is replaced on the path
+                if (isLeaf(this->fp)) this->fp_path_length--;
+                this->fp_path[this->fp_path_length] = bucket;
+                this->fp_path_length++;
+                this->fp = bucket;
+                this->fp_ref = nodeRef;
+                this->fp_depth = depth;
+            }
+            node = bucket;
+        }
+
         // If leaf expansion is needed
         if (isLeaf(node)) {
             // Replace leaf with Node4 and store both leaves in it
             uint8_t existingKey[maxKeyLength];
-            loadKey(getLeafValue(node), existingKey);
+            loadKey(getLeafValue(node), existingKey, maxKeyLength);
             unsigned newPrefixLength = 0;
             while (existingKey[depth + newPrefixLength] ==
                    key[depth + newPrefixLength])
                 newPrefixLength++;
 
-            Node4* newNode = new Node4();
+            if (bitmapLevel(depth + newPrefixLength)) {
+                // Store both leaves as bits of a bitmap node instead
+                NodeBitmap* newNode =
+                    newBitmapNode(nodeRef, node, key, depth, newPrefixLength);
+                // If the changing node was the fp
+                if (this->fp_leaf == node) {
+                    if (!isLeaf(this->fp)) {
+                        this->fp_depth += fp->prefixLength;
+                        this->fp_depth++;
+                    } else {
+                        // A root leaf is replaced on the path
+                        this->fp_path_length--;
+                    }
+                    // Adjust fp parameters
+                    this->fp_path[this->fp_path_length] = newNode;
+                    this->fp_path_length++;
+                    this->fp = newNode;
+                    this->fp_ref = nodeRef;
+                }
+                newNode->insertBitmap(this, nodeRef,
+                                      existingKey[depth + newPrefixLength]);
+                newNode->insertBitmap(this, nodeRef,
+                                      key[depth + newPrefixLength]);
+                return;
+            }
+
+            Node4* newNode = allocNode<Node4>(this);
             newNode->prefixLength = newPrefixLength;
             memcpy(newNode->prefix, key + depth,
                    min(newPrefixLength, maxPrefixLength));
@@ -177,6 +190,9 @@ class QuART_stail : public ART {
                 if (!isLeaf(this->fp)) {
                     this->fp_depth += fp->prefixLength;
                     this->fp_depth++;
+                } else {
+                    // A root leaf is replaced on the path
+                    this->fp_path_length--;
                 }
                 // Adjust fp parameters
                 this->fp_path[this->fp_path_length] = newNode;
@@ -188,17 +204,30 @@ class QuART_stail : public ART {
             newNode->insertNode4(this, nodeRef,
                                  existingKey[depth + newPrefixLength], node);
             newNode->insertNode4(this, nodeRef, key[depth + newPrefixLength],
-                                 makeLeaf(value));
+                                 addLeaf(value));
             return;
         }
 
+        if (isTerminal(node)) {
+            // Add to the interval or bucket in place, or split it and insert
+            // below. A bucket may have moved to a larger node
+            if (insertIntoTerminal(nodeRef, node, value)) {
+                // The fp keeps its place, fp_leaf follows its largest key
+                if (this->fp == *nodeRef &&
+                    value > getLeafValue(this->fp_leaf))
+                    this->fp_leaf.setKey(value);
+                return;
+            }
+            node = *nodeRef;
+        }
+
         // Handle prefix of inner node
         if (node->prefixLength) {
             unsigned mismatchPos =
                 prefixMismatch(node, key, depth, maxKeyLength);
             if (mismatchPos != node->prefixLength) {
                 // Prefix differs, create new node
-                Node4* newNode = new Node4();
+                Node4* newNode = allocNode<Node4>(this);
                 *nodeRef = newNode;
                 newNode->prefixLength = mismatchPos;
                 memcpy(newNode->prefix, node->prefix,
@@ -234,7 +263,7 @@ class QuART_stail : public ART {
                 } else {
                     node->prefixLength -= (mismatchPos + 1);
                     uint8_t minKey[maxKeyLength];
-                    loadKey(getLeafValue(minimum(node)), minKey);
+                    loadKey(getLeafValue(minimum(node)), minKey, maxKeyLength);
                     // If the nodes that being changed is in fp_path
                     auto it = std::find(fp_path.begin(),
                                         fp_path.begin() + fp_path_length, node);
@@ -262,68 +291,87 @@ class QuART_stail : public ART {
                             min(node->prefixLength, maxPrefixLength));
                 }
                 newNode->insertNode4(this, nodeRef, key[depth + mismatchPos],
-                                     makeLeaf(value));
+                                     addLeaf(value));
                 return;
             }
             depth += node->prefixLength;
         }
 
         // Recurse
-        ArtNode** child = findChild(node, key[depth]);
+        NodeRef* child = findChild(node, key[depth]);
         if (*child) {
             insert_recursive_preserve_fp(*child, child, key, depth + 1, value,
                                          maxKeyLength);
+            countInsert(child);
             return;
         }
 
         // Insert leaf into inner node
-        ArtNode* newNode = makeLeaf(value);
         switch (node->type) {
-            case NodeType4:
-                static_cast<Node4*>(node)->stailInsertNode4PreserveFp(
-                    this, nodeRef, key[depth], newNode);
+            case NodeTypeBitmap:
+                static_cast<NodeBitmap*>(node)->insertBitmap(this, nodeRef,
+                                                             key[depth]);
                 break;
-            case NodeType16:
-                static_cast<Node16*>(node)->stailInsertNode16PreserveFp(
-                    this, nodeRef, key[depth], newNode);
-                break;
-            case NodeType48:
-                static_cast<Node48*>(node)->stailInsertNode48PreserveFp(
-                    this, nodeRef, key[depth], newNode);
-                break;
-            case NodeType256:
-                static_cast<Node256*>(node)->insertNode256(this, nodeRef,
-                                                           key[depth], newNode);
+            default:
+                // Inner nodes of every type on the growth ladder
+                stailInsertChildPreserveFp(this, nodeRef, node, key[depth],
+                                           addLeaf(value));
                 break;
         }
     }
 
     /* Recursive insert function that changes fp_leaf value */
-    void insert_recursive_change_fp(ArtNode* node, ArtNode** nodeRef,
+    void insert_recursive_change_fp(ArtNode* node, NodeRef* nodeRef,
                                     uint8_t key[], unsigned depth,
                                     uintptr_t value, unsigned maxKeyLength) {
         // Insert the leaf
         if (node == NULL) {
-            *nodeRef = makeLeaf(value);
-            // Adjust fp parameters
+            *nodeRef = addLeaf(value);
+            // Adjust fp parameters, the leaf is the root and the whole path
             this->fp_leaf = *nodeRef;
             this->fp = *nodeRef;
             this->fp_ref = nodeRef;
             this->fp_depth = 0;
+            this->fp_path = {*nodeRef};
+            this->fp_path_length = 1;
             return;
         }
 
+        // The key is already in the tree. Leaves below the root are found
+        // before the recursion reaches them, the root leaf is the fp already
+        if (isLeaf(node) && isFoundLeaf(nodeRef, value)) return;
+
+        if (isLeaf(node) && bucketLevel(depth)) {
+            // Gather the colliding leaves in a bucket instead
+            node = newBucket(nodeRef, node, depth);
+        }
+
         // If leaf expansion is needed
         if (isLeaf(node)) {
             // Replace leaf with Node4 and store both leaves in it
             uint8_t existingKey[maxKeyLength];
-            loadKey(getLeafValue(node), existingKey);
+            loadKey(getLeafValue(node), existingKey, maxKeyLength);
             unsigned newPrefixLength = 0;
             while (existingKey[depth + newPrefixLength] ==
                    key[depth + newPrefixLength])
                 newPrefixLength++;
 
-            Node4* newNode = new Node4();
+            if (bitmapLevel(depth + newPrefixLength)) {
+                // Store both leaves as bits of a bitmap node instead
+                NodeBitmap* newNode =
+                    newBitmapNode(nodeRef, node, key, depth, newPrefixLength);
+                // Adjust fp parameters
+                this->fp_path[this->fp_path_length - 1] = newNode;
+                this->fp_depth = depth;
+
+                newNode->insertBitmap(this, nodeRef,
+                                      existingKey[depth + newPrefixLength]);
+                newNode->stailInsertBitmapChangeFp(
+                    this, nodeRef, key[depth + newPrefixLength]);
+                return;
+            }
+
+            Node4* newNode = allocNode<Node4>(this);
             newNode->prefixLength = newPrefixLength;
             memcpy(newNode->prefix, key + depth,
                    min(newPrefixLength, maxPrefixLength));
@@ -331,22 +379,36 @@ class QuART_stail : public ART {
 
             // Adjust fp parameters
             this->fp_path[this->fp_path_length - 1] = newNode;
-            this->fp_depth = depth + newPrefixLength;
+            this->fp_depth = depth;
 
             newNode->insertNode4(this, nodeRef,
                                  existingKey[depth + newPrefixLength], node);
             newNode->stailInsertNode4ChangeFp(
-                this, nodeRef, key[depth + newPrefixLength], makeLeaf(value));
+                this, nodeRef, key[depth + newPrefixLength], addLeaf(value));
             return;
         }
 
+        if (isTerminal(node)) {
+            // Add to the interval or bucket in place, or split it and insert
+            // below. A bucket may have moved to a larger node
+            if (insertIntoTerminal(nodeRef, node, value)) {
+                // Adjust fp parameters
+                this->fp_leaf.setKey(value);
+                this->fp = *nodeRef;
+                this->fp_ref = nodeRef;
+                this->fp_depth = depth;
+                return;
+            }
+            node = *nodeRef;
+        }
+
         // Handle prefix of inner node
         if (node->prefixLength) {
             unsigned mismatchPos =
                 prefixMismatch(node, key, depth, maxKeyLength);
             if (mismatchPos != node->prefixLength) {
                 // Prefix differs, create new node
-                Node4* newNode = new Node4();
+                Node4* newNode = allocNode<Node4>(this);
                 *nodeRef = newNode;
                 newNode->prefixLength = mismatchPos;
                 memcpy(newNode->prefix, node->prefix,
@@ -363,7 +425,7 @@ class QuART_stail : public ART {
                 } else {
                     node->prefixLength -= (mismatchPos + 1);
                     uint8_t minKey[maxKeyLength];
-                    loadKey(getLeafValue(minimum(node)), minKey);
+                    loadKey(getLeafValue(minimum(node)), minKey, maxKeyLength);
                     // In all cases, newNode should be added to fp_path
                     fp_path[fp_path_length - 1] = newNode;
                     newNode->insertNode4(this, nodeRef,
@@ -374,42 +436,44 @@ class QuART_stail : public ART {
                 // Adjust fp_depth
                 this->fp_depth = depth;
                 newNode->stailInsertNode4ChangeFp(
-                    this, nodeRef, key[depth + mismatchPos], makeLeaf(value));
+                    this, nodeRef, key[depth + mismatchPos], addLeaf(value));
                 return;
             }
             depth += node->prefixLength;
         }
 
         // Recurse
-        ArtNode** child = findChild(node, key[depth]);
+        NodeRef* child = findChild(node, key[depth]);
         if (*child) {
+            if (isLeaf(*child) && isFoundLeaf(child, value)) {
+                // The key is already in the tree, the fp moves to its leaf
+                // as if it was inserted here
+                this->fp_depth = depth - node->prefixLength;
+                this->fp_leaf = *child;
+                this->fp = node;
+                this->fp_ref = nodeRef;
+                return;
+            }
             fp_path[fp_path_length] =
                 *child;        // add the node to the array before recursion
             fp_path_length++;  // increase the size of the array
             insert_recursive_change_fp(*child, child, key, depth + 1, value,
                                        maxKeyLength);
+            countInsert(child);
             return;
         }
 
         // Insert leaf into inner node
-        ArtNode* newNode = makeLeaf(value);
         this->fp_depth = depth - node->prefixLength;
         switch (node->type) {
-            case NodeType4:
-                static_cast<Node4*>(node)->stailInsertNode4ChangeFp(
-                    this, nodeRef, key[depth], newNode);
-                break;
-            case NodeType16:
-                static_cast<Node16*>(node)->stailInsertNode16ChangeFp(
-                    this, nodeRef, key[depth], newNode);
-                break;
-            case NodeType48:
-                static_cast<Node48*>(node)->stailInsertNode48ChangeFp(
-                    this, nodeRef, key[depth], newNode);
+            case NodeTypeBitmap:
+                static_cast<NodeBitmap*>(node)->stailInsertBitmapChangeFp(
+                    this, nodeRef, key[depth]);
                 break;
-            case NodeType256:
-                static_cast<Node256*>(node)->stailInsertNode256ChangeFp(
-                    this, nodeRef, key[depth], newNode);
+            default:
+                // Inner nodes of every type on the growth ladder
+                stailInsertChildChangeFp(this, nodeRef, node, key[depth],
+                                         addLeaf(value));
                 break;
         }
     }
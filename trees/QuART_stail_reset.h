@@ -11,9 +11,11 @@ class QuART_stail_reset : public QuART_stail {
     int reset_counter;
 
    public:
-    QuART_stail_reset() : QuART_stail(), reset_counter(300) {}
+    explicit QuART_stail_reset(const TreeOptions& options = TreeOptions())
+        : QuART_stail(options), reset_counter(300) {}
 
-    void insert(uint8_t key[], uintptr_t value) {
+   private:
+    void insertValue(uint8_t key[], uintptr_t value) override {
         /* Check if we can tail insert */
 
         ArtNode* root = this->root;
@@ -22,153 +24,102 @@ class QuART_stail_reset : public QuART_stail {
         // keys[0] = 1 in all cases
         if (root == nullptr) {
             QuART_stail::insert_recursive_change_fp(
-                this->root, &this->root, key, 0, value, maxPrefixLength);
+                this->root, &this->root, key, 0, value, keyLength);
+            countInsert(&this->root);
             return;
         }
 
-        // Store leafValue, it will be used a lot
-        int leafValue = getLeafValue(this->fp_leaf);
-
-        // For each byte in the key excluding the last byte,
-        // check if it matches the corresponding byte in the leaf value
-        for (size_t i = 0; i < maxPrefixLength - 1; i++) {
-            // Find the byte of leaf in the i'th position (i = [0, 1, 2])
-            uint8_t leafByte =
-                (leafValue >> (8 * (maxPrefixLength - 1 - i))) & 0xFF;
-
-            // If the bytes match, continue to next byte
-            if (key[i] == leafByte) {
-                continue;
+        // A dense interval on the fast path absorbs the next key in place,
+        // no leaf is materialized
+        if (this->fp != nullptr && !isLeaf(this->fp) &&
+            this->fp->type == NodeTypeInterval) {
+            NodeInterval* interval = static_cast<NodeInterval*>(this->fp);
+            if (interval->extendsTo(value)) {
+                interval->extend(value);
+                leafCount.add(1);
+                if (value > getLeafValue(this->fp_leaf))
+                    this->fp_leaf.setKey(value);
+                countInsert(this->fp_ref, this->fp_path_length - 1);
+                return;
             }
+        }
+
+        // Compare every byte but the last with the fp leaf at once
+        if (!onFastPath(value)) {
             // If the key byte is less than the leaf value, we do insert without
             // tracking the path, as this will never be the new fp path. We
             // only update the current fp information if it changes.
-            else if (key[i] < leafByte) {
+            uintptr_t leafValue = getLeafValue(this->fp_leaf);
+            if (value < leafValue) {
                 QuART_stail::insert_recursive_preserve_fp(
-                    this->root, &this->root, key, 0, value, maxPrefixLength);
+                    this->root, &this->root, key, 0, value, keyLength);
+                countInsert(&this->root);
                 return;
             }
-            // Key byte is greater than leaf byte
-            else {
-                // If we are at the first byte
-                if (i == 0) {
-                    // If the key is a bridge value, change fp
-                    if ((key[0] == leafByte + 1) && (key[1] == 0) &&
-                        (key[2] == 0) && ((leafValue >> 8 * 2) & 0xFF) == 255 &&
-                        ((leafValue >> 8) & 0xFF) == 255) {
-                        this->fp_path = {this->root};
-                        this->fp_path_length = 1;
-                        QuART_stail::insert_recursive_change_fp(
-                            this->root, &this->root, key, 0, value,
-                            maxPrefixLength);
-                        return;
-                    }
-                    // If it is not a bridge value and counter ended, force fp change
-                    else if (this->reset_counter == 0) {
-                        this->reset_counter = 300; // reset counter
-                        this->insert_recursive_change_fp(
-                            this->root, &this->root, key, 0, value,
-                            maxPrefixLength);
-                        return;
-                    }
-                    // If it is not a bridge value, insert without changing
-                    else {
-                        this->reset_counter--; // decrement counter
-                        QuART_stail::insert_recursive_preserve_fp(
-                            this->root, &this->root, key, 0, value,
-                            maxPrefixLength);
-                        return;
-                    }
-                }
-                // If we are at the second byte
-                else if (i == 1) {
-                    // If the key is a bridge value, change fp
-                    if ((key[1] == leafByte + 1) && (key[2] == 0) &&
-                        (key[0] == ((leafValue >> 8 * 3) & 0xFF)) &&
-                        ((leafValue >> 8) & 0xFF) == 255) {
-                        this->fp_path = {this->root};
-                        this->fp_path_length = 1;
-                        QuART_stail::insert_recursive_change_fp(
-                            this->root, &this->root, key, 0, value,
-                            maxPrefixLength);
-                        return;
-                    }
-                    // If it is not a bridge value and counter ended, force fp change
-                    else if (this->reset_counter == 0) {
-                        this->reset_counter = 300; // reset counter
-                        this->insert_recursive_change_fp(
-                            this->root, &this->root, key, 0, value,
-                            maxPrefixLength);
-                        return;
-                    }
-                    // If it is not a bridge value, insert without changing
-                    else {
-                        this->reset_counter--; // decrement counter
-                        QuART_stail::insert_recursive_preserve_fp(
-                            this->root, &this->root, key, 0, value,
-                            maxPrefixLength);
-                        return;
-                    }
-                }
-                // If we are at the third byte
-                else {
-                    // If the key is a bridge value, change fp
-                    if ((key[2] == leafByte + 1) &&
-                        (key[0] == ((leafValue >> 8 * 3) & 0xFF)) &&
-                        (key[1] == ((leafValue >> 8 * 2) & 0xFF))) {
-                        this->fp_path = {this->root};
-                        this->fp_path_length = 1;
-                        QuART_stail::insert_recursive_change_fp(
-                            this->root, &this->root, key, 0, value,
-                            maxPrefixLength);
-                        return;
-                    }
-                    // If it is not a bridge value and counter ended, force fp change
-                    else if (this->reset_counter == 0) {
-                        this->reset_counter = 300; // reset counter
-                        this->insert_recursive_change_fp(
-                            this->root, &this->root, key, 0, value,
-                            maxPrefixLength);
-                        return;
-                    }
-                    // If it is not a bridge value, insert without changing
-                    else {
-                        this->reset_counter--; // decrement counter
-                        QuART_stail::insert_recursive_preserve_fp(
-                            this->root, &this->root, key, 0, value,
-                            maxPrefixLength);
-                        return;
-                    }
-                }
+            // If the key is a bridge value, change fp
+            if (isBridge(value, leafValue)) {
+                this->fp_path = {this->root};
+                this->fp_path_length = 1;
+                QuART_stail::insert_recursive_change_fp(
+                    this->root, &this->root, key, 0, value, keyLength);
+                countInsert(&this->root);
+                return;
+            }
+            // If it is not a bridge value and counter ended, force fp change
+            if (this->reset_counter == 0) {
+                this->reset_counter = 300; // reset counter
+                this->fp_path = {this->root};
+                this->fp_path_length = 1;
+                this->insert_recursive_change_fp(
+                    this->root, &this->root, key, 0, value, keyLength);
+                countInsert(&this->root);
+                return;
             }
+            // If it is not a bridge value, insert without changing
+            this->reset_counter--; // decrement counter
+            QuART_stail::insert_recursive_preserve_fp(
+                this->root, &this->root, key, 0, value, keyLength);
+            countInsert(&this->root);
+            return;
         }
 
         /* If the algorithm reaches here, it means that fp insert will happen */
 
-        // If depth is at maxPrefixLength - 1, we do not need to worry about
+        // The nodes above fp are counted after the insert below it
+        NodeRef* ref = this->fp_ref;
+        size_t above = this->fp_path_length - 1;
+
+        // If depth is at keyLength - 1, we do not need to worry about
         // leaf expansion of prefix mismatch, we can directly insert the new
         // leaf into fp node
-        if (this->fp_depth == maxPrefixLength - 1) {
+        if (this->fp_depth == keyLength - 1) {
             // Insert leaf into fp
-            ArtNode* newNode = makeLeaf(value);
             switch (this->fp->type) {
-                case NodeType4:
-                    static_cast<Node4*>(this->fp)->stailInsertNode4PreserveFp(
-                        this, this->fp_ref, key[fp_depth], newNode);
+                case NodeTypeBitmap:
+                    // A single bit is set, no leaf is stored
+                    static_cast<NodeBitmap*>(this->fp)->insertBitmap(
+                        this, this->fp_ref, key[fp_depth]);
                     break;
-                case NodeType16:
-                    static_cast<Node16*>(this->fp)->stailInsertNode16PreserveFp(
-                        this, this->fp_ref, key[fp_depth], newNode);
+                case NodeTypeInterval:
+                case NodeTypeBucket:
+                    QuART_stail::insert_recursive_preserve_fp(
+                        this->fp, this->fp_ref, key, fp_depth, value,
+                        keyLength);
                     break;
-                case NodeType48:
-                    static_cast<Node48*>(this->fp)->stailInsertNode48PreserveFp(
-                        this, this->fp_ref, key[fp_depth], newNode);
-                    break;
-                case NodeType256:
-                    static_cast<Node256*>(this->fp)->insertNode256(
-                        this, this->fp_ref, key[fp_depth], newNode);
+                default: {
+                    // Inner nodes of every type on the growth ladder. The
+                    // child of a key that is already in the tree is its leaf
+                    NodeRef* child = findChild(this->fp, key[fp_depth]);
+                    if (*child) {
+                        isFoundLeaf(child, value);
+                        break;
+                    }
+                    stailInsertChildPreserveFp(this, this->fp_ref, this->fp,
+                                               key[fp_depth], addLeaf(value));
                     break;
+                }
             }
+            countInsert(ref, above);
             return;
         }
         // Else, we call the recursive function and let it handle leaf expansion
@@ -176,7 +127,8 @@ class QuART_stail_reset : public QuART_stail {
         // into the fp
         else {
             QuART_stail::insert_recursive_preserve_fp(
-                this->fp, this->fp_ref, key, fp_depth, value, maxPrefixLength);
+                this->fp, this->fp_ref, key, fp_depth, value, keyLength);
+            countInsert(ref, above);
             return;
         }
     }
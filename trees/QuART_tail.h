@@ -7,89 +7,98 @@ namespace ART {
 
 class QuART_tail : public ART {
    public:
-    QuART_tail() : ART() {}
+    explicit QuART_tail(const TreeOptions& options = TreeOptions())
+        : ART(options) {}
 
-    void insert(uint8_t key[], uintptr_t value) {
-        // Check if we can tail insert
+   private:
+    void insertValue(uint8_t key[], uintptr_t value) override {
+        // We can tail insert if the root is an inner node and the key matches
+        // the fp leaf in every byte but the last, which is not smaller
         ArtNode* root = this->root;
-        int leafValue = getLeafValue(this->fp_leaf);
-        // Check if the root is not null and is not a leaf
-        if (root != nullptr && !isLeaf(root)) {
-            // For each byte in the key excluding the last byte,
-            // check if it matches the corresponding byte in the leaf value
-            // If any byte does not match, set can_tail_insert to false
-            for (size_t i = 0; i < maxPrefixLength - 1; ++i) {
-                uint8_t leafByte =
-                    (leafValue >> (8 * (maxPrefixLength - 1 - i))) & 0xFF;
-                if (leafByte != key[i]) {
-                    // If the key differs from leafByte earlier, we tail insert
-                    // from root
-                    std::array<ArtNode*, maxPrefixLength> temp_fp_path = {
-                        this->root};
-                    size_t temp_fp_path_length = 1;
-                    QuART_tail::insert_recursive_tail(
-                        this, this->root, &this->root, key, 0, value,
-                        maxPrefixLength, temp_fp_path, temp_fp_path_length);
-                    return;
-                }
-            }
-        } else {
-            // If the root is null or is a leaf, we tail insert from root
-            std::array<ArtNode*, maxPrefixLength> temp_fp_path = {this->root};
-            size_t temp_fp_path_length = 1;
-            QuART_tail::insert_recursive_tail(
-                this, this->root, &this->root, key, 0, value, maxPrefixLength,
-                temp_fp_path, temp_fp_path_length);
-            return;
-        }
-
-        // We reached the last byte of the key, we can tail insert
-        if (key[maxPrefixLength - 1] >= (leafValue & 0xFF)) {
+        if (root != nullptr && !isLeaf(root) && onFastPath(value) &&
+            value >= getLeafValue(this->fp_leaf)) {
             // If we can tail insert, use the fast path
-            std::array<ArtNode*, maxPrefixLength> temp_fp_path = fp_path;
+            std::array<ArtNode*, maxKeyWidth> temp_fp_path = fp_path;
             size_t temp_fp_path_length = fp_path_length;
+            // The nodes above fp are counted after the insert below it
+            NodeRef* ref = this->fp_ref;
+            size_t above = fp_path_length - 1;
             QuART_tail::insert_recursive_tail(
                 this, this->fp, this->fp_ref, key, fp_depth, value,
-                maxPrefixLength, temp_fp_path, temp_fp_path_length);
-            return;
-        } else {
-            // If we cannot tail insert, we will insert from root
-            std::array<ArtNode*, maxPrefixLength> temp_fp_path = {this->root};
-            size_t temp_fp_path_length = 1;
-            QuART_tail::insert_recursive_tail(
-                this, this->root, &this->root, key, 0, value, maxPrefixLength,
-                temp_fp_path, temp_fp_path_length);
+                keyLength, temp_fp_path, temp_fp_path_length);
+            countInsert(ref, above);
             return;
         }
+        // Else we tail insert from root
+        std::array<ArtNode*, maxKeyWidth> temp_fp_path = {this->root};
+        size_t temp_fp_path_length = 1;
+        QuART_tail::insert_recursive_tail(this, this->root, &this->root, key, 0,
+                                          value, keyLength, temp_fp_path,
+                                          temp_fp_path_length);
+        countInsert(&this->root);
     }
 
-   private:
     void insert_recursive_tail(
-        ART* tree, ArtNode* node, ArtNode** nodeRef, uint8_t key[],
+        ART* tree, ArtNode* node, NodeRef* nodeRef, uint8_t key[],
         unsigned depth, uintptr_t value, unsigned maxKeyLength,
-        std::array<ArtNode*, maxPrefixLength>& temp_fp_path,
+        std::array<ArtNode*, maxKeyWidth>& temp_fp_path,
         size_t& temp_fp_path_length) {
         size_t depth_prev = depth;
 
         // Insert the leaf value into the tree
         if (node == NULL) {
-            *nodeRef = makeLeaf(value);
+            *nodeRef = addLeaf(value);
             // Adjust only fp_leaf (fp will still be null)
             tree->fp_leaf = *nodeRef;
             tree->fp_ref = nodeRef;
             return;
         }
 
+        // The key is already in the tree, the fast path stays as it is
+        if (isLeaf(node) && isFoundLeaf(nodeRef, value)) return;
+
+        if (isLeaf(node) && bucketLevel(depth)) {
+            // Gather the colliding leaves in a bucket instead
+            NodeBucket* bucket = newBucket(nodeRef, node, depth);
+            if (temp_fp_path[temp_fp_path_length - 1] == node)
+                temp_fp_path[temp_fp_path_length - 1] = bucket;
+            // If the changing node was the fp leaf, the bucket becomes the fp
+            if (tree->fp_leaf == node) {
+                tree->fp = bucket;
+                tree->fp_path = temp_fp_path;
+                tree->fp_path_length = temp_fp_path_length;
+                tree->fp_depth = depth_prev;
+                tree->fp_ref = nodeRef;
+            }
+            node = bucket;
+        }
+
         if (isLeaf(node)) {
             // Replace leaf with Node4 and store both leaves in it
             uint8_t existingKey[maxKeyLength];
-            loadKey(getLeafValue(node), existingKey);
+            loadKey(getLeafValue(node), existingKey, maxKeyLength);
             unsigned newPrefixLength = 0;
             while (existingKey[depth + newPrefixLength] ==
                    key[depth + newPrefixLength])
                 newPrefixLength++;
 
-            Node4* newNode = new Node4();
+            if (bitmapLevel(depth + newPrefixLength)) {
+                // Store both leaves as bits of a bitmap node instead
+                NodeBitmap* newNode =
+                    newBitmapNode(nodeRef, node, key, depth, newPrefixLength);
+                if (tree->fp_leaf == node) {
+                    temp_fp_path[temp_fp_path_length - 1] = newNode;
+                }
+                newNode->tailInsertBitmap(
+                    this, nodeRef, existingKey[depth + newPrefixLength],
+                    temp_fp_path, temp_fp_path_length, depth_prev);
+                newNode->tailInsertBitmap(
+                    this, nodeRef, key[depth + newPrefixLength], temp_fp_path,
+                    temp_fp_path_length, depth_prev);
+                return;
+            }
+
+            Node4* newNode = allocNode<Node4>(this);
             newNode->prefixLength = newPrefixLength;
             memcpy(newNode->prefix, key + depth,
                    min(newPrefixLength, maxPrefixLength));
@@ -102,18 +111,38 @@ class QuART_tail : public ART {
                 this, nodeRef, existingKey[depth + newPrefixLength], node,
                 temp_fp_path, temp_fp_path_length, depth_prev);
             newNode->tailInsertNode4(
-                this, nodeRef, key[depth + newPrefixLength], makeLeaf(value),
+                this, nodeRef, key[depth + newPrefixLength], addLeaf(value),
                 temp_fp_path, temp_fp_path_length, depth_prev);
             return;
         }
 
+        if (isTerminal(node)) {
+            // Add to the interval or bucket in place, or split it and insert
+            // below. Either may have been replaced by a new node
+            bool absorbed = insertIntoTerminal(nodeRef, node, value);
+            if (temp_fp_path[temp_fp_path_length - 1] == node)
+                temp_fp_path[temp_fp_path_length - 1] = *nodeRef;
+            if (absorbed) {
+                if (value >= getLeafValue(tree->fp_leaf)) {
+                    tree->fp_leaf.setKey(value);
+                    tree->fp = temp_fp_path[temp_fp_path_length - 1];
+                    tree->fp_path = temp_fp_path;
+                    tree->fp_path_length = temp_fp_path_length;
+                    tree->fp_depth = depth_prev;
+                    tree->fp_ref = nodeRef;
+                }
+                return;
+            }
+            node = *nodeRef;
+        }
+
         // Handle prefix of inner node
         if (node->prefixLength) {
             unsigned mismatchPos =
                 prefixMismatch(node, key, depth, maxKeyLength);
             if (mismatchPos != node->prefixLength) {
                 // Prefix differs, create new node
-                Node4* newNode = new Node4();
+                Node4* newNode = allocNode<Node4>(this);
                 *nodeRef = newNode;
                 newNode->prefixLength = mismatchPos;
                 memcpy(newNode->prefix, node->prefix,
@@ -134,7 +163,7 @@ class QuART_tail : public ART {
                         // newNode added
                         if (value < getLeafValue(tree->fp)) {
                             // A deep copy of remainder of fp_path
-                            std::array<ArtNode*, maxPrefixLength>
+                            std::array<ArtNode*, maxKeyWidth>
                                 fp_path_remainder;
                             std::copy(
                                 tree->fp_path.begin() +
@@ -163,7 +192,7 @@ class QuART_tail : public ART {
                 } else {
                     node->prefixLength -= (mismatchPos + 1);
                     uint8_t minKey[maxKeyLength];
-                    loadKey(getLeafValue(minimum(node)), minKey);
+                    loadKey(getLeafValue(minimum(node)), minKey, maxKeyLength);
                     // Stores the temp_fp_path and fp_path sizes before
                     // operations
                     size_t temp_fp_path_length_old = temp_fp_path_length;
@@ -178,7 +207,7 @@ class QuART_tail : public ART {
                         // newNode added
                         if (value < getLeafValue(tree->fp)) {
                             // A deep copy of remainder of fp_path
-                            std::array<ArtNode*, maxPrefixLength>
+                            std::array<ArtNode*, maxKeyWidth>
                                 fp_path_remainder;
                             std::copy(
                                 tree->fp_path.begin() +
@@ -205,7 +234,7 @@ class QuART_tail : public ART {
                             min(node->prefixLength, maxPrefixLength));
                 }
                 newNode->tailInsertNode4(
-                    this, nodeRef, key[depth + mismatchPos], makeLeaf(value),
+                    this, nodeRef, key[depth + mismatchPos], addLeaf(value),
                     temp_fp_path, temp_fp_path_length, depth_prev);
                 return;
             }
@@ -213,7 +242,7 @@ class QuART_tail : public ART {
         }
 
         // Recurse
-        ArtNode** child = findChild(node, key[depth]);
+        NodeRef* child = findChild(node, key[depth]);
         if (*child) {
             temp_fp_path[temp_fp_path_length] =
                 *child;  // add the node to the array before recursion
@@ -221,31 +250,22 @@ class QuART_tail : public ART {
             insert_recursive_tail(tree, *child, child, key, depth + 1, value,
                                   maxKeyLength, temp_fp_path,
                                   temp_fp_path_length);
+            countInsert(child);
             return;
         }
 
         // Insert leaf into inner node
-        ArtNode* newNode = makeLeaf(value);
         switch (node->type) {
-            case NodeType4:
-                static_cast<Node4*>(node)->tailInsertNode4(
-                    this, nodeRef, key[depth], newNode, temp_fp_path,
-                    temp_fp_path_length, depth_prev);
-                break;
-            case NodeType16:
-                static_cast<Node16*>(node)->tailInsertNode16(
-                    this, nodeRef, key[depth], newNode, temp_fp_path,
+            case NodeTypeBitmap:
+                static_cast<NodeBitmap*>(node)->tailInsertBitmap(
+                    this, nodeRef, key[depth], temp_fp_path,
                     temp_fp_path_length, depth_prev);
                 break;
-            case NodeType48:
-                static_cast<Node48*>(node)->tailInsertNode48(
-                    this, nodeRef, key[depth], newNode, temp_fp_path,
-                    temp_fp_path_length, depth_prev);
-                break;
-            case NodeType256:
-                static_cast<Node256*>(node)->tailInsertNode256(
-                    this, nodeRef, key[depth], newNode, temp_fp_path,
-                    temp_fp_path_length, depth_prev);
+            default:
+                // Inner nodes of every type on the growth ladder
+                tailInsertChild(this, nodeRef, node, key[depth],
+                                addLeaf(value), temp_fp_path,
+                                temp_fp_path_length, depth_prev);
                 break;
         }
     }